@@ -26,7 +26,9 @@
  */
 
 #include "common/collection.h"
+#include "common/colorlabels.h"
 #include "common/darktable.h"
+#include "common/database.h"
 #include "common/debug.h"
 #include "common/exif.h"
 #include "common/film.h"
@@ -36,6 +38,7 @@
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
+#include "common/mipmap_cache.h"
 #include "common/points.h"
 #include "control/conf.h"
 #include "develop/imageop.h"
@@ -45,6 +48,15 @@
 #include <sys/time.h>
 #include <unistd.h>
 
+#ifndef _WIN32
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+#include <signal.h>
+#include <sys/stat.h>
+#endif
+
 #ifdef __APPLE__
 #include "osx/osx.h"
 #endif
@@ -58,6 +70,9 @@
 static void usage(const char *progname)
 {
   fprintf(stderr, "usage: %s <input file> [<xmp file>] <output file> [options] [--core <darktable options>]\n", progname);
+#ifndef _WIN32
+  fprintf(stderr, "       %s --serve <socket> [--jobs <n>] [options] [--core <darktable options>]\n", progname);
+#endif
   fprintf(stderr, "\n");
   fprintf(stderr, "options:\n");
   fprintf(stderr, "   --width <max width> default: 0 = full resolution\n");
@@ -68,11 +83,510 @@ static void usage(const char *progname)
   fprintf(stderr, "   --style <style name>\n");
   fprintf(stderr, "   --style-overwrite\n");
   fprintf(stderr, "   --apply-custom-presets <0|1|false|true>, default: true\n");
+#ifndef _WIN32
+  fprintf(stderr, "   --serve <socket> export the jobs sent to this unix socket\n");
+  fprintf(stderr, "   --jobs <n> jobs exported at the same time with --serve, default: 2\n");
+#endif
   fprintf(stderr, "   --verbose\n");
   fprintf(stderr, "   --help,-h\n");
   fprintf(stderr, "   --version\n");
 }
 
+// gives an image which is already in the library the history of its own sidecar back,
+// or none if it has no sidecar, as if it had just been imported.
+static void _reload_history(const int id)
+{
+  char filename[PATH_MAX] = { 0 };
+  char sidecar[PATH_MAX] = { 0 };
+  gboolean from_cache = FALSE;
+  dt_image_full_path(id, filename, sizeof(filename), &from_cache);
+  g_strlcpy(sidecar, filename, sizeof(sidecar));
+  dt_image_path_append_version(id, sidecar, sizeof(sidecar));
+  g_strlcat(sidecar, ".xmp", sizeof(sidecar));
+
+  // keeps the full resolution image in the mipmap cache, only the thumbnails go
+  dt_history_delete_on_image_ext(id, FALSE);
+
+  // the xmp of an earlier job left its tags, metadata and labels behind. drop them all but the
+  // darktable tags of the import, the file and the sidecar bring back what belongs to the image.
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "DELETE FROM main.tagged_images"
+                              " WHERE imgid = ?1"
+                              "   AND tagid NOT IN (SELECT id FROM data.tags WHERE name LIKE 'darktable|%')",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.meta_data WHERE id = ?1", -1, &stmt,
+                              NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  dt_colorlabels_remove_labels(id);
+
+  dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'w');
+  (void)dt_exif_read(image, filename);
+  if(g_file_test(sidecar, G_FILE_TEST_EXISTS)) (void)dt_exif_xmp_read(image, sidecar, 0);
+  dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+}
+
+// imports input, a file or a folder, and attaches xmp to all of its images if given. with reload the
+// images are known to be in the library already and start over from their sidecars first.
+// returns a translated error message on failure.
+static gchar *_import_images(const char *input_filename, const char *xmp_filename, const gboolean reload,
+                             GList **id_list)
+{
+  *id_list = NULL;
+
+  if(g_file_test(input_filename, G_FILE_TEST_IS_DIR))
+  {
+    const int filmid = dt_film_import(input_filename);
+    if(!filmid) return g_strdup_printf(_("error: can't open folder %s"), input_filename);
+    *id_list = dt_film_get_image_ids(filmid);
+  }
+  else
+  {
+    dt_film_t film;
+    gchar *directory = g_path_get_dirname(input_filename);
+    const int filmid = dt_film_new(&film, directory);
+    g_free(directory);
+    const int id = dt_image_import(filmid, input_filename, TRUE);
+    if(!id) return g_strdup_printf(_("error: can't open file %s"), input_filename);
+    *id_list = g_list_append(*id_list, GINT_TO_POINTER(id));
+  }
+
+  if(*id_list == NULL) return g_strdup(_("no images to export, aborting\n"));
+
+  if(reload)
+    for(GList *iter = *id_list; iter; iter = g_list_next(iter)) _reload_history(GPOINTER_TO_INT(iter->data));
+
+  // attach xmp, if requested:
+  if(xmp_filename)
+  {
+    for(GList *iter = *id_list; iter; iter = g_list_next(iter))
+    {
+      int id = GPOINTER_TO_INT(iter->data);
+      dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'w');
+      const int failed = dt_exif_xmp_read(image, xmp_filename, 1);
+      // don't write new xmp:
+      dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+      if(failed) return g_strdup_printf(_("error: can't open xmp file %s"), xmp_filename);
+    }
+  }
+
+  return NULL;
+}
+
+// exports the images to output_filename, the format follows from its extension.
+// returns a translated error message on failure.
+static gchar *_export_images(GList *id_list, const char *output_filename, const int width, const int height,
+                             const char *style, const gboolean style_overwrite, const gboolean high_quality,
+                             const gboolean upscale)
+{
+  const int total = g_list_length(id_list);
+
+  // try to find out the export format from the output_filename
+  gchar *filename = g_strdup(output_filename);
+  char *ext = filename + strlen(filename);
+  while(ext > filename && *ext != '.') ext--;
+  *ext = '\0';
+  ext++;
+
+  if(!strcmp(ext, "jpg")) ext = "jpeg";
+
+  if(!strcmp(ext, "tif")) ext = "tiff";
+
+  // init the export data structures
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_storage_t *storage;
+  dt_imageio_module_data_t *sdata, *fdata;
+
+  storage = dt_imageio_get_storage_by_name("disk"); // only exporting to disk makes sense
+  if(storage == NULL)
+  {
+    g_free(filename);
+    return g_strdup(
+        _("cannot find disk storage module. please check your installation, something seems to be broken."));
+  }
+
+  sdata = storage->get_params(storage);
+  if(sdata == NULL)
+  {
+    g_free(filename);
+    return g_strdup(_("failed to get parameters from storage module, aborting export ..."));
+  }
+
+  // and now for the really ugly hacks. don't tell your children about this one or they won't sleep at night
+  // any longer ...
+  g_strlcpy((char *)sdata, filename, DT_MAX_PATH_FOR_PARAMS);
+  // all is good now, the last line didn't happen.
+
+  format = dt_imageio_get_format_by_name(ext);
+  if(format == NULL)
+  {
+    gchar *error = g_strdup_printf(_("unknown extension '.%s'"), ext);
+    storage->free_params(storage, sdata);
+    g_free(filename);
+    return error;
+  }
+  g_free(filename);
+
+  fdata = format->get_params(format);
+  if(fdata == NULL)
+  {
+    storage->free_params(storage, sdata);
+    return g_strdup(_("failed to get parameters from format module, aborting export ..."));
+  }
+
+  uint32_t w, h, fw, fh, sw, sh;
+  fw = fh = sw = sh = 0;
+  storage->dimension(storage, sdata, &sw, &sh);
+  format->dimension(format, fdata, &fw, &fh);
+
+  if(sw == 0 || fw == 0)
+    w = sw > fw ? sw : fw;
+  else
+    w = sw < fw ? sw : fw;
+
+  if(sh == 0 || fh == 0)
+    h = sh > fh ? sh : fh;
+  else
+    h = sh < fh ? sh : fh;
+
+  fdata->max_width = width;
+  fdata->max_height = height;
+  fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
+  fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
+  fdata->style[0] = '\0';
+  fdata->style_append = 1; // make append the default and override with --style-overwrite
+
+  if(style)
+  {
+    g_strlcpy((char *)fdata->style, style, DT_MAX_STYLE_NAME_LENGTH);
+    fdata->style[127] = '\0';
+    if(style_overwrite)
+      fdata->style_append = 0;
+  }
+
+  if(storage->initialize_store)
+  {
+    storage->initialize_store(storage, sdata, &format, &fdata, &id_list, high_quality, upscale);
+
+    format->set_params(format, fdata, format->params_size(format));
+    storage->set_params(storage, sdata, storage->params_size(storage));
+  }
+
+  // TODO: do we want to use the settings from conf?
+  // TODO: expose these via command line arguments
+  dt_colorspaces_color_profile_type_t icc_type = DT_COLORSPACE_NONE;
+  const gchar *icc_filename = NULL;
+  dt_iop_color_intent_t icc_intent = DT_INTENT_LAST;
+
+  // TODO: add a callback to set the bpp without going through the config
+
+  int num = 1, failed = 0;
+  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
+  {
+    int id = GPOINTER_TO_INT(iter->data);
+    // TODO: have a parameter in command line to get the export presets
+    dt_export_metadata_t metadata;
+    metadata.flags = dt_lib_export_metadata_default_flags();
+    metadata.list = NULL;
+    if(storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale,
+                      icc_type, icc_filename, icc_intent, &metadata))
+      failed++;
+  }
+
+  // cleanup time
+  if(storage->finalize_store) storage->finalize_store(storage, sdata);
+  storage->free_params(storage, sdata);
+  format->free_params(format, fdata);
+
+  if(failed) return g_strdup_printf(_("error: %d of %d images couldn't be exported to %s"), failed, total,
+                                    output_filename);
+  return NULL;
+}
+
+#ifndef _WIN32
+/* server mode: one initialized core keeps running and exports the jobs sent to
+ * a unix socket. a job is one line of tab separated key=value fields, with the
+ * keys named after the command line options:
+ *
+ *   input=<file>  [xmp=<file>]  output=<file>  [width=<n>]  [height=<n>]
+ *   [style=<name>]  [style-overwrite=<0|1>]  [hq=<0|1>]  [upscale=<0|1>]
+ *
+ * and is answered by a line "ok" or "error <message>". a connection can send
+ * any number of jobs, they are handled in turn. several connections are served
+ * at the same time. */
+
+typedef struct dt_cli_job_t
+{
+  const char *input, *xmp, *output, *style;
+  int width, height;
+  gboolean style_overwrite, high_quality, upscale;
+} dt_cli_job_t;
+
+typedef struct dt_cli_imported_t
+{
+  int id; // the image in the library
+  gint64 mtime;
+  goffset size;
+} dt_cli_imported_t;
+
+typedef struct dt_cli_server_t
+{
+  dt_cli_job_t defaults; // from the command line
+  // the library is shared: imports are serialized and an image is only in one job at a time.
+  // images stay in the library, so that later jobs on them find the caches warm.
+  GMutex lock;
+  GCond cond;
+  GHashTable *busy;     // input files of the running jobs
+  GHashTable *imported; // input files of all jobs so far, with what they were like back then
+  int running;          // jobs
+  GList *connections;   // the cancellables of the open connections
+  gboolean stopping;
+} dt_cli_server_t;
+
+static gboolean _parse_bool(const char *value, gboolean *result)
+{
+  if(!g_ascii_strcasecmp(value, "0") || !g_ascii_strcasecmp(value, "false"))
+    *result = FALSE;
+  else if(!g_ascii_strcasecmp(value, "1") || !g_ascii_strcasecmp(value, "true"))
+    *result = TRUE;
+  else
+    return FALSE;
+  return TRUE;
+}
+
+static gchar *_serve_job(dt_cli_server_t *server, const char *line)
+{
+  dt_cli_job_t job = server->defaults;
+  job.input = job.xmp = job.output = NULL;
+
+  gchar **fields = g_strsplit(line, "\t", -1);
+  for(gchar **field = fields; *field; field++)
+  {
+    if(!**field) continue;
+    char *value = strchr(*field, '=');
+    if(!value)
+    {
+      gchar *error = g_strdup_printf("malformed field '%s'", *field);
+      g_strfreev(fields);
+      return error;
+    }
+    *value++ = '\0';
+    gboolean ok = TRUE;
+    if(!strcmp(*field, "input"))
+      job.input = value;
+    else if(!strcmp(*field, "xmp"))
+      job.xmp = value;
+    else if(!strcmp(*field, "output"))
+      job.output = value;
+    else if(!strcmp(*field, "style"))
+      job.style = value;
+    else if(!strcmp(*field, "width"))
+      job.width = MAX(atoi(value), 0);
+    else if(!strcmp(*field, "height"))
+      job.height = MAX(atoi(value), 0);
+    else if(!strcmp(*field, "style-overwrite"))
+      ok = _parse_bool(value, &job.style_overwrite);
+    else if(!strcmp(*field, "hq"))
+      ok = _parse_bool(value, &job.high_quality);
+    else if(!strcmp(*field, "upscale"))
+      ok = _parse_bool(value, &job.upscale);
+    else
+      ok = FALSE;
+    if(!ok)
+    {
+      gchar *error = g_strdup_printf("unknown field or value '%s=%s'", *field, value);
+      g_strfreev(fields);
+      return error;
+    }
+  }
+
+  gchar *error = NULL;
+  if(!job.input || !job.output)
+    error = g_strdup("a job needs an input and an output");
+  else if(!g_file_test(job.input, G_FILE_TEST_IS_REGULAR))
+    error = g_strdup_printf(_("error: can't open file %s"), job.input);
+  else if(g_file_test(job.output, G_FILE_TEST_IS_DIR))
+    error = g_strdup(_("error: output file is a directory. please specify file name"));
+  if(error)
+  {
+    g_strfreev(fields);
+    return error;
+  }
+
+  // wait for other jobs on the same image, they might come with another xmp. an image seen before
+  // starts from its sidecar again, like in a fresh darktable-cli. a file which was replaced since
+  // leaves the library with all its cached pixels and is imported anew.
+  GList *id_list = NULL;
+  g_mutex_lock(&server->lock);
+  while(g_hash_table_contains(server->busy, job.input)) g_cond_wait(&server->cond, &server->lock);
+  g_hash_table_add(server->busy, g_strdup(job.input));
+  GStatBuf statbuf = { 0 };
+  const int stat_failed = g_stat(job.input, &statbuf);
+  dt_cli_imported_t *imported = g_hash_table_lookup(server->imported, job.input);
+  if(imported && (stat_failed || imported->mtime != statbuf.st_mtime || imported->size != statbuf.st_size))
+  {
+    dt_mipmap_cache_evict_at_size(darktable.mipmap_cache, imported->id, DT_MIPMAP_FULL);
+    dt_mipmap_cache_evict_at_size(darktable.mipmap_cache, imported->id, DT_MIPMAP_F);
+    dt_image_remove(imported->id);
+    g_hash_table_remove(server->imported, job.input);
+    imported = NULL;
+  }
+  error = _import_images(job.input, job.xmp, imported != NULL, &id_list);
+  if(id_list && !imported && !stat_failed)
+  {
+    imported = g_new(dt_cli_imported_t, 1);
+    imported->id = GPOINTER_TO_INT(id_list->data);
+    imported->mtime = statbuf.st_mtime;
+    imported->size = statbuf.st_size;
+    g_hash_table_insert(server->imported, g_strdup(job.input), imported);
+  }
+  g_mutex_unlock(&server->lock);
+
+  if(!error)
+    error = _export_images(id_list, job.output, job.width, job.height, job.style, job.style_overwrite,
+                           job.high_quality, job.upscale);
+
+  g_mutex_lock(&server->lock);
+  g_hash_table_remove(server->busy, job.input);
+  g_cond_broadcast(&server->cond);
+  g_mutex_unlock(&server->lock);
+
+  g_list_free(id_list);
+  g_strfreev(fields);
+  return error;
+}
+
+// runs in a thread of its own for every connection
+static gboolean _serve_connection(GThreadedSocketService *service, GSocketConnection *connection,
+                                  GObject *source_object, gpointer user_data)
+{
+  dt_cli_server_t *server = (dt_cli_server_t *)user_data;
+  GDataInputStream *in = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+  GOutputStream *out = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+
+  // shutting down cancels the wait for the next job
+  GCancellable *cancellable = g_cancellable_new();
+  g_mutex_lock(&server->lock);
+  const gboolean refused = server->stopping;
+  server->connections = g_list_prepend(server->connections, cancellable);
+  g_mutex_unlock(&server->lock);
+
+  gchar *line;
+  while(!refused && (line = g_data_input_stream_read_line(in, NULL, cancellable, NULL)))
+  {
+    g_mutex_lock(&server->lock);
+    const gboolean stopping = server->stopping;
+    if(!stopping) server->running++;
+    g_mutex_unlock(&server->lock);
+    if(stopping)
+    {
+      g_free(line);
+      break;
+    }
+
+    gchar *error = _serve_job(server, line);
+    if(error) fprintf(stderr, "[darktable-cli] %s: %s\n", line, error);
+    gchar *reply = error ? g_strdup_printf("error %s\n", g_strchomp(error)) : g_strdup("ok\n");
+    g_output_stream_write_all(out, reply, strlen(reply), NULL, NULL, NULL);
+    g_free(reply);
+    g_free(error);
+    g_free(line);
+
+    g_mutex_lock(&server->lock);
+    server->running--;
+    g_cond_broadcast(&server->cond);
+    g_mutex_unlock(&server->lock);
+  }
+
+  g_object_unref(in);
+  g_io_stream_close(G_IO_STREAM(connection), NULL, NULL);
+
+  // the last thing touching the server, which _serve() waits for before it goes away
+  g_mutex_lock(&server->lock);
+  server->connections = g_list_remove(server->connections, cancellable);
+  g_cond_broadcast(&server->cond);
+  g_mutex_unlock(&server->lock);
+  g_object_unref(cancellable);
+  return TRUE;
+}
+
+static gboolean _serve_quit(gpointer user_data)
+{
+  g_main_loop_quit((GMainLoop *)user_data);
+  return G_SOURCE_REMOVE;
+}
+
+// connections accepted before the service stopped may only get a thread later on, so the server
+// lives as long as the service's handler and goes with it
+static void _serve_free(gpointer data, GClosure *closure)
+{
+  dt_cli_server_t *server = (dt_cli_server_t *)data;
+  g_hash_table_destroy(server->busy);
+  g_hash_table_destroy(server->imported);
+  g_mutex_clear(&server->lock);
+  g_cond_clear(&server->cond);
+  g_free(server);
+}
+
+static int _serve(const char *socket_path, const int jobs, const dt_cli_job_t *defaults)
+{
+  // a stale socket of a previous server is in the way, anything else is left alone
+  GStatBuf st;
+  if(!g_lstat(socket_path, &st) && S_ISSOCK(st.st_mode)) g_unlink(socket_path);
+
+  GError *error = NULL;
+  GSocketService *service = g_threaded_socket_service_new(jobs);
+  GSocketAddress *address = g_unix_socket_address_new(socket_path);
+  const gboolean listening = g_socket_listener_add_address(G_SOCKET_LISTENER(service), address,
+                                                           G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT,
+                                                           NULL, NULL, &error);
+  g_object_unref(address);
+  if(!listening)
+  {
+    fprintf(stderr, "[darktable-cli] can't listen on %s: %s\n", socket_path, error->message);
+    g_error_free(error);
+    g_object_unref(service);
+    return 1;
+  }
+
+  dt_cli_server_t *server = g_new0(dt_cli_server_t, 1);
+  server->defaults = *defaults;
+  server->busy = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  server->imported = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  g_mutex_init(&server->lock);
+  g_cond_init(&server->cond);
+
+  GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+  g_signal_connect_data(service, "run", G_CALLBACK(_serve_connection), server, _serve_free, 0);
+  g_unix_signal_add(SIGINT, _serve_quit, loop);
+  g_unix_signal_add(SIGTERM, _serve_quit, loop);
+  g_socket_service_start(service);
+  fprintf(stderr, "[darktable-cli] serving on %s\n", socket_path);
+
+  g_main_loop_run(loop);
+
+  // no new jobs. the running ones finish before the core goes away, and the idle connections
+  // are woken up and closed. connections which are still queued find the server stopping.
+  g_socket_service_stop(service);
+  g_socket_listener_close(G_SOCKET_LISTENER(service));
+  g_unlink(socket_path);
+  g_mutex_lock(&server->lock);
+  server->stopping = TRUE;
+  for(GList *iter = server->connections; iter; iter = g_list_next(iter)) g_cancellable_cancel(iter->data);
+  while(server->running > 0 || server->connections) g_cond_wait(&server->cond, &server->lock);
+  g_mutex_unlock(&server->lock);
+
+  g_object_unref(service);
+  g_main_loop_unref(loop);
+  return 0;
+}
+#endif
+
 int main(int argc, char *arg[])
 {
 #ifdef __APPLE__
@@ -92,6 +606,10 @@ int main(int argc, char *arg[])
   int file_counter = 0;
   int width = 0, height = 0, bpp = 0;
   gboolean verbose = FALSE, high_quality = TRUE, upscale = FALSE, style_overwrite = FALSE, custom_presets = TRUE;
+#ifndef _WIN32
+  char *socket_path = NULL;
+  int jobs = 2;
+#endif
 
   int k;
   for(k = 1; k < argc; k++)
@@ -183,7 +701,18 @@ int main(int argc, char *arg[])
         }
         g_free(str);
       }
-
+#ifndef _WIN32
+      else if(!strcmp(arg[k], "--serve") && argc > k + 1)
+      {
+        k++;
+        socket_path = arg[k];
+      }
+      else if(!strcmp(arg[k], "--jobs") && argc > k + 1)
+      {
+        k++;
+        jobs = MAX(atoi(arg[k]), 1);
+      }
+#endif
       else if(!strcmp(arg[k], "-v") || !strcmp(arg[k], "--verbose"))
       {
         verbose = TRUE;
@@ -217,6 +746,37 @@ int main(int argc, char *arg[])
   for(; k < argc; k++) m_arg[m_argc++] = arg[k];
   m_arg[m_argc] = NULL;
 
+#ifndef _WIN32
+  if(socket_path)
+  {
+    if(file_counter > 0)
+    {
+      usage(arg[0]);
+      free(m_arg);
+      exit(1);
+    }
+
+    // init dt without gui and without data.db:
+    if(dt_init(m_argc, m_arg, FALSE, custom_presets, NULL))
+    {
+      free(m_arg);
+      exit(1);
+    }
+
+    const dt_cli_job_t defaults = { .width = width,
+                                    .height = height,
+                                    .style = style,
+                                    .style_overwrite = style_overwrite,
+                                    .high_quality = high_quality,
+                                    .upscale = upscale };
+    const int res = _serve(socket_path, jobs, &defaults);
+
+    dt_cleanup();
+    free(m_arg);
+    return res;
+  }
+#endif
+
   if(file_counter < 2 || file_counter > 3)
   {
     usage(arg[0]);
@@ -252,68 +812,15 @@ int main(int argc, char *arg[])
   }
 
   GList *id_list = NULL;
-
-  if(g_file_test(input_filename, G_FILE_TEST_IS_DIR))
-  {
-    const int filmid = dt_film_import(input_filename);
-    if(!filmid)
-    {
-      fprintf(stderr, _("error: can't open folder %s"), input_filename);
-      fprintf(stderr, "\n");
-      free(m_arg);
-      exit(1);
-    }
-    id_list = dt_film_get_image_ids(filmid);
-  }
-  else
+  gchar *error = _import_images(input_filename, xmp_filename, FALSE, &id_list);
+  if(error)
   {
-    dt_film_t film;
-    int id = 0;
-    int filmid = 0;
-
-    gchar *directory = g_path_get_dirname(input_filename);
-    filmid = dt_film_new(&film, directory);
-    id = dt_image_import(filmid, input_filename, TRUE);
-    if(!id)
-    {
-      fprintf(stderr, _("error: can't open file %s"), input_filename);
-      fprintf(stderr, "\n");
-      free(m_arg);
-      exit(1);
-    }
-    g_free(directory);
-
-    id_list = g_list_append(id_list, GINT_TO_POINTER(id));
-  }
-
-  const int total = g_list_length(id_list);
-
-  if(total == 0)
-  {
-    fprintf(stderr, _("no images to export, aborting\n"));
+    fprintf(stderr, "%s\n", g_strchomp(error));
+    g_free(error);
     free(m_arg);
     exit(1);
   }
 
-  // attach xmp, if requested:
-  if(xmp_filename)
-  {
-    for(GList *iter = id_list; iter; iter = g_list_next(iter))
-    {
-      int id = GPOINTER_TO_INT(iter->data);
-      dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'w');
-      if(dt_exif_xmp_read(image, xmp_filename, 1) != 0)
-      {
-        fprintf(stderr, _("error: can't open xmp file %s"), xmp_filename);
-        fprintf(stderr, "\n");
-        free(m_arg);
-        exit(1);
-      }
-      // don't write new xmp:
-      dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
-    }
-  }
-
   // print the history stack. only look at the first image and assume all got the same processing applied
   if(verbose)
   {
@@ -325,123 +832,14 @@ int main(int argc, char *arg[])
       printf("[%s]\n", _("empty history stack"));
   }
 
-  // try to find out the export format from the output_filename
-  char *ext = output_filename + strlen(output_filename);
-  while(ext > output_filename && *ext != '.') ext--;
-  *ext = '\0';
-  ext++;
-
-  if(!strcmp(ext, "jpg")) ext = "jpeg";
-
-  if(!strcmp(ext, "tif")) ext = "tiff";
-
-  // init the export data structures
-  dt_imageio_module_format_t *format;
-  dt_imageio_module_storage_t *storage;
-  dt_imageio_module_data_t *sdata, *fdata;
-
-  storage = dt_imageio_get_storage_by_name("disk"); // only exporting to disk makes sense
-  if(storage == NULL)
-  {
-    fprintf(
-        stderr, "%s\n",
-        _("cannot find disk storage module. please check your installation, something seems to be broken."));
-    free(m_arg);
-    exit(1);
-  }
-
-  sdata = storage->get_params(storage);
-  if(sdata == NULL)
+  error = _export_images(id_list, output_filename, width, height, style, style_overwrite, high_quality, upscale);
+  if(error)
   {
-    fprintf(stderr, "%s\n", _("failed to get parameters from storage module, aborting export ..."));
+    fprintf(stderr, "%s\n", error);
+    g_free(error);
     free(m_arg);
     exit(1);
   }
-
-  // and now for the really ugly hacks. don't tell your children about this one or they won't sleep at night
-  // any longer ...
-  g_strlcpy((char *)sdata, output_filename, DT_MAX_PATH_FOR_PARAMS);
-  // all is good now, the last line didn't happen.
-
-  format = dt_imageio_get_format_by_name(ext);
-  if(format == NULL)
-  {
-    fprintf(stderr, _("unknown extension '.%s'"), ext);
-    fprintf(stderr, "\n");
-    free(m_arg);
-    exit(1);
-  }
-
-  fdata = format->get_params(format);
-  if(fdata == NULL)
-  {
-    fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
-    free(m_arg);
-    exit(1);
-  }
-
-  uint32_t w, h, fw, fh, sw, sh;
-  fw = fh = sw = sh = 0;
-  storage->dimension(storage, sdata, &sw, &sh);
-  format->dimension(format, fdata, &fw, &fh);
-
-  if(sw == 0 || fw == 0)
-    w = sw > fw ? sw : fw;
-  else
-    w = sw < fw ? sw : fw;
-
-  if(sh == 0 || fh == 0)
-    h = sh > fh ? sh : fh;
-  else
-    h = sh < fh ? sh : fh;
-
-  fdata->max_width = width;
-  fdata->max_height = height;
-  fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
-  fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
-  fdata->style[0] = '\0';
-  fdata->style_append = 1; // make append the default and override with --style-overwrite
-
-  if(style)
-  {
-    g_strlcpy((char *)fdata->style, style, DT_MAX_STYLE_NAME_LENGTH);
-    fdata->style[127] = '\0';
-    if(style_overwrite)
-      fdata->style_append = 0;
-  }
-
-  if(storage->initialize_store)
-  {
-    storage->initialize_store(storage, sdata, &format, &fdata, &id_list, high_quality, upscale);
-
-    format->set_params(format, fdata, format->params_size(format));
-    storage->set_params(storage, sdata, storage->params_size(storage));
-  }
-
-  // TODO: do we want to use the settings from conf?
-  // TODO: expose these via command line arguments
-  dt_colorspaces_color_profile_type_t icc_type = DT_COLORSPACE_NONE;
-  const gchar *icc_filename = NULL;
-  dt_iop_color_intent_t icc_intent = DT_INTENT_LAST;
-
-  // TODO: add a callback to set the bpp without going through the config
-
-  int num = 1;
-  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
-  {
-    int id = GPOINTER_TO_INT(iter->data);
-    // TODO: have a parameter in command line to get the export presets
-    dt_export_metadata_t metadata;
-    metadata.flags = dt_lib_export_metadata_default_flags();
-    metadata.list = NULL;
-    storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale,
-                   icc_type, icc_filename, icc_intent, &metadata);
-  }
-
-  // cleanup time
-  if(storage->finalize_store) storage->finalize_store(storage, sdata);
-  storage->free_params(storage, sdata);
-  format->free_params(format, fdata);
   g_list_free(id_list);
 
   dt_cleanup();
@@ -81,12 +81,35 @@ size_t dt_bilateral_singlebuffer_size2(const int width,
 }
 #endif
 
-static void image_to_grid(const dt_bilateral_t *const b, const int i, const int j, const float L, float *x,
-                          float *y, float *z)
+// pixels per side of the tiles the splat is scheduled in
+#define DT_COMMON_BILATERAL_SPLAT_TILE 64
+// grid vertices of a row the blur filters at once, its scratch rows live on the stack
+#define DT_COMMON_BILATERAL_BLUR_CHUNK 256
+// grids kept around for dt_bilateral_acquire(), at most so many and so many bytes of them
+#define DT_COMMON_BILATERAL_CACHE_SIZE 16
+#define DT_COMMON_BILATERAL_CACHE_BYTES ((size_t)256 << 20)
+
+// grid cell and offset into it for every image column (or row). all rows share the
+// same x coordinates and all pixels of a row the same y, so this is done once per call.
+static void image_to_grid(const int n, const float sigma_s, const int size, int *const restrict idx,
+                          float *const restrict frac)
 {
-  *x = CLAMPS(i / b->sigma_s, 0, b->size_x - 1);
-  *y = CLAMPS(j / b->sigma_s, 0, b->size_y - 1);
-  *z = CLAMPS(L / b->sigma_r, 0, b->size_z - 1);
+  for(int k = 0; k < n; k++)
+  {
+    const float x = CLAMPS(k / sigma_s, 0, size - 1);
+    const int xi = MIN((int)x, size - 2);
+    idx[k] = xi;
+    frac[k] = x - xi;
+  }
+}
+
+// first column (or row) falling into each of the cells grid cells, start[cells] is one past the end
+static void grid_cell_starts(const int n, const int *const idx, const int cells, int *const start)
+{
+  int c = 0;
+  for(int k = 0; k < n; k++)
+    while(c <= idx[k]) start[c++] = k;
+  while(c <= cells) start[c++] = n;
 }
 
 dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
@@ -110,6 +133,11 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   b->sigma_s = MAX(height / (b->size_y - 1.0f), width / (b->size_x - 1.0f));
   b->sigma_r = 100.0f / (b->size_z - 1.0f);
   b->buf = dt_alloc_align(64, b->size_x * b->size_y * b->size_z * sizeof(float));
+  if(!b->buf)
+  {
+    free(b);
+    return NULL;
+  }
 
   memset(b->buf, 0, b->size_x * b->size_y * b->size_z * sizeof(float));
 #if 0
@@ -120,262 +148,475 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   return b;
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(in:64)
-#endif
 void dt_bilateral_splat(dt_bilateral_t *b, const float *const in)
 {
-  const int ox = 1;
-  const int oy = b->size_x;
-  const int oz = b->size_y * b->size_x;
-  const float sigma_s = b->sigma_s * b->sigma_s;
+  const int width = b->width;
+  const int height = b->height;
+  const int size_x = b->size_x;
+  const int size_y = b->size_y;
+  const int size_z = b->size_z;
+  const size_t oy = size_x;
+  const size_t oz = (size_t)size_y * size_x;
+  const float sigma_r = b->sigma_r;
+  const float norm = 100.0f / (b->sigma_s * b->sigma_s);
   float *const buf = b->buf;
 
-// splat into downsampled grid
+  int *const xi = malloc(sizeof(int) * (width + height + size_x + size_y));
+  int *const yi = xi + width;
+  int *const xstart = yi + height;
+  int *const ystart = xstart + size_x;
+  float *const xf = malloc(sizeof(float) * (width + height));
+  float *const yf = xf + width;
+  image_to_grid(width, b->sigma_s, size_x, xi, xf);
+  image_to_grid(height, b->sigma_s, size_y, yi, yf);
+  grid_cell_starts(width, xi, size_x - 1, xstart);
+  grid_cell_starts(height, yi, size_y - 1, ystart);
+
+  // a tile of cells [c, c + cells) only splats into the cells [c, c + cells], so tiles
+  // two apart never touch the same grid vertex. the four phases over the parities of
+  // the tile coordinates are race free and the summation order does not depend on
+  // the number of threads, unlike a shared grid with unsynchronized +=.
+  const int cells = MAX(1, (int)(DT_COMMON_BILATERAL_SPLAT_TILE / b->sigma_s));
+  const int tiles_x = (size_x - 1 + cells - 1) / cells;
+  const int tiles_y = (size_y - 1 + cells - 1) / cells;
+
+  for(int phase = 0; phase < 4; phase++)
+  {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, oy, oz, ox, sigma_s, buf) \
-  shared(b) \
-  collapse(2)
+  dt_omp_firstprivate(in, buf, xi, yi, xf, yf, xstart, ystart, cells, tiles_x, tiles_y, phase, width, \
+                      size_x, size_y, size_z, oy, oz, sigma_r, norm) \
+  schedule(dynamic) collapse(2)
 #endif
-  for(int j = 0; j < b->height; j++)
-  {
-    for(int i = 0; i < b->width; i++)
+    for(int ty = phase >> 1; ty < tiles_y; ty += 2)
     {
-      size_t index = 4 * (j * b->width + i);
-      float x, y, z;
-      const float L = in[index];
-      image_to_grid(b, i, j, L, &x, &y, &z);
-      const int xi = MIN((int)x, b->size_x - 2);
-      const int yi = MIN((int)y, b->size_y - 2);
-      const int zi = MIN((int)z, b->size_z - 2);
-      const float xf = x - xi;
-      const float yf = y - yi;
-      const float zf = z - zi;
-      // nearest neighbour splatting:
-      const size_t grid_index = xi + b->size_x * (yi + b->size_y * zi);
-      // sum up payload here, doesn't have to be same as edge stopping data
-      // for cross bilateral applications.
-      // also note that this is not clipped (as L->z is), so potentially hdr/out of gamut
-      // should not cause clipping here.
+      for(int tx = phase & 1; tx < tiles_x; tx += 2)
+      {
+        const int j0 = ystart[ty * cells], j1 = ystart[MIN((ty + 1) * cells, size_y - 1)];
+        const int i0 = xstart[tx * cells], i1 = xstart[MIN((tx + 1) * cells, size_x - 1)];
+        for(int j = j0; j < j1; j++)
+        {
+          const size_t row = yi[j] * oy;
+          const float wy[2] = { (1.0f - yf[j]) * norm, yf[j] * norm };
+          for(int i = i0; i < i1; i++)
+          {
+            const float L = in[4 * ((size_t)j * width + i)];
+            const float z = CLAMPS(L / sigma_r, 0, size_z - 1);
+            const int zi = MIN((int)z, size_z - 2);
+            const float zf = z - zi;
+            const float wx[2] = { 1.0f - xf[i], xf[i] };
+            const float wz[2] = { 1.0f - zf, zf };
+            // nearest neighbour splatting:
+            const size_t grid_index = xi[i] + row + zi * oz;
+            // sum up payload here, doesn't have to be same as edge stopping data
+            // for cross bilateral applications.
+            // also note that this is not clipped (as L->z is), so potentially hdr/out of gamut
+            // should not cause clipping here.
 #ifdef _OPENMP
 #pragma omp simd aligned(buf:64)
 #endif
-      for(int k = 0; k < 8; k++)
-      {
-        const size_t ii = grid_index + ((k & 1) ? ox : 0) + ((k & 2) ? oy : 0) + ((k & 4) ? oz : 0);
-        const float contrib = ((k & 1) ? xf : (1.0f - xf)) * ((k & 2) ? yf : (1.0f - yf))
-                              * ((k & 4) ? zf : (1.0f - zf)) * 100.0f / sigma_s;
-        buf[ii] += contrib;
+            for(int k = 0; k < 8; k++)
+            {
+              const size_t ii = grid_index + (k & 1) + ((k & 2) ? oy : 0) + ((k & 4) ? oz : 0);
+              buf[ii] += wx[k & 1] * wy[(k >> 1) & 1] * wz[k >> 2];
+            }
+          }
+        }
       }
     }
   }
+
+  free(xi);
+  free(xf);
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(buf:64)
-#endif
-static void blur_line_z(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
-                        const int size2, const int size3)
+// blurs one line of size3 grid vertices offset3 apart, for size2 lines offset2 apart.
+// the lines along x are contiguous in memory and are done one after the other.
+static void blur_line(float *buf, const int offset2, const int offset3, const int size2, const int size3)
 {
+  const float w0 = 6.f / 16.f;
   const float w1 = 4.f / 16.f;
-  const float w2 = 2.f / 16.f;
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(size1, size2, size3, offset1, offset2, offset3, w1, w2) \
-    shared(buf)
-#endif
-  for(int k = 0; k < size1; k++)
+  const float w2 = 1.f / 16.f;
+  size_t index = 0;
+  for(int j = 0; j < size2; j++)
   {
-    size_t index = (size_t)k * offset1;
-    for(int j = 0; j < size2; j++)
+    float tmp1 = buf[index];
+    buf[index] = buf[index] * w0 + w1 * buf[index + offset3] + w2 * buf[index + 2 * offset3];
+    index += offset3;
+    float tmp2 = buf[index];
+    buf[index] = buf[index] * w0 + w1 * (buf[index + offset3] + tmp1) + w2 * buf[index + 2 * offset3];
+    index += offset3;
+    for(int i = 2; i < size3 - 2; i++)
     {
-      float tmp1 = buf[index];
-      buf[index] = w1 * buf[index + offset3] + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      float tmp2 = buf[index];
-      buf[index] = w1 * (buf[index + offset3] - tmp1) + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      for(int i = 2; i < size3 - 2; i++)
-      {
-        const float tmp3 = buf[index];
-        buf[index] = +w1 * (buf[index + offset3] - tmp2) + w2 * (buf[index + 2 * offset3] - tmp1);
-        index += offset3;
-        tmp1 = tmp2;
-        tmp2 = tmp3;
-      }
       const float tmp3 = buf[index];
-      buf[index] = w1 * (buf[index + offset3] - tmp2) - w2 * tmp1;
+      buf[index]
+          = buf[index] * w0 + w1 * (buf[index + offset3] + tmp2) + w2 * (buf[index + 2 * offset3] + tmp1);
       index += offset3;
-      buf[index] = -w1 * tmp3 - w2 * tmp2;
-      index += offset3;
-      index += offset2 - offset3 * size3;
+      tmp1 = tmp2;
+      tmp2 = tmp3;
     }
+    const float tmp3 = buf[index];
+    buf[index] = buf[index] * w0 + w1 * (buf[index + offset3] + tmp2) + w2 * tmp1;
+    index += offset3;
+    buf[index] = buf[index] * w0 + w1 * tmp3 + w2 * tmp2;
+    index += offset3;
+    index += offset2 - offset3 * size3;
   }
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(buf:64)
-#endif
-static void blur_line(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
-                      const int size2, const int size3)
+// same filter as blur_line() (or its derivative for z) along n rows stride apart, for the
+// width contiguous vertices of a row at once so the inner loops vectorize. missing
+// neighbours past the ends are zero, which gives bit for bit the boundary terms of the
+// line by line version. tmp holds 4 * width floats.
+static void blur_rows(float *const buf, const size_t stride, const int n, const int width, const int derivative,
+                      float *const tmp)
 {
   const float w0 = 6.f / 16.f;
   const float w1 = 4.f / 16.f;
-  const float w2 = 1.f / 16.f;
+  const float w2 = derivative ? 2.f / 16.f : 1.f / 16.f;
+  // unfiltered rows i - 2 and i - 1, a copy of row i and a row of zeros
+  float *prev2 = tmp, *prev1 = tmp + width, *cur = tmp + 2 * width;
+  const float *const zero = tmp + 3 * width;
+  memset(tmp, 0, sizeof(float) * 2 * width);
+  memset(tmp + 3 * width, 0, sizeof(float) * width);
+
+  for(int i = 0; i < n; i++)
+  {
+    float *const restrict row = buf + i * stride;
+    const float *const restrict next1 = i + 1 < n ? row + stride : zero;
+    const float *const restrict next2 = i + 2 < n ? row + 2 * stride : zero;
+    const float *const restrict p1 = prev1;
+    const float *const restrict p2 = prev2;
+    memcpy(cur, row, sizeof(float) * width);
+    if(derivative)
+    {
+      // -2 derivative of the gaussian up to 3 sigma: x*exp(-x*x)
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(size1, size2, size3, offset1, offset2, offset3, w0, w1, w2) \
-    shared(buf)
+#pragma omp simd
 #endif
-  for(int k = 0; k < size1; k++)
-  {
-    size_t index = (size_t)k * offset1;
-    for(int j = 0; j < size2; j++)
+      for(int k = 0; k < width; k++) row[k] = w1 * (next1[k] - p1[k]) + w2 * (next2[k] - p2[k]);
+    }
+    else
     {
-      float tmp1 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * buf[index + offset3] + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      float tmp2 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * (buf[index + offset3] + tmp1) + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      for(int i = 2; i < size3 - 2; i++)
-      {
-        const float tmp3 = buf[index];
-        buf[index]
-            = buf[index] * w0 + w1 * (buf[index + offset3] + tmp2) + w2 * (buf[index + 2 * offset3] + tmp1);
-        index += offset3;
-        tmp1 = tmp2;
-        tmp2 = tmp3;
-      }
-      const float tmp3 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * (buf[index + offset3] + tmp2) + w2 * tmp1;
-      index += offset3;
-      buf[index] = buf[index] * w0 + w1 * tmp3 + w2 * tmp2;
-      index += offset3;
-      index += offset2 - offset3 * size3;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int k = 0; k < width; k++)
+        row[k] = row[k] * w0 + w1 * (next1[k] + p1[k]) + w2 * (next2[k] + p2[k]);
     }
+    float *const t = prev2;
+    prev2 = prev1;
+    prev1 = cur;
+    cur = t;
   }
 }
 
+// blur_rows() for rows of any width, a chunk of columns after the other. the columns are
+// independent, so this gives the same result without a scratch buffer which could fail.
+static void blur_rows_chunked(float *const buf, const size_t stride, const int n, const int width,
+                              const int derivative)
+{
+  float tmp[4 * DT_COMMON_BILATERAL_BLUR_CHUNK] __attribute__((aligned(64)));
+  for(int x = 0; x < width; x += DT_COMMON_BILATERAL_BLUR_CHUNK)
+    blur_rows(buf + x, stride, n, MIN(DT_COMMON_BILATERAL_BLUR_CHUNK, width - x), derivative, tmp);
+}
 
 void dt_bilateral_blur(dt_bilateral_t *b)
 {
-  // gaussian up to 3 sigma
-  blur_line(b->buf, b->size_x * b->size_y, b->size_x, 1, b->size_z, b->size_y, b->size_x);
-  // gaussian up to 3 sigma
-  blur_line(b->buf, b->size_x * b->size_y, 1, b->size_x, b->size_z, b->size_x, b->size_y);
-  // -2 derivative of the gaussian up to 3 sigma: x*exp(-x*x)
-  blur_line_z(b->buf, 1, b->size_x, b->size_x * b->size_y, b->size_x, b->size_y, b->size_z);
-}
+  const int size_x = b->size_x;
+  const int size_y = b->size_y;
+  const int size_z = b->size_z;
+  const size_t oz = (size_t)size_x * size_y;
+  float *const buf = b->buf;
 
+  // gaussian up to 3 sigma along x and y, one z slice at a time so the second pass
+  // finds the slice in cache
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, size_x, size_y, size_z, oz) \
+  schedule(static)
+#endif
+  for(int k = 0; k < size_z; k++)
+  {
+    float *const slice = buf + k * oz;
+    blur_line(slice, size_x, 1, size_y, size_x);
+    blur_rows_chunked(slice, size_x, size_y, size_x, 0);
+  }
 
+  // -2 derivative of the gaussian up to 3 sigma along z, for one row of x at a time
 #ifdef _OPENMP
-#pragma omp declare simd aligned(out, in :64)
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, size_x, size_y, size_z, oz) \
+  schedule(static)
 #endif
+  for(int j = 0; j < size_y; j++) blur_rows_chunked(buf + (size_t)j * size_x, oz, size_z, size_x, 1);
+}
+
+// trilinear lookup of the grid at the row and column coordinates from image_to_grid() and the luma L
+static inline float grid_lookup(const float *const buf, const int size_x, const size_t oz, const float sigma_r,
+                                const int size_z, const int xi, const float xf, const size_t row,
+                                const float yf, const float L)
+{
+  const float z = CLAMPS(L / sigma_r, 0, size_z - 1);
+  const int zi = MIN((int)z, size_z - 2);
+  const float zf = z - zi;
+  const size_t gi = xi + row + zi * oz;
+  const size_t ox = 1;
+  const size_t oy = size_x;
+  return buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
+         + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
+         + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
+         + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
+         + buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
+         + buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
+         + buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
+         + buf[gi + ox + oy + oz] * (xf) * (yf) * (zf);
+}
+
 void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, float *out, const float detail)
 {
   // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
   const float norm = -detail * b->sigma_r * 0.04f;
-  const int ox = 1;
-  const int oy = b->size_x;
-  const int oz = b->size_y * b->size_x;
-  float *const buf = b->buf;
+  const float *const buf = b->buf;
   const int size_x = b->size_x;
   const int size_y = b->size_y;
   const int size_z = b->size_z;
+  const size_t oz = (size_t)size_y * size_x;
+  const float sigma_r = b->sigma_r;
   const int width = b->width;
   const int height = b->height;
 
+  int *const xi = malloc(sizeof(int) * width);
+  float *const xf = malloc(sizeof(float) * width);
+  image_to_grid(width, b->sigma_s, size_x, xi, xf);
+  const float sigma_s = b->sigma_s;
+
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(b, in, norm, ox, oy, oz, size_x, size_y, size_z, height, width, buf) \
-    shared(out) collapse(2)
+  dt_omp_firstprivate(in, norm, xi, xf, size_x, size_y, size_z, oz, sigma_r, sigma_s, height, width, buf) \
+  shared(out) schedule(static)
 #endif
   for(int j = 0; j < height; j++)
   {
+    const float y = CLAMPS(j / sigma_s, 0, size_y - 1);
+    const int yi = MIN((int)y, size_y - 2);
+    const float yf = y - yi;
+    const size_t row = (size_t)yi * size_x;
     for(int i = 0; i < width; i++)
     {
-      size_t index = 4 * (j * width + i);
-      float x, y, z;
+      const size_t index = 4 * ((size_t)j * width + i);
       const float L = in[index];
-      image_to_grid(b, i, j, L, &x, &y, &z);
-      // trilinear lookup:
-      const int xi = MIN((int)x, size_x - 2);
-      const int yi = MIN((int)y, size_y - 2);
-      const int zi = MIN((int)z, size_z - 2);
-      const float xf = x - xi;
-      const float yf = y - yi;
-      const float zf = z - zi;
-      const size_t gi = xi + size_x * (yi + size_y * zi);
-      const float Lout = L
-                         + norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
-                                   + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
-                                   + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
-                                   + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
-                                   + buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
-                                   + buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
-                                   + buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
-                                   + buf[gi + ox + oy + oz] * (xf) * (yf) * (zf));
-      out[index] = Lout;
+      out[index] = L + norm * grid_lookup(buf, size_x, oz, sigma_r, size_z, xi[i], xf[i], row, yf, L);
       // and copy color and mask
       out[index + 1] = in[index + 1];
       out[index + 2] = in[index + 2];
       out[index + 3] = in[index + 3];
     }
   }
+
+  free(xi);
+  free(xf);
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(out, in :64)
-#endif
 void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *const in, float *out,
                                   const float detail)
 {
   // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
   const float norm = -detail * b->sigma_r * 0.04f;
-  const int ox = 1;
-  const int oy = b->size_x;
-  const int oz = b->size_y * b->size_x;
-  float *const buf = b->buf;
+  const float *const buf = b->buf;
   const int size_x = b->size_x;
   const int size_y = b->size_y;
   const int size_z = b->size_z;
+  const size_t oz = (size_t)size_y * size_x;
+  const float sigma_r = b->sigma_r;
   const int width = b->width;
   const int height = b->height;
 
+  int *const xi = malloc(sizeof(int) * width);
+  float *const xf = malloc(sizeof(float) * width);
+  image_to_grid(width, b->sigma_s, size_x, xi, xf);
+  const float sigma_s = b->sigma_s;
+
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(b, in, norm, oy, oz, ox, buf, size_x, size_y, size_z, width, height) \
-  shared(out) collapse(2)
+  dt_omp_firstprivate(in, norm, xi, xf, size_x, size_y, size_z, oz, sigma_r, sigma_s, height, width, buf) \
+  shared(out) schedule(static)
 #endif
   for(int j = 0; j < height; j++)
   {
+    const float y = CLAMPS(j / sigma_s, 0, size_y - 1);
+    const int yi = MIN((int)y, size_y - 2);
+    const float yf = y - yi;
+    const size_t row = (size_t)yi * size_x;
     for(int i = 0; i < width; i++)
     {
-      size_t index = 4 * (j * width + i);
-      float x, y, z;
+      const size_t index = 4 * ((size_t)j * width + i);
       const float L = in[index];
-      image_to_grid(b, i, j, L, &x, &y, &z);
-      // trilinear lookup:
-      const int xi = MIN((int)x, size_x - 2);
-      const int yi = MIN((int)y, size_y - 2);
-      const int zi = MIN((int)z, size_z - 2);
-      const float xf = x - xi;
-      const float yf = y - yi;
-      const float zf = z - zi;
-      const size_t gi = xi + size_x * (yi + size_y * zi);
-      const float Lout = norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
-                                 + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
-                                 + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
-                                 + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
-                                 + buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
-                                 + buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
-                                 + buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
-                                 + buf[gi + ox + oy + oz] * (xf) * (yf) * (zf));
+      const float Lout = norm * grid_lookup(buf, size_x, oz, sigma_r, size_z, xi[i], xf[i], row, yf, L);
       out[index] = MAX(0.0f, out[index] + Lout);
     }
   }
+
+  free(xi);
+  free(xf);
+}
+
+/* modules like shadhi, bilat or monochrome slice the same grid again when only
+ * their slicing parameters change, and the preview and full pipes may see the
+ * very same input. the grid only depends on the splatted buffer and the
+ * geometry, so the last few are kept, read-only, keyed by a hash of the buffer.
+ * they are bounded by their total size, and go with the pipe which built them.
+ * any pipe may slice a cached grid, so one can be dropped while others still
+ * slice it: it then stays in its slot, no longer found, until the last release. */
+typedef struct dt_bilateral_cache_entry_t
+{
+  uint64_t hash;
+  int width, height;
+  float sigma_s, sigma_r;
+  dt_bilateral_t *b;
+  size_t bytes;
+  const void *pipe;
+  int users;
+  gboolean dropped; // waits for its users to free it
+  uint64_t age;
+} dt_bilateral_cache_entry_t;
+
+static struct
+{
+  GMutex lock;
+  uint64_t clock;
+  size_t bytes;
+  dt_bilateral_cache_entry_t entry[DT_COMMON_BILATERAL_CACHE_SIZE];
+} grid_cache;
+
+static size_t grid_bytes(const dt_bilateral_t *const b)
+{
+  return b->size_x * b->size_y * b->size_z * sizeof(float);
+}
+
+// called with the lock held. a grid which is being sliced is only marked, the last
+// dt_bilateral_release() frees it.
+static void cache_drop(dt_bilateral_cache_entry_t *const e)
+{
+  if(e->users)
+  {
+    e->dropped = TRUE;
+    return;
+  }
+  dt_bilateral_free(e->b);
+  grid_cache.bytes -= e->bytes;
+  *e = (dt_bilateral_cache_entry_t){ 0 };
+}
+
+dt_bilateral_t *dt_bilateral_acquire(const void *const pipe, const uint64_t hash, const float *const in,
+                                     const int width, const int height, const float sigma_s,
+                                     const float sigma_r)
+{
+  // a zero hash asks for a private grid, as for tiles which would just thrash the cache
+  if(!hash)
+  {
+    dt_bilateral_t *b = dt_bilateral_init(width, height, sigma_s, sigma_r);
+    if(!b) return NULL;
+    dt_bilateral_splat(b, in);
+    dt_bilateral_blur(b);
+    return b;
+  }
+
+  g_mutex_lock(&grid_cache.lock);
+  for(int k = 0; k < DT_COMMON_BILATERAL_CACHE_SIZE; k++)
+  {
+    dt_bilateral_cache_entry_t *e = &grid_cache.entry[k];
+    if(e->b && !e->dropped && e->hash == hash && e->width == width && e->height == height
+       && e->sigma_s == sigma_s && e->sigma_r == sigma_r)
+    {
+      e->users++;
+      e->age = ++grid_cache.clock;
+      g_mutex_unlock(&grid_cache.lock);
+      return e->b;
+    }
+  }
+  g_mutex_unlock(&grid_cache.lock);
+
+  dt_bilateral_t *b = dt_bilateral_init(width, height, sigma_s, sigma_r);
+  if(!b) return NULL;
+  dt_bilateral_splat(b, in);
+  dt_bilateral_blur(b);
+
+  const size_t bytes = grid_bytes(b);
+  if(bytes > DT_COMMON_BILATERAL_CACHE_BYTES) return b;
+
+  // make room by dropping the least recently used grids nobody is slicing
+  g_mutex_lock(&grid_cache.lock);
+  dt_bilateral_cache_entry_t *slot = NULL;
+  while(TRUE)
+  {
+    dt_bilateral_cache_entry_t *victim = NULL;
+    slot = NULL;
+    for(int k = 0; k < DT_COMMON_BILATERAL_CACHE_SIZE; k++)
+    {
+      dt_bilateral_cache_entry_t *e = &grid_cache.entry[k];
+      if(!e->b)
+        slot = e;
+      else if(!e->users && (!victim || e->age < victim->age))
+        victim = e;
+    }
+    if(slot && grid_cache.bytes + bytes <= DT_COMMON_BILATERAL_CACHE_BYTES) break;
+    if(!victim)
+    {
+      // everything left is in use, the new grid stays private
+      slot = NULL;
+      break;
+    }
+    cache_drop(victim);
+  }
+  if(slot)
+  {
+    *slot = (dt_bilateral_cache_entry_t){ .hash = hash, .width = width, .height = height,
+                                          .sigma_s = sigma_s, .sigma_r = sigma_r, .b = b, .bytes = bytes,
+                                          .pipe = pipe, .users = 1, .age = ++grid_cache.clock };
+    grid_cache.bytes += bytes;
+  }
+  g_mutex_unlock(&grid_cache.lock);
+
+  return b;
+}
+
+void dt_bilateral_release(dt_bilateral_t *b)
+{
+  if(!b) return;
+
+  g_mutex_lock(&grid_cache.lock);
+  for(int k = 0; k < DT_COMMON_BILATERAL_CACHE_SIZE; k++)
+  {
+    dt_bilateral_cache_entry_t *e = &grid_cache.entry[k];
+    if(e->b == b)
+    {
+      e->users--;
+      if(e->dropped && !e->users) cache_drop(e);
+      g_mutex_unlock(&grid_cache.lock);
+      return;
+    }
+  }
+  g_mutex_unlock(&grid_cache.lock);
+
+  // a private grid
+  dt_bilateral_free(b);
+}
+
+void dt_bilateral_cache_drop(const void *const pipe)
+{
+  g_mutex_lock(&grid_cache.lock);
+  for(int k = 0; k < DT_COMMON_BILATERAL_CACHE_SIZE; k++)
+  {
+    dt_bilateral_cache_entry_t *e = &grid_cache.entry[k];
+    if(e->b && !e->dropped && (!pipe || e->pipe == pipe)) cache_drop(e);
+  }
+  g_mutex_unlock(&grid_cache.lock);
+}
+
+void dt_bilateral_cleanup(void)
+{
+  dt_bilateral_cache_drop(NULL);
 }
 
 void dt_bilateral_free(dt_bilateral_t *b)
@@ -387,6 +628,9 @@ void dt_bilateral_free(dt_bilateral_t *b)
 
 #undef DT_COMMON_BILATERAL_MAX_RES_S
 #undef DT_COMMON_BILATERAL_MAX_RES_R
+#undef DT_COMMON_BILATERAL_SPLAT_TILE
+#undef DT_COMMON_BILATERAL_CACHE_SIZE
+#undef DT_COMMON_BILATERAL_CACHE_BYTES
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
 
 typedef struct dt_bilateral_t
 {
@@ -64,6 +65,28 @@ void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *co
 
 void dt_bilateral_free(dt_bilateral_t *b);
 
+// returns the splatted and blurred grid of the buffer identified by hash, only building it from in
+// when no grid of the same buffer and geometry is cached. slice it, then hand it back with
+// dt_bilateral_release(), never modify or free it. a hash of 0 always builds a private grid.
+// a grid built here is cached until dt_bilateral_cache_drop() for its pipe, or until it makes
+// room for others.
+dt_bilateral_t *dt_bilateral_acquire(const void *const pipe, // the pixelpipe asking
+                                     const uint64_t hash,    // hash of the contents of in, or 0
+                                     const float *const in,
+                                     const int width,      // width of input image
+                                     const int height,     // height of input image
+                                     const float sigma_s,  // spatial sigma (blur pixel coords)
+                                     const float sigma_r); // range sigma (blur luma values)
+
+void dt_bilateral_release(dt_bilateral_t *b);
+
+// drops the cached grids which pipe has built, those of all pipes for NULL. grids still being
+// sliced stay valid until their last dt_bilateral_release().
+void dt_bilateral_cache_drop(const void *const pipe);
+
+// drops the cached grids
+void dt_bilateral_cleanup(void);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
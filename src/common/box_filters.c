@@ -0,0 +1,196 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/box_filters.h"
+#include "common/darktable.h"
+
+#include <math.h>
+#include <string.h>
+
+// number of columns filtered together in the vertical pass
+#define LANES 16
+
+typedef enum dt_box_filter_t
+{
+  DT_BOX_MEAN,
+  DT_BOX_MIN,
+  DT_BOX_MAX
+} dt_box_filter_t;
+
+/* all one dimensional filters work on lanes interleaved signals of length n:
+ * element i of lane l is in[i * in_stride + l] and out[i * out_stride + l].
+ * in and out may be the same, the input is read completely into the scratch
+ * space before anything is written. */
+
+// moving mean by differences of running sums, sums holds (n + 1) * lanes doubles
+static inline void box_mean_1d(const float *const in, const size_t in_stride, float *const out,
+                               const size_t out_stride, const size_t n, const int lanes, const size_t radius,
+                               double *const restrict sums)
+{
+  for(int l = 0; l < lanes; l++) sums[l] = 0.0;
+  for(size_t i = 0; i < n; i++)
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int l = 0; l < lanes; l++) sums[(i + 1) * lanes + l] = sums[i * lanes + l] + in[i * in_stride + l];
+  }
+  for(size_t i = 0; i < n; i++)
+  {
+    const size_t lo = i > radius ? i - radius : 0;
+    const size_t hi = MIN(i + radius + 1, n);
+    const double norm = 1.0 / (hi - lo);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int l = 0; l < lanes; l++)
+      out[i * out_stride + l] = (sums[hi * lanes + l] - sums[lo * lanes + l]) * norm;
+  }
+}
+
+// length of the signal padded by radius on both sides and rounded up to whole windows
+static inline size_t padded_length(const size_t n, const size_t radius)
+{
+  const size_t k = 2 * radius + 1;
+  return (n + 2 * radius + k - 1) / k * k;
+}
+
+static inline float minmax(const float a, const float b, const int is_max)
+{
+  return is_max ? fmaxf(a, b) : fminf(a, b);
+}
+
+// van Herk/Gil-Werman moving extremum: the padded signal is cut into blocks of
+// the window size k, g runs forward and h backward within every block, and each
+// window [i, i + k - 1] spans exactly one block boundary, so its extremum is
+// that of h[i] and g[i + k - 1]. g and h hold padded_length(n, radius) * lanes floats.
+static inline void box_minmax_1d(const float *const in, const size_t in_stride, float *const out,
+                                 const size_t out_stride, const size_t n, const int lanes, const size_t radius,
+                                 const int is_max, float *const restrict g, float *const restrict h)
+{
+  const size_t k = 2 * radius + 1;
+  const size_t m = padded_length(n, radius);
+  const float pad = is_max ? -INFINITY : INFINITY;
+
+  for(size_t j = 0; j < m; j++)
+  {
+    const int inside = j >= radius && j - radius < n;
+    for(int l = 0; l < lanes; l++) g[j * lanes + l] = inside ? in[(j - radius) * in_stride + l] : pad;
+  }
+  memcpy(h, g, sizeof(float) * m * lanes);
+
+  for(size_t j = 0; j < m; j++)
+  {
+    if(j % k == 0) continue;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int l = 0; l < lanes; l++) g[j * lanes + l] = minmax(g[(j - 1) * lanes + l], g[j * lanes + l], is_max);
+  }
+  for(size_t j = m - 1; j-- > 0;)
+  {
+    if((j + 1) % k == 0) continue;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int l = 0; l < lanes; l++) h[j * lanes + l] = minmax(h[(j + 1) * lanes + l], h[j * lanes + l], is_max);
+  }
+
+  for(size_t i = 0; i < n; i++)
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int l = 0; l < lanes; l++)
+      out[i * out_stride + l] = minmax(h[i * lanes + l], g[(i + k - 1) * lanes + l], is_max);
+  }
+}
+
+static inline void box_filter_1d(const float *const in, const size_t in_stride, float *const out,
+                                 const size_t out_stride, const size_t n, const int lanes, const size_t radius,
+                                 const dt_box_filter_t filter, void *const scratch)
+{
+  if(filter == DT_BOX_MEAN)
+    box_mean_1d(in, in_stride, out, out_stride, n, lanes, radius, (double *)scratch);
+  else
+  {
+    float *const g = (float *)scratch;
+    float *const h = g + padded_length(n, radius) * lanes;
+    box_minmax_1d(in, in_stride, out, out_stride, n, lanes, radius, filter == DT_BOX_MAX, g, h);
+  }
+}
+
+// the box is separable: rows first, then strips of LANES columns at once
+__DT_CLONE_TARGETS__
+static void box_filter(float *const buf, const size_t height, const size_t width, const int ch, const int radius,
+                       const dt_box_filter_t filter)
+{
+  if(radius <= 0 || width == 0 || height == 0) return;
+
+  const size_t r = radius;
+  const size_t row = width * ch;
+  const size_t lanes = MAX(ch, LANES);
+  const size_t len = MAX(width, height);
+  const size_t scratch_size = (filter == DT_BOX_MEAN) ? sizeof(double) * (len + 1) * lanes
+                                                      : sizeof(float) * 2 * padded_length(len, r) * lanes;
+
+  // scratch space is allocated per thread inside the parallel region, so that
+  // callers that are already parallel (and get a single thread here) work, too
+#ifdef _OPENMP
+#pragma omp parallel default(none) \
+  dt_omp_firstprivate(buf, ch, filter, height, r, row, scratch_size, width)
+#endif
+  {
+    void *const scratch = dt_alloc_align(64, scratch_size);
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(size_t j = 0; j < height; j++)
+      box_filter_1d(buf + j * row, ch, buf + j * row, ch, width, ch, r, filter, scratch);
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(size_t x = 0; x < row; x += LANES)
+      box_filter_1d(buf + x, row, buf + x, row, height, MIN(LANES, row - x), r, filter, scratch);
+
+    dt_free_align(scratch);
+  }
+}
+
+void dt_box_mean(float *const buf, const size_t height, const size_t width, const int ch, const int radius)
+{
+  box_filter(buf, height, width, ch, radius, DT_BOX_MEAN);
+}
+
+void dt_box_min(float *const buf, const size_t height, const size_t width, const int ch, const int radius)
+{
+  box_filter(buf, height, width, ch, radius, DT_BOX_MIN);
+}
+
+void dt_box_max(float *const buf, const size_t height, const size_t width, const int ch, const int radius)
+{
+  box_filter(buf, height, width, ch, radius, DT_BOX_MAX);
+}
+
+#undef LANES
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,37 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+/* moving window filters over boxes of (2*radius+1) x (2*radius+1) pixels of
+ * an image with ch interleaved channels. they work in place, crop the box at
+ * the image borders and take constant time per pixel whatever the radius.
+ * they may be called from within an OpenMP parallel region. */
+
+// mean over the box, from running sums (one dimensional integral images) in double precision
+void dt_box_mean(float *const buf, const size_t height, const size_t width, const int ch, const int radius);
+
+// minimum and maximum over the box, van Herk/Gil-Werman: three comparisons per pixel and pass
+void dt_box_min(float *const buf, const size_t height, const size_t width, const int ch, const int radius);
+void dt_box_max(float *const buf, const size_t height, const size_t width, const int ch, const int radius);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -17,6 +17,7 @@
 */
 
 #include "common/collection.h"
+#include "common/database.h"
 #include "common/debug.h"
 #include "common/image.h"
 #include "common/imageio_rawspeed.h"
@@ -55,19 +56,38 @@ static const char *comparators[] = {
 static int _dt_collection_store(const dt_collection_t *collection, gchar *query, gchar *query_no_group);
 /* Counts the number of images in the current collection */
 static uint32_t _dt_collection_compute_count(const dt_collection_t *collection, gboolean no_group);
+/* Materializes the image ids of the current collection, returns their number */
+static uint32_t _dt_collection_compute_ids(const dt_collection_t *collection);
+/* Drops the materialized image ids, they are recomputed on next use */
+static void _dt_collection_invalidate_ids(const dt_collection_t *collection);
+/* bumped whenever image properties used to sort or filter collections change */
+static gint _ids_generation = 0;
+/* Updates count and count_no_group, avoiding duplicate queries when possible */
+static void _dt_collection_update_counts(const dt_collection_t *collection);
 /* signal handlers to update the cached count when something interesting might have happened.
  * we need 2 different since there are different kinds of signals we need to listen to. */
 static void _dt_collection_recount_callback_1(gpointer instace, gpointer user_data);
 static void _dt_collection_recount_callback_2(gpointer instance, uint8_t id, gpointer user_data);
+static void _dt_collection_changed_callback(gpointer instance, gpointer user_data);
 
 /* determine image offset of specified imgid for the given collection */
 static int dt_collection_image_offset_with_collection(const dt_collection_t *collection, int imgid);
 /* update aspect ratio for the selected images */
 static void _collection_update_aspect_ratio(const dt_collection_t *collection);
 
+/* the materialized ids of every collection carry the generation they were computed at, a new one makes
+ * them all stale at once */
+void dt_collection_images_changed(void)
+{
+  g_atomic_int_inc(&_ids_generation);
+}
+
 const dt_collection_t *dt_collection_new(const dt_collection_t *clone)
 {
   dt_collection_t *collection = g_malloc0(sizeof(dt_collection_t));
+  g_mutex_init(&collection->ids_lock);
+  collection->ids = g_array_new(FALSE, FALSE, sizeof(int32_t));
+  collection->ids_offset = g_hash_table_new(g_direct_hash, g_direct_equal);
 
   /* initialize collection context*/
   if(clone) /* if clone is provided let's copy it into this context */
@@ -98,6 +118,10 @@ const dt_collection_t *dt_collection_new(const dt_collection_t *clone)
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_IMPORTED,
                             G_CALLBACK(_dt_collection_recount_callback_2), collection);
 
+  /* anything announcing a collection change may have changed the order of images */
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED,
+                            G_CALLBACK(_dt_collection_changed_callback), collection);
+
   return collection;
 }
 
@@ -107,10 +131,15 @@ void dt_collection_free(const dt_collection_t *collection)
                                (gpointer)collection);
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_recount_callback_2),
                                (gpointer)collection);
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_changed_callback),
+                               (gpointer)collection);
 
   g_free(collection->query);
   g_free(collection->query_no_group);
   g_strfreev(collection->where_ext);
+  g_array_free(collection->ids, TRUE);
+  g_hash_table_destroy(collection->ids_offset);
+  g_mutex_clear((GMutex *)&collection->ids_lock);
   g_free((dt_collection_t *)collection);
 }
 
@@ -354,8 +383,8 @@ int dt_collection_update(const dt_collection_t *collection)
 
   /* update the cached count. collection isn't a real const anyway, we are writing to it in
    * _dt_collection_store, too. */
-  ((dt_collection_t *)collection)->count = _dt_collection_compute_count(collection, FALSE);
-  ((dt_collection_t *)collection)->count_no_group = _dt_collection_compute_count(collection, TRUE);
+  _dt_collection_invalidate_ids(collection);
+  _dt_collection_update_counts(collection);
   dt_collection_hint_message(collection);
 
   _collection_update_aspect_ratio(collection);
@@ -796,6 +825,69 @@ static uint32_t _dt_collection_compute_count(const dt_collection_t *collection,
   return count;
 }
 
+static uint32_t _dt_collection_compute_ids(const dt_collection_t *collection)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+
+  // outside of the lock, this may rebuild the query which drops the ids
+  const gchar *query = dt_collection_get_query(collection);
+
+  g_mutex_lock(&c->ids_lock);
+  const gint generation = g_atomic_int_get(&_ids_generation);
+  if(!c->ids_valid || c->ids_generation != generation)
+  {
+    g_array_set_size(c->ids, 0);
+    g_hash_table_remove_all(c->ids_offset);
+
+    if(query)
+    {
+      sqlite3_stmt *stmt = NULL;
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+      if(collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
+      {
+        DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
+        DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
+      }
+      while(sqlite3_step(stmt) == SQLITE_ROW)
+      {
+        const int32_t id = sqlite3_column_int(stmt, 0);
+        // offsets are stored +1 so that the first image isn't mistaken for a missing one
+        g_hash_table_insert(c->ids_offset, GINT_TO_POINTER(id), GINT_TO_POINTER(c->ids->len + 1));
+        g_array_append_val(c->ids, id);
+      }
+      sqlite3_finalize(stmt);
+    }
+    c->ids_valid = TRUE;
+    c->ids_generation = generation;
+  }
+  const uint32_t count = c->ids->len;
+  g_mutex_unlock(&c->ids_lock);
+
+  return count;
+}
+
+static void _dt_collection_invalidate_ids(const dt_collection_t *collection)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+  g_mutex_lock(&c->ids_lock);
+  c->ids_valid = FALSE;
+  g_mutex_unlock(&c->ids_lock);
+}
+
+static void _dt_collection_update_counts(const dt_collection_t *collection)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+
+  c->count = _dt_collection_compute_count(collection, FALSE);
+
+  // without grouping both queries are the same, no need to count twice
+  if(!(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT)
+     && !g_strcmp0(collection->query, collection->query_no_group))
+    c->count_no_group = c->count;
+  else
+    c->count_no_group = _dt_collection_compute_count(collection, TRUE);
+}
+
 uint32_t dt_collection_get_count(const dt_collection_t *collection)
 {
   return collection->count;
@@ -875,22 +967,16 @@ int dt_collection_get_nth(const dt_collection_t *collection, int nth)
 {
   if(nth < 0 || nth >= dt_collection_get_count(collection))
     return -1;
-  const gchar *query = dt_collection_get_query(collection);
-  sqlite3_stmt *stmt = NULL;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, nth);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, 1);
 
-  int result = -1;
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    result  = sqlite3_column_int(stmt, 0);
-  }
+  dt_collection_t *c = (dt_collection_t *)collection;
+  _dt_collection_compute_ids(collection);
 
-  sqlite3_finalize(stmt);
+  int result = -1;
+  g_mutex_lock(&c->ids_lock);
+  if(nth < c->ids->len) result = g_array_index(c->ids, int32_t, nth);
+  g_mutex_unlock(&c->ids_lock);
 
   return result;
-
 }
 
 GList *dt_collection_get_selected(const dt_collection_t *collection, int limit)
@@ -1217,6 +1303,22 @@ gchar *dt_collection_get_makermodel(const char *exif_maker, const char *exif_mod
   return makermodel;
 }
 
+/* substring match on one column of the trigram index, see _create_search_index() in database.c.
+   the LIKE semantics (case folding, user supplied wildcards) are the same as on the plain tables. */
+static gchar *_search_index_filter(gchar *query, const char *column, const char *escaped_text)
+{
+  return dt_util_dstrcat(query, "(id IN (SELECT rowid FROM memory.images_fts WHERE %s LIKE '%%%s%%'))",
+                         column, escaped_text);
+}
+
+static gchar *_metadata_filter(gchar *query, const char *column, const int key, const char *escaped_text)
+{
+  if(dt_database_has_search_index(darktable.db)) return _search_index_filter(query, column, escaped_text);
+
+  return dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
+                                "LIKE '%%%s%%'))", key, escaped_text);
+}
+
 static gchar *get_query_string(const dt_collection_properties_t property, const gchar *text)
 {
   char *escaped_text = sqlite3_mprintf("%q", text);
@@ -1334,27 +1436,25 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
     // TODO: How to handle images without metadata? In the moment they are not shown.
     // TODO: Autogenerate this code?
     case DT_COLLECTION_PROP_TITLE: // title
-      query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_TITLE, escaped_text);
+      query = _metadata_filter(query, "title", DT_METADATA_XMP_DC_TITLE, escaped_text);
       break;
     case DT_COLLECTION_PROP_DESCRIPTION: // description
-      query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_DESCRIPTION, escaped_text);
+      query = _metadata_filter(query, "description", DT_METADATA_XMP_DC_DESCRIPTION, escaped_text);
       break;
     case DT_COLLECTION_PROP_CREATOR: // creator
-      query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_CREATOR, escaped_text);
+      query = _metadata_filter(query, "creator", DT_METADATA_XMP_DC_CREATOR, escaped_text);
       break;
     case DT_COLLECTION_PROP_PUBLISHER: // publisher
-      query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_PUBLISHER, escaped_text);
+      query = _metadata_filter(query, "publisher", DT_METADATA_XMP_DC_PUBLISHER, escaped_text);
       break;
     case DT_COLLECTION_PROP_RIGHTS: // rights
-      query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_RIGHTS, escaped_text);
+      query = _metadata_filter(query, "rights", DT_METADATA_XMP_DC_RIGHTS, escaped_text);
       break;
     case DT_COLLECTION_PROP_LENS: // lens
-      query = dt_util_dstrcat(query, "(lens LIKE '%%%s%%')", escaped_text);
+      if(dt_database_has_search_index(darktable.db))
+        query = _search_index_filter(query, "lens", escaped_text);
+      else
+        query = dt_util_dstrcat(query, "(lens LIKE '%%%s%%')", escaped_text);
       break;
 
     case DT_COLLECTION_PROP_FOCAL_LENGTH: // focal length
@@ -1459,8 +1559,14 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       GList *list, *l;
       list = dt_util_str_to_glist(",", escaped_text);
 
+      const gboolean indexed = dt_database_has_search_index(darktable.db);
       for (l = list; l != NULL; l = l->next)
-        l->data = dt_util_dstrcat(query, "(filename LIKE '%%%s%%')", (char *)l->data);
+      {
+        if(indexed)
+          l->data = _search_index_filter(query, "filename", (char *)l->data);
+        else
+          l->data = dt_util_dstrcat(query, "(filename LIKE '%%%s%%')", (char *)l->data);
+      }
 
       query = dt_util_glist_to_str(" OR ", list);
       g_list_free(list);
@@ -1738,39 +1844,16 @@ void dt_collection_hint_message(const dt_collection_t *collection)
 static int dt_collection_image_offset_with_collection(const dt_collection_t *collection, int imgid)
 {
   if(imgid == -1) return 0;
-  const gchar *qin = dt_collection_get_query(collection);
-  int offset = 0;
-  sqlite3_stmt *stmt;
 
-  if(qin)
-  {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
+  dt_collection_t *c = (dt_collection_t *)collection;
+  _dt_collection_compute_ids(collection);
 
-    // was the limit portion of the query tacked on?
-    if(collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
-    {
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
-    }
+  g_mutex_lock(&c->ids_lock);
+  const int offset = GPOINTER_TO_INT(g_hash_table_lookup(c->ids_offset, GINT_TO_POINTER(imgid)));
+  g_mutex_unlock(&c->ids_lock);
 
-    gboolean found = FALSE;
-
-    while(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      int id = sqlite3_column_int(stmt, 0);
-      if(imgid == id)
-      {
-        found = TRUE;
-        break;
-      }
-      offset++;
-    }
-
-    if(!found) offset = 0;
-
-    sqlite3_finalize(stmt);
-  }
-  return offset;
+  // not in the collection gives 0, as the first image
+  return offset > 0 ? offset - 1 : 0;
 }
 
 int dt_collection_image_offset(int imgid)
@@ -1782,8 +1865,8 @@ static void _dt_collection_recount_callback_1(gpointer instace, gpointer user_da
 {
   dt_collection_t *collection = (dt_collection_t *)user_data;
   int old_count = collection->count;
-  collection->count = _dt_collection_compute_count(collection, FALSE);
-  collection->count_no_group = _dt_collection_compute_count(collection, TRUE);
+  _dt_collection_invalidate_ids(collection);
+  _dt_collection_update_counts(collection);
   if(!collection->clone)
   {
     if(old_count != collection->count) dt_collection_hint_message(collection);
@@ -1795,8 +1878,8 @@ static void _dt_collection_recount_callback_2(gpointer instance, uint8_t id, gpo
 {
   dt_collection_t *collection = (dt_collection_t *)user_data;
   int old_count = collection->count;
-  collection->count = _dt_collection_compute_count(collection, FALSE);
-  collection->count_no_group = _dt_collection_compute_count(collection, TRUE);
+  _dt_collection_invalidate_ids(collection);
+  _dt_collection_update_counts(collection);
   if(!collection->clone)
   {
     if(old_count != collection->count) dt_collection_hint_message(collection);
@@ -1804,6 +1887,12 @@ static void _dt_collection_recount_callback_2(gpointer instance, uint8_t id, gpo
   }
 }
 
+static void _dt_collection_changed_callback(gpointer instance, gpointer user_data)
+{
+  // only drop the ids, they are recomputed lazily by the next offset or nth lookup
+  _dt_collection_invalidate_ids((dt_collection_t *)user_data);
+}
+
 int64_t dt_collection_get_image_position(const int32_t image_id)
 {
   int64_t image_position = -1;
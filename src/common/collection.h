@@ -143,6 +143,13 @@ typedef struct dt_collection_t
   unsigned int count, count_no_group;
   dt_collection_params_t params;
   dt_collection_params_t store;
+
+  /* the result of query, materialized on demand: ids in collection order and their offsets */
+  GMutex ids_lock;
+  GArray *ids;
+  GHashTable *ids_offset;
+  gboolean ids_valid;
+  gint ids_generation;
 } dt_collection_t;
 
 
@@ -221,6 +228,10 @@ void dt_collection_update_query(const dt_collection_t *collection);
 /** updates the hint message for collection */
 void dt_collection_hint_message(const dt_collection_t *collection);
 
+/** images were rated, labelled, tagged, or got new metadata or a new date: drops the materialized ids of all
+ * collections, as their order and content may depend on these properties */
+void dt_collection_images_changed(void);
+
 /** returns the image offset in the collection */
 int dt_collection_image_offset(int imgid);
 
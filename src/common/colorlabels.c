@@ -101,6 +101,7 @@ void dt_colorlabels_remove_labels(const int imgid)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_images_changed();
 }
 
 void dt_colorlabels_set_label(const int imgid, const int color)
@@ -112,6 +113,7 @@ void dt_colorlabels_set_label(const int imgid, const int color)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, color);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_images_changed();
 }
 
 void dt_colorlabels_remove_label(const int imgid, const int color)
@@ -123,6 +125,7 @@ void dt_colorlabels_remove_label(const int imgid, const int color)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, color);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_images_changed();
 }
 
 typedef enum dt_colorlabels_actions_t
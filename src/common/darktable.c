@@ -48,6 +48,9 @@
 #include "common/image.h"
 #include "common/image_cache.h"
 #include "common/imageio_module.h"
+#include "common/bilateral.h"
+#include "common/gaussian.h"
+#include "common/interpolation.h"
 #include "common/iop_order.h"
 #include "common/l10n.h"
 #include "common/mipmap_cache.h"
@@ -342,6 +345,14 @@ static void dt_codepaths_init()
   }
 }
 
+// reports the time a startup phase took with -d perf and returns the start of the next one
+static double _init_phase(const char *phase, const double start)
+{
+  const double now = dt_get_wtime();
+  dt_print(DT_DEBUG_PERF, "[init] %s took %.3f secs\n", phase, now - start);
+  return now;
+}
+
 int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load_data, lua_State *L)
 {
   double start_wtime = dt_get_wtime();
@@ -771,6 +782,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_loc_init_user_config_dir(configdir_from_command);
   dt_loc_init_user_cache_dir(cachedir_from_command);
 
+  double phase_wtime = _init_phase("command line", start_wtime);
+
 #ifdef USE_LUA
   dt_lua_init_early(L);
 #endif
@@ -790,6 +803,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   // set the interface language and prepare selection for prefs
   darktable.l10n = dt_l10n_init(init_gui);
 
+  phase_wtime = _init_phase("config", phase_wtime);
+
   // we need this REALLY early so that error messages can be shown, however after gtk_disable_setlocale
   if(init_gui)
   {
@@ -829,6 +844,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   // get the list of color profiles
   darktable.color_profiles = dt_colorspaces_init();
 
+  phase_wtime = _init_phase("color profiles", phase_wtime);
+
   // initialize the database
   darktable.db = dt_database_init(dbfilename_from_command, load_data, init_gui);
   if(darktable.db == NULL)
@@ -869,6 +886,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     return 1;
   }
 
+  phase_wtime = _init_phase("database", phase_wtime);
+
   // Initialize the signal system
   darktable.signals = dt_control_signal_init();
 
@@ -918,11 +937,15 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_set_signal_handlers();
 #endif
 
+  phase_wtime = _init_phase("control", phase_wtime);
+
   darktable.opencl = (dt_opencl_t *)calloc(1, sizeof(dt_opencl_t));
 #ifdef HAVE_OPENCL
   dt_opencl_init(darktable.opencl, exclude_opencl, print_statistics);
 #endif
 
+  phase_wtime = _init_phase("opencl", phase_wtime);
+
   darktable.points = (dt_points_t *)calloc(1, sizeof(dt_points_t));
   dt_points_init(darktable.points, dt_get_num_threads());
 
@@ -936,6 +959,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.mipmap_cache = (dt_mipmap_cache_t *)calloc(1, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
 
+  phase_wtime = _init_phase("caches", phase_wtime);
+
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to register
   // their keyboard accelerators
@@ -963,15 +988,20 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     return 1;
   }
 
+  phase_wtime = _init_phase("views", phase_wtime);
+
   darktable.imageio = (dt_imageio_t *)calloc(1, sizeof(dt_imageio_t));
   dt_imageio_init(darktable.imageio);
 
+  phase_wtime = _init_phase("imageio", phase_wtime);
+
   // load default iop order
   darktable.iop_order_list = dt_ioppr_get_iop_order_list(0, FALSE);
   // load iop order rules
   darktable.iop_order_rules = dt_ioppr_get_iop_order_rules();
-  // load the darkroom mode plugins once:
-  dt_iop_load_modules_so();
+  // load the darkroom mode plugins once. without gui and data.db the presets are thrown away
+  // at exit, so darktable-cli restores them from the snapshot of its previous run.
+  dt_iop_load_modules_so(!init_gui && !load_data && dt_conf_get_bool("cli_presets_snapshot"));
   // check if all modules have a iop order assigned
   if(dt_ioppr_check_so_iop_order(darktable.iop, darktable.iop_order_list))
   {
@@ -982,6 +1012,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   // set up memory.darktable_iop_names table
   dt_iop_set_darktable_iop_table();
 
+  phase_wtime = _init_phase("processing modules", phase_wtime);
+
   if(init_gui)
   {
 #ifdef HAVE_GPHOTO2
@@ -1016,6 +1048,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
     // initialize undo struct
     darktable.undo = dt_undo_init();
+
+    phase_wtime = _init_phase("gui", phase_wtime);
   }
 
   if(darktable.unmuted & DT_DEBUG_MEMORY)
@@ -1029,6 +1063,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 /* init lua last, since it's user made stuff it must be in the real environment */
 #ifdef USE_LUA
   dt_lua_init(darktable.lua_state.state, lua_command);
+
+  phase_wtime = _init_phase("lua", phase_wtime);
 #endif
 
   if(init_gui)
@@ -1116,6 +1152,8 @@ void dt_cleanup()
     dt_lib_cleanup(darktable.lib);
     free(darktable.lib);
   }
+  // the job threads are gone, write what is left of the sidecar queue
+  dt_image_synch_xmp_flush();
 #ifdef USE_LUA
   dt_lua_finalize();
 #endif
@@ -1143,6 +1181,9 @@ void dt_cleanup()
   dt_points_cleanup(darktable.points);
   free(darktable.points);
   dt_iop_unload_modules_so();
+  dt_interpolation_cleanup();
+  dt_bilateral_cleanup();
+  dt_gaussian_cleanup();
   g_list_free_full(darktable.iop_order_list, free);
   darktable.iop_order_list = NULL;
   g_list_free_full(darktable.iop_order_rules, free);
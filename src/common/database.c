@@ -26,6 +26,7 @@
 #include "common/debug.h"
 #include "common/file_location.h"
 #include "common/iop_order.h"
+#include "common/metadata.h"
 #include "common/styles.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -44,7 +45,7 @@
 
 // whenever _create_*_schema() gets changed you HAVE to bump this version and add an update path to
 // _upgrade_*_schema_step()!
-#define CURRENT_DATABASE_VERSION_LIBRARY 23
+#define CURRENT_DATABASE_VERSION_LIBRARY 24
 #define CURRENT_DATABASE_VERSION_DATA     5
 
 typedef struct dt_database_t
@@ -60,6 +61,9 @@ typedef struct dt_database_t
   /* ondisk DB */
   sqlite3 *handle;
 
+  /* trigram index over the text columns used by collection filters */
+  gboolean has_search_index;
+
   gchar *error_message, *error_dbfilename;
 } dt_database_t;
 
@@ -1415,6 +1419,15 @@ static int _upgrade_library_schema_step(dt_database_t *db, int version)
 
     new_version = 23;
   }
+  else if(version == 23)
+  {
+    // where the embedded jpeg preview of an image is, so that thumbnails don't need exiv2
+    TRY_EXEC("CREATE TABLE main.embedded_previews (imgid INTEGER PRIMARY KEY, file_size INTEGER, "
+             "offset INTEGER, length INTEGER)",
+             "[init] can't create embedded_previews table\n");
+
+    new_version = 24;
+  }
   else
     new_version = version; // should be the fallback so that calling code sees that we are in an infinite loop
 
@@ -1696,6 +1709,10 @@ static void _create_library_schema(dt_database_t *db)
 
   sqlite3_exec(db->handle, "CREATE TABLE main.module_order (imgid INTEGER PRIMARY KEY, version INTEGER, iop_list VARCHAR)",
                NULL, NULL, NULL);
+  ////////////////////////////// embedded_previews
+  sqlite3_exec(db->handle, "CREATE TABLE main.embedded_previews (imgid INTEGER PRIMARY KEY, file_size INTEGER, "
+                           "offset INTEGER, length INTEGER)",
+               NULL, NULL, NULL);
 }
 
 /* create the current database schema and set the version in db_info accordingly */
@@ -1748,6 +1765,9 @@ static void _create_memory_schema(dt_database_t *db)
       db->handle,
       "CREATE TABLE memory.collected_images (rowid INTEGER PRIMARY KEY AUTOINCREMENT, imgid INTEGER)", NULL,
       NULL, NULL);
+  // the lighttable looks up the position of an image by id
+  sqlite3_exec(db->handle, "CREATE INDEX memory.collected_images_imgid_index ON collected_images (imgid)", NULL,
+               NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.tmp_selection (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.taglist "
                            "(tmpid INTEGER PRIMARY KEY, id INTEGER UNIQUE ON CONFLICT IGNORE, count INTEGER)",
@@ -1806,6 +1826,132 @@ static void _sanitize_db(dt_database_t *db)
   sqlite3_finalize(innerstmt);
 }
 
+// the meta_data columns of the search index, rebuilt for one image
+#define SEARCH_INDEX_META(_id)                                                                          \
+  "title = (SELECT group_concat(value, char(10)) FROM meta_data WHERE id = " _id " AND key = %d), "     \
+  "description = (SELECT group_concat(value, char(10)) FROM meta_data WHERE id = " _id " AND key = %d), " \
+  "creator = (SELECT group_concat(value, char(10)) FROM meta_data WHERE id = " _id " AND key = %d), "   \
+  "publisher = (SELECT group_concat(value, char(10)) FROM meta_data WHERE id = " _id " AND key = %d), " \
+  "rights = (SELECT group_concat(value, char(10)) FROM meta_data WHERE id = " _id " AND key = %d) "
+
+// returns TRUE on success, the first failure makes the whole index go
+static gboolean _search_index_exec(dt_database_t *db, const char *query)
+{
+  char *err = NULL;
+  if(sqlite3_exec(db->handle, query, NULL, NULL, &err) != SQLITE_OK)
+  {
+    fprintf(stderr, "[init] search index: %s\n", err);
+    sqlite3_free(err);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static const char *_search_index_triggers[] = { "images_fts_insert", "images_fts_update", "images_fts_delete",
+                                                "meta_data_fts_insert", "meta_data_fts_update",
+                                                "meta_data_fts_delete" };
+
+// the triggers of the index would fail every write to images and meta_data without it
+static void _drop_search_index(dt_database_t *db, const char *schema)
+{
+  for(size_t k = 0; k < G_N_ELEMENTS(_search_index_triggers); k++)
+  {
+    gchar *query = g_strdup_printf("DROP TRIGGER IF EXISTS %s.%s", schema, _search_index_triggers[k]);
+    sqlite3_exec(db->handle, query, NULL, NULL, NULL);
+    g_free(query);
+  }
+  gchar *query = g_strdup_printf("DROP TABLE IF EXISTS %s.images_fts", schema);
+  sqlite3_exec(db->handle, query, NULL, NULL, NULL);
+  g_free(query);
+}
+
+/* the collection text filters are substring matches (LIKE '%...%') which can't use a btree index.
+ * keep an fts5 trigram table in the memory database, indexed by image id and kept in sync by temporary
+ * triggers. it is built anew on every start, so nothing of it ends up in the library: older darktable
+ * versions and sqlite builds without fts5 or the trigram tokenizer (< 3.34) open the library just the
+ * same, the latter keep the plain LIKE queries. */
+static void _create_search_index(dt_database_t *db)
+{
+  db->has_search_index = FALSE;
+
+  // an index in the library itself, as an earlier development version kept it, has to go
+  _drop_search_index(db, "main");
+  sqlite3_exec(db->handle, "DELETE FROM main.db_info WHERE key = 'search_index'", NULL, NULL, NULL);
+
+  // probe for the module and the tokenizer
+  if(sqlite3_exec(db->handle, "CREATE VIRTUAL TABLE memory.images_fts USING fts5"
+                              " (filename, lens, title, description, creator, publisher, rights,"
+                              "  tokenize = 'trigram')",
+                  NULL, NULL, NULL) != SQLITE_OK)
+  {
+    dt_print(DT_DEBUG_SQL, "[init] sqlite has no fts5 trigram tokenizer, collection filters use LIKE\n");
+    return;
+  }
+
+  // temporary triggers may watch the library, the unqualified images_fts is found in memory
+  gboolean ok = _search_index_exec(db, "CREATE TEMP TRIGGER images_fts_insert AFTER INSERT ON main.images"
+                                       " BEGIN"
+                                       "  INSERT INTO images_fts (rowid, filename, lens)"
+                                       "   VALUES (NEW.id, NEW.filename, NEW.lens);"
+                                       " END");
+  ok = ok && _search_index_exec(db, "CREATE TEMP TRIGGER images_fts_update AFTER UPDATE OF filename, lens"
+                                    " ON main.images"
+                                    " BEGIN"
+                                    "  UPDATE images_fts SET filename = NEW.filename, lens = NEW.lens"
+                                    "   WHERE rowid = NEW.id;"
+                                    " END");
+  ok = ok && _search_index_exec(db, "CREATE TEMP TRIGGER images_fts_delete AFTER DELETE ON main.images"
+                                    " BEGIN"
+                                    "  DELETE FROM images_fts WHERE rowid = OLD.id;"
+                                    " END");
+
+  const int keys[] = { DT_METADATA_XMP_DC_TITLE, DT_METADATA_XMP_DC_DESCRIPTION, DT_METADATA_XMP_DC_CREATOR,
+                       DT_METADATA_XMP_DC_PUBLISHER, DT_METADATA_XMP_DC_RIGHTS };
+  const struct
+  {
+    const char *name, *event, *id;
+  } meta_triggers[] = { { "meta_data_fts_insert", "INSERT", "NEW.id" },
+                        { "meta_data_fts_update", "UPDATE", "NEW.id" },
+                        { "meta_data_fts_delete", "DELETE", "OLD.id" } };
+  for(size_t k = 0; k < G_N_ELEMENTS(meta_triggers); k++)
+  {
+    gchar *set = g_strdup_printf(SEARCH_INDEX_META("%s"), meta_triggers[k].id, keys[0], meta_triggers[k].id,
+                                 keys[1], meta_triggers[k].id, keys[2], meta_triggers[k].id, keys[3],
+                                 meta_triggers[k].id, keys[4]);
+    gchar *query = g_strdup_printf("CREATE TEMP TRIGGER %s AFTER %s ON main.meta_data"
+                                   " BEGIN"
+                                   "  UPDATE images_fts SET %s WHERE rowid = %s;"
+                                   " END",
+                                   meta_triggers[k].name, meta_triggers[k].event, set, meta_triggers[k].id);
+    ok = ok && _search_index_exec(db, query);
+    g_free(query);
+    g_free(set);
+  }
+
+  // populate from the current library
+  ok = ok && _search_index_exec(db, "INSERT INTO memory.images_fts (rowid, filename, lens)"
+                                    " SELECT id, filename, lens FROM main.images");
+  gchar *set = g_strdup_printf(SEARCH_INDEX_META("%s"), "images_fts.rowid", keys[0], "images_fts.rowid", keys[1],
+                               "images_fts.rowid", keys[2], "images_fts.rowid", keys[3], "images_fts.rowid",
+                               keys[4]);
+  gchar *query = g_strdup_printf("UPDATE memory.images_fts SET %s"
+                                 " WHERE rowid IN (SELECT DISTINCT id FROM main.meta_data)", set);
+  ok = ok && _search_index_exec(db, query);
+  g_free(query);
+  g_free(set);
+
+  if(ok)
+    db->has_search_index = TRUE;
+  else
+  {
+    _drop_search_index(db, "temp");
+    sqlite3_exec(db->handle, "DROP TABLE IF EXISTS memory.images_fts", NULL, NULL, NULL);
+    dt_print(DT_DEBUG_SQL, "[init] could not create the search index, collection filters use LIKE\n");
+  }
+}
+
+#undef SEARCH_INDEX_META
+
 // in library we keep the names of the tags used in tagged_images. however, using that table at runtime results
 // in some overhead not necessary so instead we just use the used_tags table to update tagged_images on startup
 #define TRY_EXEC(_query, _message)                                                 \
@@ -2433,6 +2579,9 @@ start:
   // take care of potential bad data in the db.
   _sanitize_db(db);
 
+  // optional full text index for the collection filters
+  _create_search_index(db);
+
 error:
   g_free(dbname);
 
@@ -2524,6 +2673,11 @@ gboolean dt_database_get_lock_acquired(const dt_database_t *db)
   return db->lock_acquired;
 }
 
+gboolean dt_database_has_search_index(const dt_database_t *db)
+{
+  return db && db->has_search_index;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -34,6 +34,8 @@ const gchar *dt_database_get_path(const struct dt_database_t *db);
 gboolean dt_database_get_lock_acquired(const struct dt_database_t *db);
 /** show an error popup. this has to be postponed until after we tried using dbus to reach another instance */
 void dt_database_show_error(const struct dt_database_t *db);
+/** test if the trigram index for collection text filters (memory.images_fts) is available */
+gboolean dt_database_has_search_index(const struct dt_database_t *db);
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -0,0 +1,385 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/embedded_preview.h"
+#include "common/darktable.h"
+#include "common/database.h"
+#include "common/debug.h"
+
+#include <glib/gstdio.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// bounds on what we are willing to walk through in broken files
+#define MAX_IFDS 64
+#define MAX_IFD_ENTRIES 1024
+#define MAX_BOXES 1024
+#define MAX_JPEG_MARKERS 64
+// smaller previews are exif thumbnails, with a better one left to exiv2 in the maker notes
+#define MIN_PREVIEW_SIDE 320
+#define MIN_PREVIEW_FRACTION 4
+
+typedef struct _reader_t
+{
+  FILE *f;
+  size_t size;
+  int big_endian;
+} _reader_t;
+
+static int _read(_reader_t *r, const size_t offset, void *buf, const size_t len)
+{
+  if(offset > r->size || len > r->size - offset || offset > LONG_MAX) return 0;
+  if(fseek(r->f, (long)offset, SEEK_SET)) return 0;
+  return fread(buf, 1, len, r->f) == len;
+}
+
+static inline uint32_t _get2(const _reader_t *r, const uint8_t *p)
+{
+  return r->big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static inline uint32_t _get4(const _reader_t *r, const uint8_t *p)
+{
+  return r->big_endian ? ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]
+                       : ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+// check that a jpeg stream we can decode starts at offset and get its size from the frame header
+static int _probe_jpeg(_reader_t *r, const size_t offset, const size_t length, dt_embedded_preview_t *p)
+{
+  uint8_t buf[9];
+  if(length < 4 || !_read(r, offset, buf, 2) || buf[0] != 0xff || buf[1] != 0xd8) return 0;
+
+  size_t pos = offset + 2;
+  for(int k = 0; k < MAX_JPEG_MARKERS; k++)
+  {
+    if(pos + 4 > offset + length || !_read(r, pos, buf, 4) || buf[0] != 0xff) return 0;
+    // fill bytes
+    if(buf[1] == 0xff)
+    {
+      pos++;
+      continue;
+    }
+    const int marker = buf[1];
+    const size_t seglen = (buf[2] << 8) | buf[3];
+    // huffman coded baseline, extended and progressive frames. the lossless ones are raw data.
+    if(marker == 0xc0 || marker == 0xc1 || marker == 0xc2)
+    {
+      if(!_read(r, pos + 4, buf, 5)) return 0;
+      p->offset = offset;
+      p->length = length;
+      p->height = (buf[1] << 8) | buf[2];
+      p->width = (buf[3] << 8) | buf[4];
+      return p->width > 0 && p->height > 0;
+    }
+    if(marker > 0xc2 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) return 0;
+    if(marker == 0xd9 || marker == 0xda || seglen < 2) return 0;
+    pos += 2 + seglen;
+  }
+  return 0;
+}
+
+// keep the jpeg at offset if it is larger than what we have found so far
+static void _candidate(_reader_t *r, const size_t offset, const size_t length, dt_embedded_preview_t *best)
+{
+  dt_embedded_preview_t p;
+  if(!_probe_jpeg(r, offset, length, &p)) return;
+  if((size_t)p.width * p.height > (size_t)best->width * best->height) *best = p;
+}
+
+// all tiff based raws: the ifd chain and the sub ifds, offsets are relative to base.
+// the longest side of any image in there ends up in image_side.
+static void _walk_tiff(_reader_t *r, const size_t base, dt_embedded_preview_t *best, uint32_t *image_side)
+{
+  uint8_t buf[12];
+  if(!_read(r, base, buf, 8)) return;
+  if(buf[0] == 'I' && buf[1] == 'I')
+    r->big_endian = 0;
+  else if(buf[0] == 'M' && buf[1] == 'M')
+    r->big_endian = 1;
+  else
+    return;
+
+  uint32_t ifds[MAX_IFDS];
+  int num_ifds = 0;
+  ifds[num_ifds++] = _get4(r, buf + 4);
+
+  for(int i = 0; i < num_ifds; i++)
+  {
+    const size_t ifd = base + ifds[i];
+    if(!_read(r, ifd, buf, 2)) continue;
+    const int entries = _get2(r, buf);
+    if(entries == 0 || entries > MAX_IFD_ENTRIES) continue;
+
+    uint32_t subfile = 0, compression = 0, strips = 0, strip_offset = 0, strip_length = 0;
+    uint32_t jpeg_offset = 0, jpeg_length = 0;
+    for(int e = 0; e < entries; e++)
+    {
+      if(!_read(r, ifd + 2 + 12 * e, buf, 12)) break;
+      const uint32_t tag = _get2(r, buf);
+      const uint32_t type = _get2(r, buf + 2);
+      const uint32_t count = _get4(r, buf + 4);
+      // a single short sits in the first half of the value field
+      const uint32_t value = (type == 3 && count == 1) ? _get2(r, buf + 8) : _get4(r, buf + 8);
+      switch(tag)
+      {
+        case 0x002e: // panasonic JpgFromRaw, an undefined blob of count bytes
+          if(count > 4) _candidate(r, base + value, count, best);
+          break;
+        case 0x00fe: // NewSubFileType
+          subfile = value;
+          break;
+        case 0x0100: // ImageWidth
+        case 0x0101: // ImageLength
+          *image_side = MAX(*image_side, value);
+          break;
+        case 0x0103: // Compression
+          compression = value;
+          break;
+        case 0x0111: // StripOffsets
+          strips = count;
+          strip_offset = value;
+          break;
+        case 0x0117: // StripByteCounts
+          strip_length = value;
+          break;
+        case 0x014a: // SubIFDs
+          for(uint32_t k = 0; k < count && num_ifds < MAX_IFDS; k++)
+          {
+            if(count == 1)
+              ifds[num_ifds++] = value;
+            else if(_read(r, base + value + 4 * (size_t)k, buf, 4))
+              ifds[num_ifds++] = _get4(r, buf);
+          }
+          break;
+        case 0x0201: // JPEGInterchangeFormat
+          jpeg_offset = value;
+          break;
+        case 0x0202: // JPEGInterchangeFormatLength
+          jpeg_length = value;
+          break;
+        default:
+          break;
+      }
+    }
+
+    if(jpeg_offset && jpeg_length) _candidate(r, base + jpeg_offset, jpeg_length, best);
+    // old style jpeg strips (cr2) and reduced resolution jpeg images (dng). the probe
+    // rejects the lossless jpeg raw data which uses the same compression codes.
+    if(strips == 1 && strip_offset && strip_length
+       && (compression == 6 || ((subfile & 1) && (compression == 7 || compression == 34892))))
+      _candidate(r, base + strip_offset, strip_length, best);
+
+    if(num_ifds < MAX_IFDS && _read(r, ifd + 2 + 12 * (size_t)entries, buf, 4))
+    {
+      const uint32_t next = _get4(r, buf);
+      if(next) ifds[num_ifds++] = next;
+    }
+  }
+}
+
+// canon cr3: an iso base media file with the preview in a PRVW box inside a top level uuid box
+static void _walk_cr3(_reader_t *r, dt_embedded_preview_t *best)
+{
+  static const uint8_t preview_uuid[16] = { 0xea, 0xf4, 0x2b, 0x5e, 0x1c, 0x98, 0x4b, 0x88,
+                                            0xb9, 0xfb, 0xb7, 0xdc, 0x40, 0x6e, 0x4d, 0x16 };
+  r->big_endian = 1;
+  size_t pos = 0;
+  for(int k = 0; k < MAX_BOXES && pos + 8 <= r->size; k++)
+  {
+    uint8_t buf[24];
+    if(!_read(r, pos, buf, 8)) return;
+    uint64_t size = _get4(r, buf);
+    size_t header = 8;
+    if(size == 1)
+    {
+      if(!_read(r, pos + 8, buf + 8, 8)) return;
+      size = ((uint64_t)_get4(r, buf + 8) << 32) | _get4(r, buf + 12);
+      header = 16;
+    }
+    else if(size == 0)
+      size = r->size - pos;
+    if(size < header || size > r->size - pos) return;
+
+    if(!memcmp(buf + 4, "uuid", 4))
+    {
+      uint8_t uuid[16];
+      if(_read(r, pos + header, uuid, 16) && !memcmp(uuid, preview_uuid, 16))
+      {
+        // the uuid is followed by 8 bytes and the PRVW box: size, 'PRVW', 4 + 2 unknown bytes,
+        // width, height, 2 unknown bytes and the size of the jpeg which comes right after
+        const size_t prvw = pos + header + 16 + 8;
+        if(_read(r, prvw, buf, 24) && !memcmp(buf + 4, "PRVW", 4))
+          _candidate(r, prvw + 24, _get4(r, buf + 20), best);
+        return;
+      }
+    }
+    pos += size;
+  }
+}
+
+// fujifilm raf: the offset and length of the jpeg are at fixed places in the header
+static void _walk_raf(_reader_t *r, dt_embedded_preview_t *best)
+{
+  uint8_t buf[8];
+  r->big_endian = 1;
+  if(_read(r, 84, buf, 8)) _candidate(r, _get4(r, buf), _get4(r, buf + 4), best);
+}
+
+int dt_embedded_preview_locate(const char *filename, dt_embedded_preview_t *preview)
+{
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return 1;
+
+  _reader_t r = { f, 0, 0 };
+  dt_embedded_preview_t best = { 0 };
+  uint32_t image_side = 0;
+  uint8_t head[16];
+  if(!fseek(f, 0, SEEK_END))
+  {
+    const long size = ftell(f);
+    r.size = size > 0 ? size : 0;
+  }
+
+  if(_read(&r, 0, head, sizeof(head)))
+  {
+    if(!memcmp(head, "FUJIFILMCCD-RAW ", 16))
+      _walk_raf(&r, &best);
+    else if(!memcmp(head + 4, "ftypcrx ", 8))
+      _walk_cr3(&r, &best);
+    else
+      _walk_tiff(&r, 0, &best, &image_side);
+  }
+  fclose(f);
+
+  const uint32_t side = MAX(best.width, best.height);
+  if(!best.length || side < MIN_PREVIEW_SIDE || side < image_side / MIN_PREVIEW_FRACTION) return 1;
+  *preview = best;
+  return 0;
+}
+
+// remember where the preview is, or that there is none we can find (length 0)
+static void _cache_store(const int32_t imgid, const int64_t file_size, const dt_embedded_preview_t *preview)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT OR REPLACE INTO main.embedded_previews (imgid, file_size, offset, length)"
+                              " VALUES (?1, ?2, ?3, ?4)",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT64(stmt, 2, file_size);
+  DT_DEBUG_SQLITE3_BIND_INT64(stmt, 3, preview->offset);
+  DT_DEBUG_SQLITE3_BIND_INT64(stmt, 4, preview->length);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
+static void _cache_remove(const int32_t imgid)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "DELETE FROM main.embedded_previews WHERE imgid = ?1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
+int dt_embedded_preview_read(const int32_t imgid, const char *filename, const int min_width,
+                             const int min_height, uint8_t **buffer, size_t *size)
+{
+  GStatBuf statbuf;
+  if(g_stat(filename, &statbuf)) return 1;
+  const int64_t file_size = statbuf.st_size;
+
+  dt_embedded_preview_t preview = { 0 };
+  int cached = 0;
+  if(imgid > 0)
+  {
+    // a location is only trusted as long as the file keeps its size
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT file_size, offset, length FROM main.embedded_previews WHERE imgid = ?1",
+                                -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    if(sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int64(stmt, 0) == file_size)
+    {
+      preview.offset = sqlite3_column_int64(stmt, 1);
+      preview.length = sqlite3_column_int64(stmt, 2);
+      cached = 1;
+    }
+    sqlite3_finalize(stmt);
+  }
+
+  if(!cached)
+  {
+    if(dt_embedded_preview_locate(filename, &preview)) memset(&preview, 0, sizeof(preview));
+    if(imgid > 0) _cache_store(imgid, file_size, &preview);
+  }
+
+  if(preview.length < 4) return 1;
+
+  uint8_t *buf = NULL;
+  FILE *f = g_fopen(filename, "rb");
+  _reader_t r = { f, file_size, 0 };
+  dt_embedded_preview_t found;
+  if(f && _probe_jpeg(&r, preview.offset, preview.length, &found))
+  {
+    // a thumbnail remembered by an older version of the lookup
+    if(MAX(found.width, found.height) < MIN_PREVIEW_SIDE)
+    {
+      fclose(f);
+      const dt_embedded_preview_t none = { 0 };
+      if(imgid > 0) _cache_store(imgid, file_size, &none);
+      return 1;
+    }
+    // too small for what the caller wants, exiv2 may know of a bigger one
+    if(found.width < min_width && found.height < min_height)
+    {
+      fclose(f);
+      return 1;
+    }
+    if(!fseek(f, (long)preview.offset, SEEK_SET) && (buf = (uint8_t *)malloc(preview.length))
+       && fread(buf, 1, preview.length, f) == preview.length)
+    {
+      fclose(f);
+      *buffer = buf;
+      *size = preview.length;
+      return 0;
+    }
+  }
+
+  if(f) fclose(f);
+  free(buf);
+  // the file changed behind our back, look again next time
+  if(cached) _cache_remove(imgid);
+  dt_print(DT_DEBUG_LIGHTTABLE, "[embedded_preview] couldn't read the preview of %s\n", filename);
+  return 1;
+}
+
+#undef MAX_IFDS
+#undef MAX_IFD_ENTRIES
+#undef MAX_BOXES
+#undef MAX_JPEG_MARKERS
+#undef MIN_PREVIEW_SIDE
+#undef MIN_PREVIEW_FRACTION
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
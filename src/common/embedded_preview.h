@@ -0,0 +1,48 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* the largest embedded jpeg preview of a raw file, found by walking only the
+ * container structure (tiff ifds, cr3 boxes, the raf header) instead of having
+ * exiv2 parse all the metadata. formats which keep their previews elsewhere
+ * (in maker notes for instance) are left to dt_exif_get_thumbnail(), and so
+ * are files where we only find a thumbnail much smaller than the image. */
+
+typedef struct dt_embedded_preview_t
+{
+  size_t offset; // position of the jpeg stream in the file
+  size_t length; // size of the jpeg stream in bytes
+  int width, height;
+} dt_embedded_preview_t;
+
+// locate the preview in filename, returns 0 on success
+int dt_embedded_preview_locate(const char *filename, dt_embedded_preview_t *preview);
+
+// allocate buffer and return 0 on success along with the jpeg preview of the image, unless it is smaller
+// than min_width x min_height in both directions. the location is cached in the library, so that only the
+// jpeg is read next time. imgid <= 0 bypasses the cache.
+int dt_embedded_preview_read(const int32_t imgid, const char *filename, const int min_width,
+                             const int min_height, uint8_t **buffer, size_t *size);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
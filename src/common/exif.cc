@@ -3634,6 +3634,25 @@ int dt_exif_xmp_attach_export(const int imgid, const char *filename, void *metad
 }
 
 // write xmp sidecar file:
+char *dt_exif_xmp_checksum(const int imgid)
+{
+  try
+  {
+    Exiv2::XmpData xmpData;
+    std::string xmpPacket;
+    dt_exif_xmp_read_data(xmpData, imgid);
+    if(Exiv2::XmpParser::encode(xmpPacket, xmpData,
+       Exiv2::XmpParser::useCompactFormat | Exiv2::XmpParser::omitPacketWrapper) != 0)
+      return NULL;
+    return g_compute_checksum_for_string(G_CHECKSUM_MD5, xmpPacket.c_str(), -1);
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    std::cerr << "[xmp_checksum] " << imgid << ": caught exiv2 exception '" << e << "'\n";
+    return NULL;
+  }
+}
+
 int dt_exif_xmp_write(const int imgid, const char *filename)
 {
   // refuse to write sidecar for non-existent image:
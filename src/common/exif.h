@@ -50,6 +50,10 @@ int dt_exif_write_blob(uint8_t *blob, uint32_t size, const char *path, const int
 /** write xmp sidecar file. */
 int dt_exif_xmp_write(const int imgid, const char *filename);
 
+/** checksum of the xmp data darktable would write for imgid, without merging the existing sidecar.
+ *  returns NULL on error, free with g_free(). */
+char *dt_exif_xmp_checksum(const int imgid);
+
 /** write xmp packet inside an image. */
 int dt_exif_xmp_attach_export(const int imgid, const char *filename, void *metadata);
 
@@ -113,6 +113,76 @@ size_t dt_gaussian_singlebuffer_size(const int width,    // width of input image
 }
 
 
+// temp buffers up to this size are kept for the next blur instead of being freed. that covers the
+// darkroom and preview pipes which blur at screen size over and over, export sized ones come and go.
+#define ARENA_MAX_SIZE ((size_t)64 << 20)
+#define ARENA_SLOTS 4
+
+static struct
+{
+  GMutex lock;
+  float *buf[ARENA_SLOTS];
+  size_t size[ARENA_SLOTS];
+} arena;
+
+// capacity gets the real size of the buffer, which is what it goes back to arena_free() with
+static float *arena_alloc(const size_t size, size_t *capacity)
+{
+  *capacity = size;
+  if(size <= ARENA_MAX_SIZE)
+  {
+    // the smallest kept buffer which is large enough
+    g_mutex_lock(&arena.lock);
+    int best = -1;
+    for(int k = 0; k < ARENA_SLOTS; k++)
+      if(arena.buf[k] && arena.size[k] >= size && (best < 0 || arena.size[k] < arena.size[best])) best = k;
+    if(best >= 0)
+    {
+      float *buf = arena.buf[best];
+      *capacity = arena.size[best];
+      arena.buf[best] = NULL;
+      g_mutex_unlock(&arena.lock);
+      return buf;
+    }
+    g_mutex_unlock(&arena.lock);
+  }
+  return dt_alloc_align(64, size);
+}
+
+// size is the capacity the buffer was handed out with
+static void arena_free(float *buf, const size_t size)
+{
+  if(!buf) return;
+  if(size <= ARENA_MAX_SIZE)
+  {
+    g_mutex_lock(&arena.lock);
+    for(int k = 0; k < ARENA_SLOTS; k++)
+    {
+      if(!arena.buf[k])
+      {
+        arena.buf[k] = buf;
+        arena.size[k] = size;
+        g_mutex_unlock(&arena.lock);
+        return;
+      }
+    }
+    g_mutex_unlock(&arena.lock);
+  }
+  dt_free_align(buf);
+}
+
+void dt_gaussian_cleanup(void)
+{
+  g_mutex_lock(&arena.lock);
+  for(int k = 0; k < ARENA_SLOTS; k++)
+  {
+    dt_free_align(arena.buf[k]);
+    arena.buf[k] = NULL;
+    arena.size[k] = 0;
+  }
+  g_mutex_unlock(&arena.lock);
+}
+
 dt_gaussian_t *dt_gaussian_init(const int width,    // width of input image
                                 const int height,   // height of input image
                                 const int channels, // channels per pixel
@@ -130,6 +200,7 @@ dt_gaussian_t *dt_gaussian_init(const int width,    // width of input image
   g->sigma = sigma;
   g->order = order;
   g->buf = NULL;
+  g->bufsize = 0;
   g->max = (float *)calloc(channels, sizeof(float));
   g->min = (float *)calloc(channels, sizeof(float));
 
@@ -141,13 +212,13 @@ dt_gaussian_t *dt_gaussian_init(const int width,    // width of input image
     g->min[k] = min[k];
   }
 
-  g->buf = dt_alloc_align(64, (size_t)width * height * channels * sizeof(float));
+  g->buf = arena_alloc((size_t)width * height * channels * sizeof(float), &g->bufsize);
   if(!g->buf) goto error;
 
   return g;
 
 error:
-  dt_free_align(g->buf);
+  arena_free(g->buf, g->bufsize);
   free(g->max);
   free(g->min);
   free(g);
@@ -155,95 +226,155 @@ error:
 }
 
 
-void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
-{
-
-  const int width = g->width;
-  const int height = g->height;
-  const int ch = MIN(4, g->channels); // just to appease zealous compiler warnings about stack usage
+// floats per block of the vertical pass: one cache line per row, and as many lanes as the
+// widest vector unit has
+#define VBLOCK 16
 
-  float a0, a1, a2, a3, b1, b2, coefp, coefn;
+// clamping and filter steps as the former sse code had them, for the same results bit for bit
+static inline float clamp_sse(const float a, const float mn, const float mx)
+{
+  const float t = a > mn ? a : mn;
+  return mx < t ? mx : t;
+}
 
-  compute_gauss_params(g->sigma, g->order, &a0, &a1, &a2, &a3, &b1, &b2, &coefp, &coefn);
+static inline float filter_step(const int sse, const float c0, const float x0, const float c1, const float x1,
+                                const float b1, const float y1, const float b2, const float y2)
+{
+  if(sse) return (x0 * c0) + ((x1 * c1) - ((y1 * b1) + (y2 * b2)));
+  return (c0 * x0) + (c1 * x1) - (b1 * y1) - (b2 * y2);
+}
 
-  float *temp = g->buf;
+// forward and backward filter down n <= VBLOCK contiguous floats of each row, i.e. the columns
+// of a few pixels at once. every float is its own lane, so the rows are read and written a
+// cache line at a time and the lanes vectorize, with no transposition needed. sse picks the
+// evaluation order of dt_gaussian_blur_4c_sse() over the one of dt_gaussian_blur().
+static inline void blur_vertical_block(const float *const in, float *const temp, const size_t stride,
+                                       const int height, const int n, const float *const lmin,
+                                       const float *const lmax, const float a0, const float a1, const float a2,
+                                       const float a3, const float b1, const float b2, const float coefp,
+                                       const float coefn, const int sse)
+{
+  float xp[VBLOCK] __attribute__((aligned(64)));
+  float yb[VBLOCK] __attribute__((aligned(64)));
+  float yp[VBLOCK] __attribute__((aligned(64)));
 
-  float *Labmax = g->max;
-  float *Labmin = g->min;
+  // forward filter
+  for(int k = 0; k < n; k++)
+  {
+    xp[k] = sse ? clamp_sse(in[k], lmin[k], lmax[k]) : CLAMPF(in[k], lmin[k], lmax[k]);
+    yb[k] = xp[k] * coefp;
+    yp[k] = yb[k];
+  }
 
-// vertical blur column by column
+  for(int j = 0; j < height; j++)
+  {
+    const float *const row = in + j * stride;
+    float *const trow = temp + j * stride;
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, width, height, ch) \
-  shared(temp, Labmin, Labmax, a0, a1, a2, a3, b1, b2, coefp, coefn) \
-  schedule(static)
+#pragma omp simd
 #endif
-  for(int i = 0; i < width; i++)
-  {
-    float xp[4] = {0.0f};
-    float yb[4] = {0.0f};
-    float yp[4] = {0.0f};
-    float xc[4] = {0.0f};
-    float yc[4] = {0.0f};
-    float xn[4] = {0.0f};
-    float xa[4] = {0.0f};
-    float yn[4] = {0.0f};
-    float ya[4] = {0.0f};
-
-    // forward filter
-    for(int k = 0; k < ch; k++)
+    for(int k = 0; k < n; k++)
     {
-      xp[k] = CLAMPF(in[(size_t)i * ch + k], Labmin[k], Labmax[k]);
-      yb[k] = xp[k] * coefp;
-      yp[k] = yb[k];
-      xc[k] = yc[k] = xn[k] = xa[k] = yn[k] = ya[k] = 0.0f;
-    }
-
-    for(int j = 0; j < height; j++)
-    {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      for(int k = 0; k < ch; k++)
-      {
-        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
-        yc[k] = (a0 * xc[k]) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
+      const float xc = sse ? clamp_sse(row[k], lmin[k], lmax[k]) : CLAMPF(row[k], lmin[k], lmax[k]);
+      const float yc = filter_step(sse, a0, xc, a1, xp[k], b1, yp[k], b2, yb[k]);
 
-        temp[offset + k] = yc[k];
+      trow[k] = yc;
 
-        xp[k] = xc[k];
-        yb[k] = yp[k];
-        yp[k] = yc[k];
-      }
+      xp[k] = xc;
+      yb[k] = yp[k];
+      yp[k] = yc;
     }
+  }
 
-    // backward filter
-    for(int k = 0; k < ch; k++)
+  // backward filter
+  float *const xn = xp, *const xa = yb, *const yn = yp;
+  float ya[VBLOCK] __attribute__((aligned(64)));
+  for(int k = 0; k < n; k++)
+  {
+    const float xl = in[(height - 1) * stride + k];
+    xn[k] = sse ? clamp_sse(xl, lmin[k], lmax[k]) : CLAMPF(xl, lmin[k], lmax[k]);
+    xa[k] = xn[k];
+    yn[k] = xn[k] * coefn;
+    ya[k] = yn[k];
+  }
+
+  for(int j = height - 1; j > -1; j--)
+  {
+    const float *const row = in + j * stride;
+    float *const trow = temp + j * stride;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int k = 0; k < n; k++)
     {
-      xn[k] = CLAMPF(in[((size_t)(height - 1) * width + i) * ch + k], Labmin[k], Labmax[k]);
+      const float xc = sse ? clamp_sse(row[k], lmin[k], lmax[k]) : CLAMPF(row[k], lmin[k], lmax[k]);
+
+      const float yc = filter_step(sse, a2, xn[k], a3, xa[k], b1, yn[k], b2, ya[k]);
+
       xa[k] = xn[k];
-      yn[k] = xn[k] * coefn;
+      xn[k] = xc;
       ya[k] = yn[k];
+      yn[k] = yc;
+
+      trow[k] += yc;
     }
+  }
+}
 
-    for(int j = height - 1; j > -1; j--)
-    {
-      size_t offset = ((size_t)j * width + i) * ch;
+// vertical blur of the whole image into temp, in blocks of columns
+static void blur_vertical(const float *const in, float *const temp, const int width, const int height,
+                          const int ch, const float *const min, const float *const max, const float a0,
+                          const float a1, const float a2, const float a3, const float b1, const float b2,
+                          const float coefp, const float coefn, const int sse)
+{
+  // whole pixels per block, and the clamping bounds of every lane
+  const int cols = MAX(1, VBLOCK / ch);
+  const int blocks = (width + cols - 1) / cols;
+  const size_t stride = (size_t)width * ch;
+  float lmin[VBLOCK], lmax[VBLOCK];
+  for(int k = 0; k < cols * ch; k++)
+  {
+    lmin[k] = min[k % ch];
+    lmax[k] = max[k % ch];
+  }
 
-      for(int k = 0; k < ch; k++)
-      {
-        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, temp, width, height, ch, cols, blocks, stride, lmin, lmax, a0, a1, a2, a3, b1, b2, \
+                      coefp, coefn, sse) \
+  schedule(static)
+#endif
+  for(int b = 0; b < blocks; b++)
+  {
+    const int i0 = b * cols;
+    const size_t offset = (size_t)i0 * ch;
+    if(i0 + cols <= width && cols * ch == VBLOCK)
+      blur_vertical_block(in + offset, temp + offset, stride, height, VBLOCK, lmin, lmax, a0, a1, a2, a3, b1,
+                          b2, coefp, coefn, sse);
+    else
+      blur_vertical_block(in + offset, temp + offset, stride, height, MIN(cols, width - i0) * ch, lmin, lmax,
+                          a0, a1, a2, a3, b1, b2, coefp, coefn, sse);
+  }
+}
 
-        yc[k] = (a2 * xn[k]) + (a3 * xa[k]) - (b1 * yn[k]) - (b2 * ya[k]);
+void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
+{
 
-        xa[k] = xn[k];
-        xn[k] = xc[k];
-        ya[k] = yn[k];
-        yn[k] = yc[k];
+  const int width = g->width;
+  const int height = g->height;
+  const int ch = MIN(4, g->channels); // just to appease zealous compiler warnings about stack usage
 
-        temp[offset + k] += yc[k];
-      }
-    }
-  }
+  float a0, a1, a2, a3, b1, b2, coefp, coefn;
+
+  compute_gauss_params(g->sigma, g->order, &a0, &a1, &a2, &a3, &b1, &b2, &coefp, &coefn);
+
+  float *temp = g->buf;
+
+  float *Labmax = g->max;
+  float *Labmin = g->min;
+
+  // vertical blur, a few columns at a time
+  blur_vertical(in, temp, width, height, ch, Labmin, Labmax, a0, a1, a2, a3, b1, b2, coefp, coefn, 0);
 
 // horizontal blur line by line
 #ifdef _OPENMP
@@ -342,76 +473,9 @@ static void dt_gaussian_blur_4c_sse(dt_gaussian_t *g, const float *const in, flo
   float *temp = g->buf;
 
 
-// vertical blur column by column
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, Labmin, Labmax, width, height, ch) \
-  shared(temp, a0, a1, a2, a3, b1, b2, coefp, coefn) \
-  schedule(static)
-#endif
-  for(int i = 0; i < width; i++)
-  {
-    __m128 xp = _mm_setzero_ps();
-    __m128 yb = _mm_setzero_ps();
-    __m128 yp = _mm_setzero_ps();
-    __m128 xc = _mm_setzero_ps();
-    __m128 yc = _mm_setzero_ps();
-    __m128 xn = _mm_setzero_ps();
-    __m128 xa = _mm_setzero_ps();
-    __m128 yn = _mm_setzero_ps();
-    __m128 ya = _mm_setzero_ps();
-
-    // forward filter
-    xp = MMCLAMPPS(_mm_load_ps(in + i * ch), Labmin, Labmax);
-    yb = _mm_mul_ps(_mm_set_ps1(coefp), xp);
-    yp = yb;
-
-
-    for(int j = 0; j < height; j++)
-    {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      xc = MMCLAMPPS(_mm_load_ps(in + offset), Labmin, Labmax);
-
-
-      yc = _mm_add_ps(
-          _mm_mul_ps(xc, _mm_set_ps1(a0)),
-          _mm_sub_ps(_mm_mul_ps(xp, _mm_set_ps1(a1)),
-                     _mm_add_ps(_mm_mul_ps(yp, _mm_set_ps1(b1)), _mm_mul_ps(yb, _mm_set_ps1(b2)))));
-
-      _mm_store_ps(temp + offset, yc);
-
-      xp = xc;
-      yb = yp;
-      yp = yc;
-    }
-
-    // backward filter
-    xn = MMCLAMPPS(_mm_load_ps(in + ((size_t)(height - 1) * width + i) * ch), Labmin, Labmax);
-    xa = xn;
-    yn = _mm_mul_ps(_mm_set_ps1(coefn), xn);
-    ya = yn;
-
-    for(int j = height - 1; j > -1; j--)
-    {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      xc = MMCLAMPPS(_mm_load_ps(in + offset), Labmin, Labmax);
-
-      yc = _mm_add_ps(
-          _mm_mul_ps(xn, _mm_set_ps1(a2)),
-          _mm_sub_ps(_mm_mul_ps(xa, _mm_set_ps1(a3)),
-                     _mm_add_ps(_mm_mul_ps(yn, _mm_set_ps1(b1)), _mm_mul_ps(ya, _mm_set_ps1(b2)))));
-
-
-      xa = xn;
-      xn = xc;
-      ya = yn;
-      yn = yc;
-
-      _mm_store_ps(temp + offset, _mm_add_ps(_mm_load_ps(temp + offset), yc));
-    }
-  }
+  // vertical blur, a few columns at a time: the plain blocked code is vectorized over more
+  // lanes than one pixel per __m128
+  blur_vertical(in, temp, width, height, ch, g->min, g->max, a0, a1, a2, a3, b1, b2, coefp, coefn, 1);
 
 // horizontal blur line by line
 #ifdef _OPENMP
@@ -500,7 +564,7 @@ void dt_gaussian_blur_4c(dt_gaussian_t *g, const float *const in, float *const o
 void dt_gaussian_free(dt_gaussian_t *g)
 {
   if(!g) return;
-  dt_free_align(g->buf);
+  arena_free(g->buf, g->bufsize);
   free(g->min);
   free(g->max);
   free(g);
@@ -38,6 +38,7 @@ typedef struct dt_gaussian_t
   float *max;
   float *min;
   float *buf;
+  size_t bufsize;
 } dt_gaussian_t;
 
 dt_gaussian_t *dt_gaussian_init(const int width, const int height, const int channels, const float *max,
@@ -53,6 +54,9 @@ void dt_gaussian_blur_4c(dt_gaussian_t *g, const float *const in, float *const o
 
 void dt_gaussian_free(dt_gaussian_t *g);
 
+// frees the temp buffers kept for reuse
+void dt_gaussian_cleanup(void);
+
 
 #ifdef HAVE_OPENCL
 typedef struct dt_gaussian_cl_global_t
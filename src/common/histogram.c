@@ -23,6 +23,7 @@
 #endif
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "common/colorspaces_inline_conversions.h"
 #include "common/darktable.h"
@@ -305,6 +306,44 @@ inline static void histogram_helper_cs_Lab_LCh(const dt_dev_histogram_collection
 
 //==============================================================================
 
+// the partial histograms of the omp threads. histograms are collected on every pipe run, so each calling
+// thread keeps its scratch buffer around instead of allocating it every time.
+typedef struct dt_histogram_scratch_t
+{
+  size_t size;
+  void *buf;
+} dt_histogram_scratch_t;
+
+static void _histogram_scratch_free(gpointer data)
+{
+  dt_histogram_scratch_t *scratch = (dt_histogram_scratch_t *)data;
+  free(scratch->buf);
+  free(scratch);
+}
+
+static GPrivate _histogram_scratch = G_PRIVATE_INIT(_histogram_scratch_free);
+
+// returns a zeroed buffer of at least size bytes, owned by the calling thread
+static void *_histogram_scratch_get(const size_t size)
+{
+  dt_histogram_scratch_t *scratch = (dt_histogram_scratch_t *)g_private_get(&_histogram_scratch);
+  if(!scratch)
+  {
+    scratch = (dt_histogram_scratch_t *)calloc(1, sizeof(dt_histogram_scratch_t));
+    if(!scratch) return NULL;
+    g_private_set(&_histogram_scratch, scratch);
+  }
+  if(scratch->size < size)
+  {
+    free(scratch->buf);
+    scratch->buf = malloc(size);
+    scratch->size = scratch->buf ? size : 0;
+    if(!scratch->buf) return NULL;
+  }
+  memset(scratch->buf, 0, size);
+  return scratch->buf;
+}
+
 void dt_histogram_worker(dt_dev_histogram_collection_params_t *const histogram_params,
                          dt_dev_histogram_stats_t *histogram_stats, const void *const pixel,
                          uint32_t **histogram, const dt_worker Worker,
@@ -314,7 +353,8 @@ void dt_histogram_worker(dt_dev_histogram_collection_params_t *const histogram_p
 
   const size_t bins_total = (size_t)4 * histogram_params->bins_count;
   const size_t buf_size = bins_total * sizeof(uint32_t);
-  void *partial_hists = calloc(nthreads, buf_size);
+  void *partial_hists = _histogram_scratch_get(nthreads * buf_size);
+  if(!partial_hists) return;
 
   if(histogram_params->mul == 0) histogram_params->mul = (double)(histogram_params->bins_count - 1);
 
@@ -353,7 +393,6 @@ void dt_histogram_worker(dt_dev_histogram_collection_params_t *const histogram_p
   *histogram = realloc(*histogram, buf_size);
   memmove(*histogram, partial_hists, buf_size);
 #endif
-  free(partial_hists);
 
   histogram_stats->bins_count = histogram_params->bins_count;
   histogram_stats->pixels = (roi->width - roi->crop_width - roi->crop_x)
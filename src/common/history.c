@@ -495,36 +495,32 @@ int dt_history_merge_module_into_history(dt_develop_t *dev_dest, dt_develop_t *d
   return module_added;
 }
 
-static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_imgid, GList *ops)
+// the source side of a copy/paste, prepared once and shared by all destination images
+typedef struct _history_copy_source_t
 {
-  GList *modules_used = NULL;
-
-  dt_develop_t _dev_src = { 0 };
-  dt_develop_t _dev_dest = { 0 };
+  int32_t imgid;
+  dt_develop_t dev;
+  GList *mod_list;
+  // dt_ioppr_update_for_modules() renumbers the source modules for each destination, keep the
+  // original values of mod_list around to start every destination from the same state
+  int *multi_priority;
+  int *iop_order;
+} _history_copy_source_t;
+
+static void _history_copy_source_init(_history_copy_source_t *src, int32_t imgid, GList *ops)
+{
+  dt_develop_t *dev_src = &src->dev;
 
-  dt_develop_t *dev_src = &_dev_src;
-  dt_develop_t *dev_dest = &_dev_dest;
+  memset(src, 0, sizeof(_history_copy_source_t));
+  src->imgid = imgid;
 
   // we will do the copy/paste on memory so we can deal with masks
   dt_dev_init(dev_src, FALSE);
-  dt_dev_init(dev_dest, FALSE);
-
   dev_src->iop = dt_iop_load_modules_ext(dev_src, TRUE);
-  dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
-
   dt_dev_read_history_ext(dev_src, imgid, TRUE);
-
-  // This prepends the default modules and converts just in case it's an empty history
-  dt_dev_read_history_ext(dev_dest, dest_imgid, TRUE);
-
-  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_and_paste_on_image_merge ");
-  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge ");
-
+  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_source_init ");
   dt_dev_pop_history_items_ext(dev_src, dev_src->history_end);
-  dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
-
-  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_and_paste_on_image_merge 1");
-  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge 1");
+  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_source_init 1");
 
   GList *mod_list = NULL;
 
@@ -577,6 +573,71 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
   }
   if (DT_IOP_ORDER_INFO) fprintf(stderr,"\nvvvvv\n");
 
+  src->mod_list = mod_list;
+
+  const guint count = g_list_length(mod_list);
+  src->multi_priority = g_new(int, count);
+  src->iop_order = g_new(int, count);
+  int k = 0;
+  for(GList *l = mod_list; l; l = g_list_next(l), k++)
+  {
+    const dt_iop_module_t *mod = (dt_iop_module_t *)l->data;
+    src->multi_priority[k] = mod->multi_priority;
+    src->iop_order[k] = mod->iop_order;
+  }
+}
+
+static void _history_copy_source_restore(_history_copy_source_t *src)
+{
+  int k = 0;
+  for(GList *l = src->mod_list; l; l = g_list_next(l), k++)
+  {
+    dt_iop_module_t *mod = (dt_iop_module_t *)l->data;
+    mod->multi_priority = src->multi_priority[k];
+    mod->iop_order = src->iop_order[k];
+  }
+}
+
+static void _history_copy_source_cleanup(_history_copy_source_t *src)
+{
+  // leave the source modules as they were loaded
+  _history_copy_source_restore(src);
+  g_list_free(src->mod_list);
+  src->mod_list = NULL;
+  g_free(src->multi_priority);
+  src->multi_priority = NULL;
+  g_free(src->iop_order);
+  src->iop_order = NULL;
+  dt_dev_cleanup(&src->dev);
+}
+
+static int _history_copy_and_paste_on_image_merge(_history_copy_source_t *src, int32_t dest_imgid)
+{
+  GList *modules_used = NULL;
+
+  dt_develop_t _dev_dest = { 0 };
+
+  dt_develop_t *dev_src = &src->dev;
+  dt_develop_t *dev_dest = &_dev_dest;
+
+  dt_dev_init(dev_dest, FALSE);
+
+  dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
+
+  // This prepends the default modules and converts just in case it's an empty history
+  dt_dev_read_history_ext(dev_dest, dest_imgid, TRUE);
+
+  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge ");
+
+  dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
+
+  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge 1");
+
+  // undo the renumbering done for the previous destination
+  _history_copy_source_restore(src);
+
+  GList *mod_list = src->mod_list;
+
   // update iop-order list to have entries for the new modules
   dt_ioppr_update_for_modules(dev_dest, mod_list, FALSE);
 
@@ -596,7 +657,6 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
   // write history and forms to db
   dt_dev_write_history_ext(dev_dest, dest_imgid);
 
-  dt_dev_cleanup(dev_src);
   dt_dev_cleanup(dev_dest);
 
   g_list_free(modules_used);
@@ -604,7 +664,8 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
   return 0;
 }
 
-static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t dest_imgid, GList *ops)
+static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t dest_imgid, GList *ops,
+                                                      _history_copy_source_t *src)
 {
   int ret_val = 0;
   sqlite3_stmt *stmt;
@@ -698,13 +759,14 @@ static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t des
   else
   {
     // since the history and masks where deleted we can do a merge
-    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops);
+    ret_val = _history_copy_and_paste_on_image_merge(src, dest_imgid);
   }
 
   return ret_val;
 }
 
-int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops)
+static int _history_copy_and_paste_on_image_ext(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops,
+                                                _history_copy_source_t *src)
 {
   if(imgid == dest_imgid) return 1;
 
@@ -724,11 +786,22 @@ int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboole
   hist->imgid = dest_imgid;
   dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
 
+  // the source is only needed when merging modules, a plain overwrite copies the db rows
+  _history_copy_source_t _src;
+  const gboolean own_src = !src && (merge || ops);
+  if(own_src)
+  {
+    _history_copy_source_init(&_src, imgid, ops);
+    src = &_src;
+  }
+
   int ret_val = 0;
   if(merge)
-    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops);
+    ret_val = _history_copy_and_paste_on_image_merge(src, dest_imgid);
   else
-    ret_val = _history_copy_and_paste_on_image_overwrite(imgid, dest_imgid, ops);
+    ret_val = _history_copy_and_paste_on_image_overwrite(imgid, dest_imgid, ops, src);
+
+  if(own_src) _history_copy_source_cleanup(&_src);
 
   dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
   dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
@@ -765,6 +838,11 @@ int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboole
   return ret_val;
 }
 
+int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops)
+{
+  return _history_copy_and_paste_on_image_ext(imgid, dest_imgid, merge, ops, NULL);
+}
+
 GList *dt_history_get_items(int32_t imgid, gboolean enabled)
 {
   GList *result = NULL;
@@ -862,6 +940,20 @@ int dt_history_copy_and_paste_on_selection(int32_t imgid, gboolean merge, GList
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
+    // be sure the current history is written before reading the source
+    const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+    if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+    // the source history is parsed once and merged into every destination
+    _history_copy_source_t src;
+    const gboolean use_src = merge || ops;
+    if(use_src)
+    {
+      dt_lock_image(imgid);
+      _history_copy_source_init(&src, imgid, ops);
+      dt_unlock_image(imgid);
+    }
+
     dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
     do
     {
@@ -869,10 +961,12 @@ int dt_history_copy_and_paste_on_selection(int32_t imgid, gboolean merge, GList
       int32_t dest_imgid = sqlite3_column_int(stmt, 0);
 
       /* paste history stack onto image id */
-      dt_history_copy_and_paste_on_image(imgid, dest_imgid, merge, ops);
+      _history_copy_and_paste_on_image_ext(imgid, dest_imgid, merge, ops, use_src ? &src : NULL);
 
     } while(sqlite3_step(stmt) == SQLITE_ROW);
     dt_undo_end_group(darktable.undo);
+
+    if(use_src) _history_copy_source_cleanup(&src);
   }
   else
     res = 1;
@@ -1092,29 +1186,36 @@ int dt_history_compress_on_selection()
 
       if ((size>0) && (max>0))
       {
-        for (int index=0;index<(max+1);index++)
+        // collect the remaining nums in order, then close the gaps with one reused statement.
+        // the targets are always below the current num so renumbering in ascending order is safe.
+        GList *nums = NULL;
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+          "SELECT num FROM main.history WHERE imgid=?1 ORDER BY num", -1, &stmt2, NULL);
+        DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
+        while(sqlite3_step(stmt2) == SQLITE_ROW)
+          nums = g_list_prepend(nums, GINT_TO_POINTER(sqlite3_column_int(stmt2, 0)));
+        sqlite3_finalize(stmt2);
+        nums = g_list_reverse(nums);
+
+        // step by step set the correct num
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+          "UPDATE main.history SET num = ?3 WHERE imgid = ?1 AND num = ?2", -1, &stmt2, NULL);
+        for(GList *n = nums; n; n = g_list_next(n))
         {
-          sqlite3_stmt *stmt3;
-          DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-            "SELECT num FROM main.history WHERE imgid=?1 AND num=?2", -1, &stmt3, NULL);
-          DT_DEBUG_SQLITE3_BIND_INT(stmt3, 1, imgid);
-          DT_DEBUG_SQLITE3_BIND_INT(stmt3, 2, index);
-          if (sqlite3_step(stmt3) == SQLITE_ROW)
+          const int index = GPOINTER_TO_INT(n->data);
+          if(index != done)
           {
-            sqlite3_stmt *stmt4;
-            // step by step set the correct num
-            DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-              "UPDATE main.history SET num = ?3 WHERE imgid = ?1 AND num = ?2", -1, &stmt4, NULL);
-            DT_DEBUG_SQLITE3_BIND_INT(stmt4, 1, imgid);
-            DT_DEBUG_SQLITE3_BIND_INT(stmt4, 2, index);
-            DT_DEBUG_SQLITE3_BIND_INT(stmt4, 3, done);
-            sqlite3_step(stmt4);
-            sqlite3_finalize(stmt4);
-
-            done++;
+            DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
+            DT_DEBUG_SQLITE3_BIND_INT(stmt2, 2, index);
+            DT_DEBUG_SQLITE3_BIND_INT(stmt2, 3, done);
+            sqlite3_step(stmt2);
+            sqlite3_reset(stmt2);
+            sqlite3_clear_bindings(stmt2);
           }
-          sqlite3_finalize(stmt3);
+          done++;
         }
+        sqlite3_finalize(stmt2);
+        g_list_free(nums);
       }
       // update history end
       DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
@@ -1124,7 +1225,8 @@ int dt_history_compress_on_selection()
       sqlite3_step(stmt2);
       sqlite3_finalize(stmt2);
 
-      dt_image_write_sidecar_file(imgid);
+      // queued, the sidecars are written in the background
+      dt_image_synch_xmp(imgid);
     }
     if (test == 0) // no compression as history_end is right in the middle of history
     {
@@ -931,6 +931,11 @@ void dt_image_remove(const int32_t imgid)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.embedded_previews WHERE imgid = ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
   // also clear all thumbnails in mipmap_cache.
   dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
 }
@@ -2020,65 +2025,199 @@ int dt_image_local_copy_reset(const int32_t imgid)
 // xmp stuff
 // *******************************************************
 
+// sidecars are written by a background job. dt_image_synch_xmp() only records the image, repeated
+// requests for the same image before the job gets to it collapse into one write.
+static struct
+{
+  GMutex lock;
+  // imgid -> imgid, images waiting for their sidecar to be written
+  GHashTable *pending;
+  // a writer job is queued or running and will pick up pending
+  gboolean queued;
+  // imgid -> checksum of the darktable xmp data last written for it in this session
+  GHashTable *checksums;
+} _sidecar_writer;
+
+// get the sidecar name for imgid, FALSE if neither the original nor a local copy is accessible
+static gboolean _image_sidecar_filename(const int imgid, char *filename, const size_t size)
+{
+  // FIRST: check if the original file is present
+  gboolean from_cache = FALSE;
+  dt_image_full_path(imgid, filename, size, &from_cache);
+
+  if(!g_file_test(filename, G_FILE_TEST_EXISTS))
+  {
+    // OTHERWISE: check if the local copy exists
+    from_cache = TRUE;
+    dt_image_full_path(imgid, filename, size, &from_cache);
+
+    //  nothing to do, the original is not accessible and there is no local copy
+    if(!from_cache) return FALSE;
+  }
+
+  dt_image_path_append_version(imgid, filename, size);
+  g_strlcat(filename, ".xmp", size);
+  return TRUE;
+}
+
+// write the sidecar of imgid unless the data darktable puts into it did not change since it was last
+// written. returns TRUE if the file was (re)written and write_timestamp has to be updated.
+static gboolean _image_write_sidecar(const int imgid)
+{
+  char filename[PATH_MAX] = { 0 };
+  if(!_image_sidecar_filename(imgid, filename, sizeof(filename))) return FALSE;
+
+  gchar *checksum = dt_exif_xmp_checksum(imgid);
+
+  g_mutex_lock(&_sidecar_writer.lock);
+  const gchar *last = _sidecar_writer.checksums
+                          ? g_hash_table_lookup(_sidecar_writer.checksums, GINT_TO_POINTER(imgid))
+                          : NULL;
+  const gboolean unchanged = checksum && last && !strcmp(checksum, last);
+  g_mutex_unlock(&_sidecar_writer.lock);
+
+  if(unchanged && g_file_test(filename, G_FILE_TEST_EXISTS))
+  {
+    g_free(checksum);
+    return FALSE;
+  }
+
+  if(dt_exif_xmp_write(imgid, filename))
+  {
+    g_free(checksum);
+    return FALSE;
+  }
+
+  g_mutex_lock(&_sidecar_writer.lock);
+  if(!_sidecar_writer.checksums)
+    _sidecar_writer.checksums = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  if(checksum)
+    g_hash_table_insert(_sidecar_writer.checksums, GINT_TO_POINTER(imgid), checksum);
+  else
+    g_hash_table_remove(_sidecar_writer.checksums, GINT_TO_POINTER(imgid));
+  g_mutex_unlock(&_sidecar_writer.lock);
+  return TRUE;
+}
+
+// put the timestamps of freshly written sidecars into db, a single statement per chunk of images.
+// this can't be done in exif.cc since that code gets called for the copy exporter, too
+static void _image_update_write_timestamps(GList *imgs)
+{
+  while(imgs)
+  {
+    gchar *ids = NULL;
+    for(int count = 0; imgs && count < 1000; count++, imgs = g_list_next(imgs))
+      ids = dt_util_dstrcat(ids, "%s%d", ids ? "," : "", GPOINTER_TO_INT(imgs->data));
+
+    gchar *query = dt_util_dstrcat(NULL, "UPDATE main.images SET write_timestamp = STRFTIME('%%s', 'now') "
+                                         "WHERE id IN (%s)", ids);
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), query, NULL, NULL, NULL);
+    g_free(query);
+    g_free(ids);
+  }
+}
+
 void dt_image_write_sidecar_file(int imgid)
 {
-  // TODO: compute hash and don't write if not needed!
   // write .xmp file
   if(imgid > 0 && dt_conf_get_bool("write_sidecar_files"))
   {
-    char filename[PATH_MAX] = { 0 };
-
-    // FIRST: check if the original file is present
-    gboolean from_cache = FALSE;
-    dt_image_full_path(imgid, filename, sizeof(filename), &from_cache);
-
-    if (!g_file_test(filename, G_FILE_TEST_EXISTS))
+    if(_image_write_sidecar(imgid))
     {
-      // OTHERWISE: check if the local copy exists
-      from_cache = TRUE;
-      dt_image_full_path(imgid, filename, sizeof(filename), &from_cache);
-
-      //  nothing to do, the original is not accessible and there is no local copy
-      if (!from_cache) return;
+      GList *imgs = g_list_prepend(NULL, GINT_TO_POINTER(imgid));
+      _image_update_write_timestamps(imgs);
+      g_list_free(imgs);
     }
+  }
+}
 
-    dt_image_path_append_version(imgid, filename, sizeof(filename));
-    g_strlcat(filename, ".xmp", sizeof(filename));
-
-    if(!dt_exif_xmp_write(imgid, filename))
+// write all pending sidecars, until no new ones come in
+static void _image_sidecar_writer_drain(void)
+{
+  while(TRUE)
+  {
+    g_mutex_lock(&_sidecar_writer.lock);
+    GHashTable *pending = _sidecar_writer.pending;
+    _sidecar_writer.pending = NULL;
+    if(!pending) _sidecar_writer.queued = FALSE;
+    g_mutex_unlock(&_sidecar_writer.lock);
+    if(!pending) break;
+
+    GList *written = NULL;
+    if(dt_conf_get_bool("write_sidecar_files"))
     {
-      // put the timestamp into db. this can't be done in exif.cc since that code gets called
-      // for the copy exporter, too
-      sqlite3_stmt *stmt;
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                  "UPDATE main.images SET write_timestamp = STRFTIME('%s', 'now') WHERE id = ?1",
-                                  -1, &stmt, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-      sqlite3_step(stmt);
-      sqlite3_finalize(stmt);
+      GHashTableIter iter;
+      gpointer key;
+      g_hash_table_iter_init(&iter, pending);
+      while(g_hash_table_iter_next(&iter, &key, NULL))
+        if(_image_write_sidecar(GPOINTER_TO_INT(key))) written = g_list_prepend(written, key);
     }
+    g_hash_table_destroy(pending);
+
+    _image_update_write_timestamps(written);
+    g_list_free(written);
   }
 }
 
+static int32_t _image_sidecar_writer_job_run(dt_job_t *job)
+{
+  _image_sidecar_writer_drain();
+  return 0;
+}
+
+static void _image_sidecar_queue(GList *imgs)
+{
+  if(!imgs) return;
+
+  g_mutex_lock(&_sidecar_writer.lock);
+  if(!_sidecar_writer.pending) _sidecar_writer.pending = g_hash_table_new(NULL, NULL);
+  for(GList *iter = imgs; iter; iter = g_list_next(iter))
+    g_hash_table_add(_sidecar_writer.pending, iter->data);
+  const gboolean queue = !_sidecar_writer.queued;
+  _sidecar_writer.queued = TRUE;
+  g_mutex_unlock(&_sidecar_writer.lock);
+
+  // a running writer picks the new images up before it finishes
+  if(!queue) return;
+
+  // the system background queue never drops jobs, so pending images can't get stuck
+  dt_job_t *job = dt_control_job_create(&_image_sidecar_writer_job_run, "%s", "write sidecar files");
+  if(job)
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+  else
+    _image_sidecar_writer_drain();
+}
 
 void dt_image_synch_xmp(const int selected)
 {
+  if(!dt_conf_get_bool("write_sidecar_files")) return;
+
+  GList *imgs = NULL;
   if(selected > 0)
   {
-    dt_image_write_sidecar_file(selected);
+    imgs = g_list_prepend(imgs, GINT_TO_POINTER(selected));
   }
-  else if(dt_conf_get_bool("write_sidecar_files"))
+  else
   {
     sqlite3_stmt *stmt;
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images", -1, &stmt,
                                 NULL);
     while(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      const int imgid = sqlite3_column_int(stmt, 0);
-      dt_image_write_sidecar_file(imgid);
-    }
+      imgs = g_list_prepend(imgs, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
     sqlite3_finalize(stmt);
   }
+  _image_sidecar_queue(imgs);
+  g_list_free(imgs);
+}
+
+void dt_image_synch_xmp_flush(void)
+{
+  _image_sidecar_writer_drain();
+
+  g_mutex_lock(&_sidecar_writer.lock);
+  if(_sidecar_writer.checksums) g_hash_table_destroy(_sidecar_writer.checksums);
+  _sidecar_writer.checksums = NULL;
+  g_mutex_unlock(&_sidecar_writer.lock);
 }
 
 void dt_image_synch_all_xmp(const gchar *pathname)
@@ -2191,6 +2330,7 @@ void dt_image_add_time_offset(const int imgid, const long int offset)
     dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'w');
     g_strlcpy(img->exif_datetime_taken, datetime, sizeof(img->exif_datetime_taken));
     dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_SAFE);
+    dt_collection_images_changed();
   }
   else dt_image_cache_read_release(darktable.image_cache, cimg);
 
@@ -334,7 +334,10 @@ gboolean dt_image_safe_remove(const int32_t imgid);
 void dt_image_local_copy_synch(void);
 // xmp functions:
 void dt_image_write_sidecar_file(int imgid);
+/** queue writing the sidecar of selected (or of all selected images if selected <= 0) in the background */
 void dt_image_synch_xmp(const int selected);
+/** write all queued sidecars now, to be called once the job threads are gone */
+void dt_image_synch_xmp_flush(void);
 void dt_image_synch_all_xmp(const gchar *pathname);
 
 // add an offset to the exif_datetime_taken field
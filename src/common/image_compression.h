@@ -19,9 +19,20 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stddef.h>
 
 /** K. Roimela, T. Aarnio and J. Itäranta. High Dynamic Range Texture Compression. Proceedings of SIGGRAPH
  * 2006. */
+
+// number of bytes needed to hold a compressed width x height image (16 bytes per 4x4 block).
+// dimensions don't need to be multiples of 4, border blocks are padded.
+static inline size_t dt_image_compressed_size(const int32_t width, const int32_t height)
+{
+  return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * 16;
+}
+
+// compress/uncompress 4-channel float rgb buffers (the alpha channel is dropped, and written as 0).
+// input has to be non-negative, negative values are clamped to 0. blocks are processed in parallel.
 void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const int32_t height);
 void dt_image_uncompress(const uint8_t *in, float *out, const int32_t width, const int32_t height);
 
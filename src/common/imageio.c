@@ -23,6 +23,7 @@
 #include "common/colorspaces.h"
 #include "common/darktable.h"
 #include "common/debug.h"
+#include "common/embedded_preview.h"
 #include "common/exif.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
@@ -72,7 +73,8 @@
 #endif
 
 // load a full-res thumbnail:
-int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
+int dt_imageio_large_thumbnail(const int32_t imgid, const char *filename, const int32_t min_width,
+                               const int32_t min_height, uint8_t **buffer, int32_t *width, int32_t *height,
                                dt_colorspaces_color_profile_type_t *color_space)
 {
   int res = 1;
@@ -81,8 +83,11 @@ int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *
   char *mime_type = NULL;
   size_t bufsize;
 
-  // get the biggest thumb from exif
-  if(dt_exif_get_thumbnail(filename, &buf, &bufsize, &mime_type)) goto error;
+  // get the biggest thumb, straight from the container if we know where to look, from exif otherwise
+  if(!dt_embedded_preview_read(imgid, filename, min_width, min_height, &buf, &bufsize))
+    mime_type = strdup("image/jpeg");
+  else if(dt_exif_get_thumbnail(filename, &buf, &bufsize, &mime_type))
+    goto error;
 
   if(strcmp(mime_type, "image/jpeg") == 0)
   {
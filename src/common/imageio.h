@@ -99,7 +99,10 @@ void dt_imageio_flip_buffers_ui8_to_float(float *out, const uint8_t *in, const f
                                           const dt_image_orientation_t orientation);
 
 // allocate buffer and return 0 on success along with largest jpg thumbnail from raw.
-int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
+// the location of the thumbnail in the file is cached in the library for imgid. when the one found
+// there is smaller than min_width x min_height in both directions, exiv2 gets to look for a bigger one.
+int dt_imageio_large_thumbnail(const int32_t imgid, const char *filename, const int32_t min_width,
+                               const int32_t min_height, uint8_t **buffer, int32_t *width, int32_t *height,
                                dt_colorspaces_color_profile_type_t *color_space);
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
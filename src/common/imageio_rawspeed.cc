@@ -22,8 +22,16 @@
 
 #include "RawSpeed-API.h"
 
+#include <limits>
 #include <memory>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define __STDC_LIMIT_MACROS
 
 extern "C" {
@@ -34,6 +42,7 @@ extern "C" {
 #include "common/imageio_rawspeed.h"
 #include "imageio.h"
 #include "common/tags.h"
+#include "control/conf.h"
 #include <stdint.h>
 }
 
@@ -103,6 +112,53 @@ void dt_rawspeed_lookup_makermodel(const char *maker, const char *model,
   }
 }
 
+#ifndef _WIN32
+// a read only mapping of the whole raw file. rawspeed gets a non owning buffer on top of it,
+// so the file is neither copied to the heap nor read under the global readFile_mutex: the
+// kernel pages it in while the decoder runs. a file which shrinks or goes away meanwhile
+// raises SIGBUS, so this is only done when the user asks for it, for a NULL filename it
+// stays empty.
+class dt_rawspeed_mapping_t
+{
+public:
+  explicit dt_rawspeed_mapping_t(const char *filename)
+  {
+    if(!filename) return;
+    const int fd = open(filename, O_RDONLY);
+    if(fd < 0) return;
+
+    struct stat st;
+    if(!fstat(fd, &st) && st.st_size > 0
+       && (uint64_t)st.st_size <= std::numeric_limits<Buffer::size_type>::max())
+    {
+      void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(addr != MAP_FAILED)
+      {
+        madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        data = (const uint8_t *)addr;
+        size = st.st_size;
+      }
+    }
+    close(fd);
+  }
+
+  ~dt_rawspeed_mapping_t() { reset(); }
+
+  dt_rawspeed_mapping_t(const dt_rawspeed_mapping_t &) = delete;
+  dt_rawspeed_mapping_t &operator=(const dt_rawspeed_mapping_t &) = delete;
+
+  void reset()
+  {
+    if(data) munmap((void *)data, size);
+    data = NULL;
+    size = 0;
+  }
+
+  const uint8_t *data = NULL;
+  size_t size = 0;
+};
+#endif
+
 uint32_t dt_rawspeed_crop_dcraw_filters(uint32_t filters, uint32_t crop_x, uint32_t crop_y)
 {
   if(!filters || filters == 9u) return filters;
@@ -119,6 +175,11 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
   snprintf(filen, sizeof(filen), "%s", filename);
   FileReader f(filen);
 
+#ifndef _WIN32
+  // declared before the buffer and the decoder, so that it is unmapped after they are gone
+  dt_rawspeed_mapping_t map(dt_conf_get_bool("rawspeed_mmap") ? filen : NULL);
+#endif
+
   std::unique_ptr<RawDecoder> d;
   std::unique_ptr<const Buffer> m;
 
@@ -126,9 +187,16 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
   {
     dt_rawspeed_load_meta();
 
-    dt_pthread_mutex_lock(&darktable.readFile_mutex);
-    m = f.readFile();
-    dt_pthread_mutex_unlock(&darktable.readFile_mutex);
+#ifndef _WIN32
+    if(map.data)
+      m = std::unique_ptr<const Buffer>(new Buffer(map.data, map.size));
+    else
+#endif
+    {
+      dt_pthread_mutex_lock(&darktable.readFile_mutex);
+      m = f.readFile();
+      dt_pthread_mutex_unlock(&darktable.readFile_mutex);
+    }
 
     RawParser t(m.get());
     d = t.getDecoder(meta);
@@ -223,6 +291,9 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
     /* free auto pointers on spot */
     d.reset();
     m.reset();
+#ifndef _WIN32
+    map.reset();
+#endif
 
     // Grab the WB
     for(int i = 0; i < 4; i++) img->wb_coeffs[i] = r->metadata.wbCoeffs[i];
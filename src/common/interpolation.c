@@ -639,6 +639,72 @@ static inline void compute_upsampling_kernel(const struct dt_interpolation *itor
     dt_unreachable_codepath();
 }
 
+/* --------------------------------------------------------------------------
+ * Tabulated kernels for the per pixel interpolation
+ * ------------------------------------------------------------------------*/
+
+// samples per unit of t, linear interpolation in between stays within 1e-5 of the
+// direct evaluation (bar the removable singularity of the fast lanczos at t == 0)
+#define KERNEL_LUT_RES 4096
+
+static float kernel_lut[DT_INTERPOLATION_LAST][MAX_HALF_FILTER_WIDTH * KERNEL_LUT_RES + 2];
+
+static const float *get_kernel_lut(const struct dt_interpolation *itor)
+{
+  static gsize lut_initialized = 0;
+  if(g_once_init_enter(&lut_initialized))
+  {
+    for(int i = DT_INTERPOLATION_FIRST; i < DT_INTERPOLATION_LAST; i++)
+    {
+      const struct dt_interpolation *const it = &dt_interpolator[i];
+      const int n = it->width * KERNEL_LUT_RES;
+      // all kernels are even functions, tabulate [0, width]
+      for(int k = 0; k <= n; k++) kernel_lut[it->id][k] = it->func((float)it->width, (float)k / KERNEL_LUT_RES);
+      // so that t == width can be interpolated without a branch
+      kernel_lut[it->id][n + 1] = kernel_lut[it->id][n];
+    }
+    g_once_init_leave(&lut_initialized, 1);
+  }
+  return kernel_lut[itor->id];
+}
+
+/** Computes an upsampling filtering kernel from the tabulated kernel
+ *
+ * same interface as compute_upsampling_kernel(), but no transcendental
+ * function is evaluated per tap. used for the per pixel interpolation which
+ * builds two kernels for every single output pixel. */
+static inline void compute_upsampling_kernel_lut(const struct dt_interpolation *itor, float *kernel,
+                                                 float *norm, int *first, float t)
+{
+  const float *const lut = get_kernel_lut(itor);
+  const float w = (float)itor->width;
+
+  int f = (int)t - itor->width + 1;
+  if(first)
+  {
+    *first = f;
+  }
+
+  t = t - (float)f;
+
+  float n = 0.f;
+#ifdef _OPENMP
+#pragma omp simd reduction(+ : n)
+#endif
+  for(int i = 0; i < 2 * itor->width; i++)
+  {
+    const float x = fminf(fabsf(t - (float)i), w) * KERNEL_LUT_RES;
+    const int k = (int)x;
+    const float tap = lut[k] + (x - (float)k) * (lut[k + 1] - lut[k]);
+    n += tap;
+    kernel[i] = tap;
+  }
+  if(norm)
+  {
+    *norm = n;
+  }
+}
+
 /** Computes a downsampling filtering kernel
  *
  * @param itor [in] Interpolator used
@@ -788,8 +854,8 @@ float dt_interpolation_compute_sample(const struct dt_interpolation *itor, const
   // Compute both horizontal and vertical kernels
   float normh;
   float normv;
-  compute_upsampling_kernel(itor, kernelh, &normh, NULL, x);
-  compute_upsampling_kernel(itor, kernelv, &normv, NULL, y);
+  compute_upsampling_kernel_lut(itor, kernelh, &normh, NULL, x);
+  compute_upsampling_kernel_lut(itor, kernelv, &normv, NULL, y);
 
   int ix = (int)x;
   int iy = (int)y;
@@ -884,8 +950,8 @@ static void dt_interpolation_compute_pixel4c_plain(const struct dt_interpolation
   // Compute both horizontal and vertical kernels
   float normh;
   float normv;
-  compute_upsampling_kernel(itor, kernelh, &normh, NULL, x);
-  compute_upsampling_kernel(itor, kernelv, &normv, NULL, y);
+  compute_upsampling_kernel_lut(itor, kernelh, &normh, NULL, x);
+  compute_upsampling_kernel_lut(itor, kernelv, &normv, NULL, y);
 
   // Precompute the inverse of the filter norm for later use
   const float oonorm = (1.f / (normh * normv));
@@ -979,8 +1045,8 @@ static void dt_interpolation_compute_pixel4c_sse(const struct dt_interpolation *
   // Compute both horizontal and vertical kernels
   float normh;
   float normv;
-  compute_upsampling_kernel(itor, kernelh, &normh, NULL, x);
-  compute_upsampling_kernel(itor, kernelv, &normv, NULL, y);
+  compute_upsampling_kernel_lut(itor, kernelh, &normh, NULL, x);
+  compute_upsampling_kernel_lut(itor, kernelv, &normv, NULL, y);
 
   // We will process four components a time, duplicate the information
   for(int i = 0; i < 2 * itor->width; i++)
@@ -1093,8 +1159,8 @@ static void dt_interpolation_compute_pixel1c_plain(const struct dt_interpolation
   // Compute both horizontal and vertical kernels
   float normh;
   float normv;
-  compute_upsampling_kernel(itor, kernelh, &normh, NULL, x);
-  compute_upsampling_kernel(itor, kernelv, &normv, NULL, y);
+  compute_upsampling_kernel_lut(itor, kernelh, &normh, NULL, x);
+  compute_upsampling_kernel_lut(itor, kernelv, &normv, NULL, y);
 
   // Precompute the inverse of the filter norm for later use
   const float oonorm = (1.f / (normh * normv));
@@ -1259,7 +1325,7 @@ const struct dt_interpolation *dt_interpolation_new(enum dt_interpolation_type t
  * @param in [in] Number of input samples
  * @param out [in] Number of output samples
  * @param plength [out] Array of lengths for each pixel filtering (number
- * of taps/indexes to use). This array mus be freed with dt_free_align() when you're
+ * of taps/indexes to use). This array must be handed to release_resampling_plan() when you're
  * done with the plan.
  * @param pkernel [out] Array of filter kernel taps
  * @param pindex [out] Array of sample indexes to be used for applying each kernel tap
@@ -1268,7 +1334,7 @@ const struct dt_interpolation *dt_interpolation_new(enum dt_interpolation_type t
  * out position meta[3*out]
  * @return 0 for success, !0 for failure
  */
-static int prepare_resampling_plan(const struct dt_interpolation *itor, int in, const int in_x0, int out,
+static int compute_resampling_plan(const struct dt_interpolation *itor, int in, const int in_x0, int out,
                                    const int out_x0, float scale, int **plength, float **pkernel,
                                    int **pindex, int **pmeta)
 {
@@ -1449,6 +1515,122 @@ static int prepare_resampling_plan(const struct dt_interpolation *itor, int in,
   return 0;
 }
 
+/* --------------------------------------------------------------------------
+ * Resampling plan cache
+ * ------------------------------------------------------------------------*/
+
+/* the pipes keep resampling the same geometries (the final downscale, every
+ * redraw at a given zoom level, exports of a whole film roll at the same
+ * size), so the plans are kept and shared between calls and threads. a plan
+ * only depends on the interpolator, the sizes, the output offset and the
+ * scale, and is read-only once computed. */
+#define RESAMPLING_PLAN_CACHE_SIZE 16
+
+typedef struct resampling_plan_t
+{
+  enum dt_interpolation_type id;
+  int in, out, out_x0;
+  float scale;
+  gboolean meta;
+  int *length; // start of the plan allocation
+  float *kernel;
+  int *index;
+  int *pmeta;
+  int users;
+  uint64_t age;
+} resampling_plan_t;
+
+static struct
+{
+  GMutex lock;
+  uint64_t clock;
+  resampling_plan_t plan[RESAMPLING_PLAN_CACHE_SIZE];
+} plan_cache;
+
+/** Looks up a resampling plan in the cache or computes it, see compute_resampling_plan()
+ * for the parameters. The plan has to be handed back with release_resampling_plan(). */
+static int prepare_resampling_plan(const struct dt_interpolation *itor, int in, const int in_x0, int out,
+                                   const int out_x0, float scale, int **plength, float **pkernel,
+                                   int **pindex, int **pmeta)
+{
+  if(scale == 1.f)
+    return compute_resampling_plan(itor, in, in_x0, out, out_x0, scale, plength, pkernel, pindex, pmeta);
+
+  g_mutex_lock(&plan_cache.lock);
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE_SIZE; k++)
+  {
+    resampling_plan_t *p = &plan_cache.plan[k];
+    if(p->length && p->id == itor->id && p->in == in && p->out == out && p->out_x0 == out_x0
+       && p->scale == scale && p->meta == (pmeta != NULL))
+    {
+      p->users++;
+      p->age = ++plan_cache.clock;
+      *plength = p->length;
+      *pkernel = p->kernel;
+      *pindex = p->index;
+      if(pmeta) *pmeta = p->pmeta;
+      g_mutex_unlock(&plan_cache.lock);
+      return 0;
+    }
+  }
+  g_mutex_unlock(&plan_cache.lock);
+
+  const int r = compute_resampling_plan(itor, in, in_x0, out, out_x0, scale, plength, pkernel, pindex, pmeta);
+  if(r) return r;
+
+  // replace the least recently used plan nobody is working with
+  g_mutex_lock(&plan_cache.lock);
+  resampling_plan_t *victim = NULL;
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE_SIZE; k++)
+  {
+    resampling_plan_t *p = &plan_cache.plan[k];
+    if(p->users) continue;
+    if(!victim || !p->length || (victim->length && p->age < victim->age)) victim = p;
+  }
+  if(victim)
+  {
+    dt_free_align(victim->length);
+    *victim = (resampling_plan_t){ .id = itor->id, .in = in, .out = out, .out_x0 = out_x0, .scale = scale,
+                                   .meta = (pmeta != NULL), .length = *plength, .kernel = *pkernel,
+                                   .index = *pindex, .pmeta = pmeta ? *pmeta : NULL, .users = 1,
+                                   .age = ++plan_cache.clock };
+  }
+  g_mutex_unlock(&plan_cache.lock);
+
+  return 0;
+}
+
+static void release_resampling_plan(int *length)
+{
+  if(!length) return;
+
+  g_mutex_lock(&plan_cache.lock);
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE_SIZE; k++)
+  {
+    if(plan_cache.plan[k].length == length)
+    {
+      plan_cache.plan[k].users--;
+      g_mutex_unlock(&plan_cache.lock);
+      return;
+    }
+  }
+  g_mutex_unlock(&plan_cache.lock);
+
+  // the cache was full of busy plans, this one was private
+  dt_free_align(length);
+}
+
+void dt_interpolation_cleanup(void)
+{
+  g_mutex_lock(&plan_cache.lock);
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE_SIZE; k++)
+  {
+    dt_free_align(plan_cache.plan[k].length);
+    plan_cache.plan[k] = (resampling_plan_t){ 0 };
+  }
+  g_mutex_unlock(&plan_cache.lock);
+}
+
 static void dt_interpolation_resample_plain(const struct dt_interpolation *itor, float *out,
                                             const dt_iop_roi_t *const roi_out, const int32_t out_stride,
                                             const float *const in, const dt_iop_roi_t *const roi_in,
@@ -1601,8 +1783,8 @@ exit:
   /* Free the resampling plans. It's nasty to optimize allocs like that, but
    * it simplifies the code :-D. The length array is in fact the only memory
    * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  release_resampling_plan(hlength);
+  release_resampling_plan(vlength);
 }
 
 #if defined(__SSE2__)
@@ -1762,8 +1944,8 @@ exit:
   /* Free the resampling plans. It's nasty to optimize allocs like that, but
    * it simplifies the code :-D. The length array is in fact the only memory
    * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  release_resampling_plan(hlength);
+  release_resampling_plan(vlength);
 }
 #endif
 
@@ -2019,8 +2201,8 @@ int dt_interpolation_resample_cl(const struct dt_interpolation *itor, int devid,
   dt_opencl_release_mem_object(dev_vlength);
   dt_opencl_release_mem_object(dev_vkernel);
   dt_opencl_release_mem_object(dev_vmeta);
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  release_resampling_plan(hlength);
+  release_resampling_plan(vlength);
   return CL_SUCCESS;
 
 error:
@@ -2032,8 +2214,8 @@ error:
   dt_opencl_release_mem_object(dev_vlength);
   dt_opencl_release_mem_object(dev_vkernel);
   dt_opencl_release_mem_object(dev_vmeta);
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  release_resampling_plan(hlength);
+  release_resampling_plan(vlength);
   dt_print(DT_DEBUG_OPENCL, "[opencl_resampling] couldn't enqueue kernel! %d\n", err);
   return err;
 }
@@ -2208,8 +2390,8 @@ static void dt_interpolation_resample_1c_plain(const struct dt_interpolation *it
   /* Free the resampling plans. It's nasty to optimize allocs like that, but
    * it simplifies the code :-D. The length array is in fact the only memory
    * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  release_resampling_plan(hlength);
+  release_resampling_plan(vlength);
 }
 
 /** Applies resampling (re-scaling) on *full* input and output buffers.
@@ -75,6 +75,10 @@ void local_laplacian(
 size_t local_laplacian_memory_use(const int width,      // width of input image
                                   const int height);    // height of input image
 
+// the opencl path keeps all gamma levels on the device at once
+size_t local_laplacian_memory_use_cl(const int width,   // width of input image
+                                     const int height); // height of input image
+
 
 size_t local_laplacian_singlebuffer_size(const int width,       // width of input image
                                          const int height);     // height of input image
@@ -206,6 +206,7 @@ static void _pop_undo_execute(const int imgid, GList *before, GList *after)
 
   _bulk_remove_metadata(imgid, tobe_removed_list);
   _bulk_add_metadata(tobe_added_list);
+  if(tobe_removed_list || tobe_added_list) dt_collection_images_changed();
 
   g_free(tobe_removed_list);
   g_free(tobe_added_list);
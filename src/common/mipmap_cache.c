@@ -23,10 +23,12 @@
 #include "common/file_location.h"
 #include "common/grealpath.h"
 #include "common/image_cache.h"
+#include "common/image_compression.h"
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
 #include "control/conf.h"
+#include "control/control.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
 
@@ -61,7 +63,9 @@ typedef enum dt_mipmap_buffer_dsc_flags
 {
   DT_MIPMAP_BUFFER_DSC_FLAG_NONE = 0,
   DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE = 1 << 0,
-  DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE = 1 << 1
+  DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE = 1 << 1,
+  // float buffer holds 4-channel rgb (no mosaic), so it can go to the compressed tier when evicted
+  DT_MIPMAP_BUFFER_DSC_FLAG_COMPRESSIBLE = 1 << 2
 } dt_mipmap_buffer_dsc_flags;
 
 // the embedded Exif data to tag thumbnails as sRGB or AdobeRGB
@@ -106,6 +110,15 @@ static const size_t dt_mipmap_buffer_dsc_size __attribute__((unused))
 static const size_t dt_mipmap_buffer_dsc_size __attribute__((unused)) = sizeof(struct dt_mipmap_buffer_dsc);
 #endif
 
+// header of an entry in the compressed float tier, followed by the compressed blocks
+struct dt_mipmap_compressed_dsc
+{
+  uint32_t width;
+  uint32_t height;
+  float iscale;
+  dt_colorspaces_color_profile_type_t color_space;
+} __attribute__((packed, aligned(64)));
+
 // last resort mem alloc for dead images. sizeof(dt_mipmap_buffer_dsc) + dead image pixels (8x8)
 // Must be alignment to 4 * sizeof(float).
 static float dt_mipmap_cache_static_dead_image[sizeof(struct dt_mipmap_buffer_dsc) / sizeof(float) + 64 * 4]
@@ -238,7 +251,7 @@ exit:
 }
 
 static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *buf, uint32_t *width, uint32_t *height, float *iscale,
-                    const uint32_t imgid);
+                    dt_mipmap_buffer_dsc_flags *flags, const uint32_t imgid);
 static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *iscale,
                     dt_colorspaces_color_profile_type_t *color_space, const uint32_t imgid,
                     const dt_mipmap_size_t size);
@@ -442,11 +455,119 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, uint32_t imgid,
   }
 }
 
+typedef struct _compress_f_job_t
+{
+  uint32_t key;
+  gint generation;
+  void *data; // the evicted dt_mipmap_buffer_dsc and its pixels, owned by the job
+} _compress_f_job_t;
+
+static int32_t _compress_f_job_run(dt_job_t *job)
+{
+  _compress_f_job_t *params = dt_control_job_get_params(job);
+  dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  // the image was removed since, or is back in the hot tier and will be compressed anew once evicted:
+  if(!cache->compressed_tier || params->generation != g_atomic_int_get(&cache->compressed_generation)
+     || dt_cache_contains(&cache->mip_f.cache, params->key))
+    return 0;
+
+  const struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)params->data;
+  dt_cache_t *ccache = &cache->mip_f_compressed.cache;
+  dt_cache_entry_t *centry = dt_cache_get(ccache, params->key, 'w');
+  ASAN_UNPOISON_MEMORY_REGION(centry->data, centry->data_size);
+  struct dt_mipmap_compressed_dsc *cdsc = (struct dt_mipmap_compressed_dsc *)centry->data;
+  cdsc->width = dsc->width;
+  cdsc->height = dsc->height;
+  cdsc->iscale = dsc->iscale;
+  cdsc->color_space = dsc->color_space;
+  dt_image_compress((const float *)(dsc + 1), (uint8_t *)(cdsc + 1), dsc->width, dsc->height);
+  dt_cache_release(ccache, centry);
+  return 0;
+}
+
+// also called when the job is discarded from the queue without having run
+static void _compress_f_job_cleanup(void *data)
+{
+  _compress_f_job_t *params = (_compress_f_job_t *)data;
+  dt_free_align(params->data);
+  free(params);
+}
+
+// move an evicted float buffer to the compressed tier, so switching back to this image
+// doesn't need to load and downscale the full image again. this is called from the garbage
+// collection with the mip_f cache locked, so the compression itself is left to a job which
+// takes over the buffer. returns TRUE if it did.
+static gboolean _compress_f(dt_mipmap_cache_t *cache, dt_cache_entry_t *entry)
+{
+  const struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+  // don't store skulls, half generated or outdated buffers:
+  if(dsc->width <= 8 || dsc->height <= 8) return FALSE;
+  if(!(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_COMPRESSIBLE)
+     || (dsc->flags & (DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE | DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE)))
+    return FALSE;
+  if(!dt_control_running()) return FALSE;
+
+  dt_job_t *job = dt_control_job_create(&_compress_f_job_run, "compress preview %d", get_imgid(entry->key));
+  if(!job) return FALSE;
+  _compress_f_job_t *params = (_compress_f_job_t *)calloc(1, sizeof(_compress_f_job_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return FALSE;
+  }
+  params->key = entry->key;
+  params->generation = g_atomic_int_get(&cache->compressed_generation);
+  params->data = entry->data;
+  entry->data = NULL;
+  dt_control_job_set_params_with_size(job, params, sizeof(_compress_f_job_t), _compress_f_job_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+  return TRUE;
+}
+
+// drop the compressed float buffer of an image, it doesn't match the file or the image any more
+static void _remove_compressed_f(dt_mipmap_cache_t *cache, const uint32_t imgid)
+{
+  g_atomic_int_inc(&cache->compressed_generation);
+  if(cache->compressed_tier) dt_cache_remove(&cache->mip_f_compressed.cache, get_key(imgid, DT_MIPMAP_F));
+}
+
+// try to fill a float buffer from the compressed tier. returns non zero on success.
+static int _uncompress_f(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *mipmap_buf,
+                         struct dt_mipmap_buffer_dsc *dsc, const uint32_t imgid)
+{
+  if(!cache->compressed_tier) return 0;
+
+  dt_cache_t *ccache = &cache->mip_f_compressed.cache;
+  const uint32_t key = get_key(imgid, DT_MIPMAP_F);
+  dt_cache_entry_t *centry = dt_cache_testget(ccache, key, 'r');
+  if(!centry) return 0;
+
+  ASAN_UNPOISON_MEMORY_REGION(centry->data, centry->data_size);
+  const struct dt_mipmap_compressed_dsc *cdsc = (struct dt_mipmap_compressed_dsc *)centry->data;
+  dt_image_uncompress((const uint8_t *)(cdsc + 1), (float *)(dsc + 1), cdsc->width, cdsc->height);
+  dsc->width = cdsc->width;
+  dsc->height = cdsc->height;
+  dsc->iscale = cdsc->iscale;
+  dsc->flags |= DT_MIPMAP_BUFFER_DSC_FLAG_COMPRESSIBLE;
+  mipmap_buf->color_space = cdsc->color_space;
+  dt_cache_release(ccache, centry);
+
+  // the hot tier owns this image again, it will be compressed anew once evicted:
+  dt_cache_remove(ccache, key);
+  __sync_fetch_and_add(&cache->mip_f_compressed.stats_fetches, 1);
+  return 1;
+}
+
 void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
   dt_mipmap_cache_t *cache = (dt_mipmap_cache_t *)data;
   const dt_mipmap_size_t mip = get_size(entry->key);
-  if(mip < DT_MIPMAP_F)
+  if(mip == DT_MIPMAP_F && cache->compressed_tier)
+  {
+    // the job frees the buffer once compressed
+    if(_compress_f(cache, entry)) return;
+  }
+  else if(mip < DT_MIPMAP_F)
   {
     struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
     // don't write skulls:
@@ -577,6 +698,11 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->mip_full.stats_misses = 0;
   cache->mip_full.stats_fetches = 0;
   cache->mip_full.stats_standin = 0;
+  cache->mip_f_compressed.stats_requests = 0;
+  cache->mip_f_compressed.stats_near_match = 0;
+  cache->mip_f_compressed.stats_misses = 0;
+  cache->mip_f_compressed.stats_fetches = 0;
+  cache->mip_f_compressed.stats_standin = 0;
 
   dt_cache_init(&cache->mip_thumbs.cache, 0, max_mem);
   dt_cache_set_allocate_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_allocate_dynamic, cache);
@@ -599,13 +725,34 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->buffer_size[DT_MIPMAP_F] = sizeof(struct dt_mipmap_buffer_dsc)
                                         + 4 * sizeof(float) * cache->max_width[DT_MIPMAP_F]
                                           * cache->max_height[DT_MIPMAP_F];
+
+  // second tier for evicted mipf buffers, block compressed to 1 byte per pixel instead of 16.
+  // entries are fixed-size, so the quota is the number of buffers fitting into the memory budget.
+  const size_t compressed_size = sizeof(struct dt_mipmap_compressed_dsc)
+                                 + dt_image_compressed_size(cache->max_width[DT_MIPMAP_F],
+                                                            cache->max_height[DT_MIPMAP_F]);
+  const int64_t compressed_memory = MAX(0, dt_conf_get_int64("cache_memory_compressed"));
+  const size_t compressed_entries = MIN((size_t)compressed_memory, ((size_t)8) << 30) / compressed_size;
+  dt_cache_init(&cache->mip_f_compressed.cache, compressed_size, compressed_entries);
+  cache->compressed_tier = compressed_entries > 0;
+  cache->compressed_generation = 0;
+
+  memset(&cache->viewport, 0, sizeof(cache->viewport));
+  dt_pthread_mutex_init(&cache->viewport.lock, NULL);
 }
 
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
 {
+  // no point in compressing buffers we are about to free anyway:
+  cache->compressed_tier = FALSE;
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+  dt_cache_cleanup(&cache->mip_f_compressed.cache);
+
+  // the control jobs are gone by now
+  dt_pthread_mutex_destroy(&cache->viewport.lock);
+  free(cache->viewport.imgids);
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
@@ -617,6 +764,11 @@ void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
   printf("[mipmap_cache] float fill %"PRIu32"/%"PRIu32" slots (%.2f%%)\n",
          (uint32_t)cache->mip_f.cache.cost, (uint32_t)cache->mip_f.cache.cost_quota,
          100.0f * (float)cache->mip_f.cache.cost / (float)cache->mip_f.cache.cost_quota);
+  if(cache->compressed_tier)
+    printf("[mipmap_cache] compressed float fill %"PRIu32"/%"PRIu32" slots (%.2f%%), %ld restored\n",
+           (uint32_t)cache->mip_f_compressed.cache.cost, (uint32_t)cache->mip_f_compressed.cache.cost_quota,
+           100.0f * (float)cache->mip_f_compressed.cache.cost / (float)cache->mip_f_compressed.cache.cost_quota,
+           cache->mip_f_compressed.stats_fetches);
   printf("[mipmap_cache] full  fill %"PRIu32"/%"PRIu32" slots (%.2f%%)\n",
          (uint32_t)cache->mip_full.cache.cost, (uint32_t)cache->mip_full.cache.cost_quota,
          100.0f * (float)cache->mip_full.cache.cost / (float)cache->mip_full.cache.cost_quota);
@@ -674,6 +826,128 @@ static dt_mipmap_cache_one_t *_get_cache(dt_mipmap_cache_t *cache, const dt_mipm
   }
 }
 
+typedef struct dt_mipmap_viewport_job_t
+{
+  int serial;
+  gboolean done; // the job has been taken off viewport.jobs
+} dt_mipmap_viewport_job_t;
+
+static int32_t _viewport_job_run(dt_job_t *job)
+{
+  dt_mipmap_viewport_job_t *params = dt_control_job_get_params(job);
+  dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  dt_mipmap_viewport_t *vp = &cache->viewport;
+
+  // generate thumbnails back to back, always the most important one left
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&vp->lock);
+    if(vp->next >= vp->count || !dt_control_running())
+    {
+      // leave under the lock, so that a new list is sure to get a job
+      vp->jobs--;
+      params->done = TRUE;
+      dt_pthread_mutex_unlock(&vp->lock);
+      break;
+    }
+    const int32_t imgid = vp->imgids[vp->next++];
+    const dt_mipmap_size_t mip = vp->mip;
+    dt_pthread_mutex_unlock(&vp->lock);
+
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(cache, &buf, imgid, mip, DT_MIPMAP_BLOCKING, 'r');
+    if(buf.buf && buf.height && buf.width)
+      dt_image_set_aspect_ratio_if_different(imgid, (double)buf.width / (double)buf.height);
+    dt_mipmap_cache_release(cache, &buf);
+  }
+  return 0;
+}
+
+// also called when the job is discarded from the queue without having run
+static void _viewport_job_cleanup(void *data)
+{
+  dt_mipmap_viewport_job_t *params = (dt_mipmap_viewport_job_t *)data;
+  if(!params->done)
+  {
+    dt_mipmap_viewport_t *vp = &darktable.mipmap_cache->viewport;
+    dt_pthread_mutex_lock(&vp->lock);
+    vp->jobs--;
+    dt_pthread_mutex_unlock(&vp->lock);
+  }
+  free(params);
+}
+
+// queue jobs up to one per worker but one, so that the user's own jobs still get through.
+// called with vp->lock held, which is released.
+static void _viewport_start_jobs(dt_mipmap_viewport_t *vp)
+{
+  const int max_jobs = MAX(1, darktable.control->num_threads - 1);
+  const int new_jobs = MAX(0, MIN(max_jobs, vp->count - vp->next) - vp->jobs);
+  vp->jobs += new_jobs;
+  const int serial = vp->serial;
+  vp->serial += new_jobs;
+  dt_pthread_mutex_unlock(&vp->lock);
+
+  for(int k = 0; k < new_jobs; k++)
+  {
+    dt_job_t *job = dt_control_job_create(&_viewport_job_run, "generate thumbnails %d", serial + k);
+    dt_mipmap_viewport_job_t *params = job ? calloc(1, sizeof(dt_mipmap_viewport_job_t)) : NULL;
+    if(!params)
+    {
+      if(job) dt_control_job_dispose(job);
+      dt_pthread_mutex_lock(&vp->lock);
+      vp->jobs--;
+      dt_pthread_mutex_unlock(&vp->lock);
+      continue;
+    }
+    params->serial = serial + k;
+    dt_control_job_set_params_with_size(job, params, sizeof(dt_mipmap_viewport_job_t), _viewport_job_cleanup);
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+  }
+}
+
+void dt_mipmap_cache_prefetch_viewport(dt_mipmap_cache_t *cache, const int32_t *imgids, const int count,
+                                       const dt_mipmap_size_t mip)
+{
+  if(mip >= DT_MIPMAP_F || (int)mip < DT_MIPMAP_0 || !dt_control_running()) return;
+
+  dt_mipmap_viewport_t *vp = &cache->viewport;
+  dt_pthread_mutex_lock(&vp->lock);
+
+  // redraws of an unchanged view keep the work in progress. if its jobs have all been
+  // dropped from a full queue meanwhile, the rest of the list needs new ones.
+  if(vp->mip == mip && vp->count == count && (count == 0 || !memcmp(vp->imgids, imgids, sizeof(int32_t) * count)))
+  {
+    if(vp->jobs == 0 && vp->next < vp->count)
+      _viewport_start_jobs(vp);
+    else
+      dt_pthread_mutex_unlock(&vp->lock);
+    return;
+  }
+
+  vp->imgids = realloc(vp->imgids, sizeof(int32_t) * MAX(count, 1));
+  memcpy(vp->imgids, imgids, sizeof(int32_t) * count);
+  vp->count = count;
+  vp->next = 0;
+  vp->mip = mip;
+
+  _viewport_start_jobs(vp);
+}
+
+// is the thumbnail waiting on the viewport's list? those already picked are either being
+// generated or done, in which case they may have been removed again and need a job of their own.
+// so do the waiting ones when no job is left to work through the list.
+static gboolean _viewport_wants(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  dt_mipmap_viewport_t *vp = &cache->viewport;
+  gboolean wanted = FALSE;
+  dt_pthread_mutex_lock(&vp->lock);
+  if(vp->mip == mip && vp->jobs > 0)
+    for(int k = vp->next; k < vp->count && !wanted; k++) wanted = (vp->imgids[k] == imgid);
+  dt_pthread_mutex_unlock(&vp->lock);
+  return wanted;
+}
+
 void dt_mipmap_cache_get_with_caller(
     dt_mipmap_cache_t *cache,
     dt_mipmap_buffer_t *buf,
@@ -722,6 +996,8 @@ void dt_mipmap_cache_get_with_caller(
     // and opposite: prefetch without locking
     if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
       return; // remove the (int) once we no longer have to support gcc < 4.8 :/
+    // the viewport jobs will get to it, in their own order
+    if(_viewport_wants(cache, imgid, mip)) return;
     dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
   }
   else if(flags == DT_MIPMAP_PREFETCH_DISK)
@@ -808,7 +1084,8 @@ void dt_mipmap_cache_get_with_caller(
       else if(mip == DT_MIPMAP_F)
       {
         ASAN_UNPOISON_MEMORY_REGION(dsc + 1, dsc->size - sizeof(struct dt_mipmap_buffer_dsc));
-        _init_f(buf, (float *)(dsc + 1), &dsc->width, &dsc->height, &dsc->iscale, imgid);
+        if(!_uncompress_f(cache, buf, dsc, imgid))
+          _init_f(buf, (float *)(dsc + 1), &dsc->width, &dsc->height, &dsc->iscale, &dsc->flags, imgid);
       }
       else
       {
@@ -996,6 +1273,7 @@ void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid)
       dt_mipmap_cache_unlink_ondisk_thumbnail((&_get_cache(cache, k)->cache)->cleanup_data, imgid, k);
     }
   }
+  _remove_compressed_f(cache, imgid);
 }
 void dt_mipmap_cache_evict_at_size(dt_mipmap_cache_t *cache, const uint32_t imgid, dt_mipmap_size_t mip)
 {
@@ -1013,10 +1291,11 @@ void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid)
     // write thumbnail to disc if not existing there
     dt_cache_remove(&_get_cache(cache, k)->cache, key);
   }
+  _remove_compressed_f(cache, imgid);
 }
 
 static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width, uint32_t *height, float *iscale,
-                    const uint32_t imgid)
+                    dt_mipmap_buffer_dsc_flags *flags, const uint32_t imgid)
 {
   const uint32_t wd = *width, ht = *height;
 
@@ -1099,6 +1378,8 @@ static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width,
   {
     // downsample
     dt_iop_clip_and_zoom(out, (const float *)buf.buf, &roi_out, &roi_in, roi_out.width, roi_in.width);
+    // only rgb buffers survive the lossy compressed tier, mosaics would not demosaic any more
+    *flags |= DT_MIPMAP_BUFFER_DSC_FLAG_COMPRESSIBLE;
   }
 
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
@@ -1197,7 +1478,7 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     {
       uint8_t *tmp = 0;
       int32_t thumb_width, thumb_height;
-      res = dt_imageio_large_thumbnail(filename, &tmp, &thumb_width, &thumb_height, color_space);
+      res = dt_imageio_large_thumbnail(imgid, filename, wd, ht, &tmp, &thumb_width, &thumb_height, color_space);
       if(!res)
       {
         // if the thumbnail is not large enough, we compute one
@@ -20,6 +20,7 @@
 
 #include "common/cache.h"
 #include "common/colorspaces.h"
+#include "common/dtpthread.h"
 #include "common/image.h"
 
 // sizes stored in the mipmap cache, set to fixed values in mipmap_cache.c
@@ -85,6 +86,18 @@ typedef struct dt_mipmap_cache_one_t
   long int stats_standin;    // texture used as stand-in
 } dt_mipmap_cache_one_t;
 
+// thumbnails wanted by the lighttable viewport, see dt_mipmap_cache_prefetch_viewport()
+typedef struct dt_mipmap_viewport_t
+{
+  dt_pthread_mutex_t lock;
+  int32_t *imgids;      // most important first
+  int count;
+  int next;             // first one not picked by a job yet
+  dt_mipmap_size_t mip;
+  int jobs;             // number of jobs working through the list
+  int serial;           // keeps the jobs apart in the control queue
+} dt_mipmap_viewport_t;
+
 typedef struct dt_mipmap_cache_t
 {
   // real width and height are stored per element
@@ -98,7 +111,13 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_thumbs;
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
+  // compressed second tier for evicted mip_f buffers
+  dt_mipmap_cache_one_t mip_f_compressed;
+  gboolean compressed_tier;
+  // bumped when images are removed, compression jobs queued before that are dropped
+  gint compressed_generation;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+  dt_mipmap_viewport_t viewport;
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -139,6 +158,13 @@ void dt_mipmap_cache_write_get_with_caller(
 void dt_mipmap_cache_release_with_caller(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *buf, const char *file,
                                          int line);
 
+// replace the thumbnails the viewport wants by imgids[0 .. count), ordered from the most important
+// (the centre of the view) to the least (prefetched rows). a few jobs work through the list one
+// thumbnail after the other, entries of a previous list not picked yet are dropped, so scrolling
+// away cancels pending work. prefetches of listed thumbnails don't queue jobs of their own.
+void dt_mipmap_cache_prefetch_viewport(dt_mipmap_cache_t *cache, const int32_t *imgids, const int count,
+                                       const dt_mipmap_size_t mip);
+
 // remove thumbnails, so they will be regenerated:
 void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid);
 
@@ -56,6 +56,8 @@ static void _ratings_apply_to_image(int imgid, int rating)
     image->flags = (image->flags & ~0x7) | (0x7 & rating);
     // synch through:
     dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_SAFE);
+    // the rating may be used to sort or filter the collections
+    dt_collection_images_changed();
   }
   else
   {
@@ -107,6 +107,9 @@ static void _destroy_style_shortcut_callback(gpointer data, GClosure *closure)
 }
 
 static int32_t dt_styles_get_id_by_name(const char *name);
+static GList *_styles_get_apply_items(const int id);
+static void _styles_apply_items_to_image(const char *name, GList *si_list, const gboolean duplicate,
+                                         const int32_t imgid);
 
 gboolean dt_styles_exists(const char *name)
 {
@@ -504,6 +507,10 @@ void dt_styles_apply_to_selection(const char *name, gboolean duplicate)
   const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
   if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
 
+  /* the style is read once and applied to all images */
+  const int id = dt_styles_get_id_by_name(name);
+  GList *si_list = id ? _styles_get_apply_items(id) : NULL;
+
   /* for each selected image apply style */
   sqlite3_stmt *stmt;
   dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
@@ -512,13 +519,24 @@ void dt_styles_apply_to_selection(const char *name, gboolean duplicate)
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
     const int imgid = sqlite3_column_int(stmt, 0);
-    dt_styles_apply_to_image(name, duplicate, imgid);
+    if(id) _styles_apply_items_to_image(name, si_list, duplicate, imgid);
     selected = TRUE;
   }
   sqlite3_finalize(stmt);
   dt_undo_end_group(darktable.undo);
 
-  if(!selected) dt_control_log(_("no image selected!"));
+  g_list_free_full(si_list, dt_style_item_free);
+
+  if(!selected)
+    dt_control_log(_("no image selected!"));
+  else if(id)
+  {
+    /* if we have created duplicates, reset collected images once */
+    if(duplicate) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
+
+    /* redraw center view to update visible mipmaps */
+    dt_control_queue_redraw_center();
+  }
 }
 
 void dt_styles_create_from_selection()
@@ -637,139 +655,169 @@ void dt_styles_apply_style_item(dt_develop_t *dev, dt_style_item_t *style_item,
   }
 }
 
-void dt_styles_apply_to_image(const char *name, const gboolean duplicate, const int32_t imgid)
+// read all items of a style once, the list is shared by all images the style is applied to
+static GList *_styles_get_apply_items(const int id)
 {
-  int id = 0;
   sqlite3_stmt *stmt;
+  GList *si_list = NULL;
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT num, module, operation, op_params, enabled,"
+                              "  blendop_params, blendop_version, multi_priority, multi_name"
+                              " FROM data.style_items WHERE styleid=?1 "
+                              " ORDER BY operation, multi_priority",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    dt_style_item_t *style_item = (dt_style_item_t *)malloc(sizeof(dt_style_item_t));
+
+    style_item->num = sqlite3_column_int(stmt, 0);
+    style_item->selimg_num = 0;
+    style_item->enabled = sqlite3_column_int(stmt, 4);
+    style_item->multi_priority = sqlite3_column_int(stmt, 7);
+    style_item->name = NULL;
+    style_item->operation = g_strdup((char *)sqlite3_column_text(stmt, 2));
+    style_item->multi_name = g_strdup((char *)sqlite3_column_text(stmt, 8));
+    style_item->module_version = sqlite3_column_int(stmt, 1);
+    style_item->blendop_version = sqlite3_column_int(stmt, 6);
+    style_item->params_size = sqlite3_column_bytes(stmt, 3);
+    style_item->params = (void *)malloc(style_item->params_size);
+    memcpy(style_item->params, (void *)sqlite3_column_blob(stmt, 3), style_item->params_size);
+    style_item->blendop_params_size = sqlite3_column_bytes(stmt, 5);
+    style_item->blendop_params = (void *)malloc(style_item->blendop_params_size);
+    memcpy(style_item->blendop_params, (void *)sqlite3_column_blob(stmt, 5), style_item->blendop_params_size);
+    style_item->iop_order = 0;
+
+    si_list = g_list_append(si_list, style_item);
+  }
+  sqlite3_finalize(stmt);
+
+  return si_list;
+}
+
+static void _styles_apply_items_to_image(const char *name, GList *si_list, const gboolean duplicate,
+                                         const int32_t imgid)
+{
   int32_t newimgid;
 
-  if((id = dt_styles_get_id_by_name(name)) != 0)
+  /* check if we should make a duplicate before applying style */
+  if(duplicate)
   {
-    /* check if we should make a duplicate before applying style */
-    if(duplicate)
-    {
-      newimgid = dt_image_duplicate(imgid);
-      if(newimgid != -1) dt_history_copy_and_paste_on_image(imgid, newimgid, FALSE, NULL);
-    }
-    else
-      newimgid = imgid;
+    newimgid = dt_image_duplicate(imgid);
+    if(newimgid != -1) dt_history_copy_and_paste_on_image(imgid, newimgid, FALSE, NULL);
+  }
+  else
+    newimgid = imgid;
 
-    // now deal with the history
-    GList *modules_used = NULL;
+  // now deal with the history
+  GList *modules_used = NULL;
 
-    dt_develop_t _dev_dest = { 0 };
+  dt_develop_t _dev_dest = { 0 };
 
-    dt_develop_t *dev_dest = &_dev_dest;
+  dt_develop_t *dev_dest = &_dev_dest;
 
-    dt_dev_init(dev_dest, FALSE);
+  dt_dev_init(dev_dest, FALSE);
 
-    dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
+  dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
 
-    dt_dev_read_history_ext(dev_dest, newimgid, TRUE);
+  dt_dev_read_history_ext(dev_dest, newimgid, TRUE);
 
-    dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image ");
+  dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image ");
 
-    dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
+  dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
 
-    dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 1");
+  dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 1");
 
-    if (DT_IOP_ORDER_INFO)
-      fprintf(stderr,"\n^^^^^ Apply style on image %i, history size %i",imgid,dev_dest->history_end);
+  if (DT_IOP_ORDER_INFO)
+    fprintf(stderr,"\n^^^^^ Apply style on image %i, history size %i",imgid,dev_dest->history_end);
 
-    // go through all entries in style
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "SELECT num, module, operation, op_params, enabled,"
-                                "  blendop_params, blendop_version, multi_priority, multi_name"
-                                " FROM data.style_items WHERE styleid=?1 "
-                                " ORDER BY operation, multi_priority",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
-    GList *si_list = NULL;
-    while(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      dt_style_item_t *style_item = (dt_style_item_t *)malloc(sizeof(dt_style_item_t));
-
-      style_item->num = sqlite3_column_int(stmt, 0);
-      style_item->selimg_num = 0;
-      style_item->enabled = sqlite3_column_int(stmt, 4);
-      style_item->multi_priority = sqlite3_column_int(stmt, 7);
-      style_item->name = NULL;
-      style_item->operation = g_strdup((char *)sqlite3_column_text(stmt, 2));
-      style_item->multi_name = g_strdup((char *)sqlite3_column_text(stmt, 8));
-      style_item->module_version = sqlite3_column_int(stmt, 1);
-      style_item->blendop_version = sqlite3_column_int(stmt, 6);
-      style_item->params_size = sqlite3_column_bytes(stmt, 3);
-      style_item->params = (void *)malloc(style_item->params_size);
-      memcpy(style_item->params, (void *)sqlite3_column_blob(stmt, 3), style_item->params_size);
-      style_item->blendop_params_size = sqlite3_column_bytes(stmt, 5);
-      style_item->blendop_params = (void *)malloc(style_item->blendop_params_size);
-      memcpy(style_item->blendop_params, (void *)sqlite3_column_blob(stmt, 5), style_item->blendop_params_size);
-      style_item->iop_order = 0;
-
-      si_list = g_list_append(si_list, style_item);
-    }
-    sqlite3_finalize(stmt);
+  // the iop-order update rewrites the multi-priorities for this image, keep the ones
+  // from the style so the shared item list can be applied to the next image
+  const int nb_items = g_list_length(si_list);
+  int *multi_priority = malloc(sizeof(int) * MAX(nb_items, 1));
+  int k = 0;
+  for(GList *l = si_list; l; l = g_list_next(l))
+    multi_priority[k++] = ((dt_style_item_t *)l->data)->multi_priority;
 
-    dt_ioppr_update_for_style_items(dev_dest, si_list, FALSE);
+  dt_ioppr_update_for_style_items(dev_dest, si_list, FALSE);
 
-    GList *l = si_list;
-    while(l)
-    {
-      dt_style_item_t *style_item = (dt_style_item_t *)l->data;
-      dt_styles_apply_style_item(dev_dest, style_item, &modules_used, FALSE);
-      l = g_list_next(l);
-    }
+  GList *l = si_list;
+  while(l)
+  {
+    dt_style_item_t *style_item = (dt_style_item_t *)l->data;
+    dt_styles_apply_style_item(dev_dest, style_item, &modules_used, FALSE);
+    l = g_list_next(l);
+  }
 
-    g_list_free_full(si_list, dt_style_item_free);
+  k = 0;
+  for(GList *li = si_list; li; li = g_list_next(li))
+  {
+    dt_style_item_t *style_item = (dt_style_item_t *)li->data;
+    style_item->multi_priority = multi_priority[k++];
+    style_item->iop_order = 0;
+  }
+  free(multi_priority);
 
-    if (DT_IOP_ORDER_INFO) fprintf(stderr,"\nvvvvv --> look for written history below\n");
+  if (DT_IOP_ORDER_INFO) fprintf(stderr,"\nvvvvv --> look for written history below\n");
 
-    dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 2");
+  dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 2");
 
-    dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
-    hist->imgid = newimgid;
-    dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
+  dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
+  hist->imgid = newimgid;
+  dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
 
-    // write history and forms to db
-    dt_dev_write_history_ext(dev_dest, newimgid);
+  // write history and forms to db
+  dt_dev_write_history_ext(dev_dest, newimgid);
 
-    dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
-    dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-    dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
-                   dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
-    dt_undo_end_group(darktable.undo);
+  dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
+  dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
+  dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
+                 dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
+  dt_undo_end_group(darktable.undo);
 
-    dt_dev_cleanup(dev_dest);
+  dt_dev_cleanup(dev_dest);
 
-    g_list_free(modules_used);
+  g_list_free(modules_used);
 
-    /* add tag */
-    guint tagid = 0;
-    gchar ntag[512] = { 0 };
-    g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", name);
-    if(dt_tag_new(ntag, &tagid)) dt_tag_attach_from_gui(tagid, newimgid, FALSE, FALSE);
-    if(dt_tag_new("darktable|changed", &tagid)) dt_tag_attach_from_gui(tagid, newimgid, FALSE, FALSE);
+  /* add tag */
+  guint tagid = 0;
+  gchar ntag[512] = { 0 };
+  g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", name);
+  if(dt_tag_new(ntag, &tagid)) dt_tag_attach_from_gui(tagid, newimgid, FALSE, FALSE);
+  if(dt_tag_new("darktable|changed", &tagid)) dt_tag_attach_from_gui(tagid, newimgid, FALSE, FALSE);
 
-    /* if current image in develop reload history */
-    if(dt_dev_is_current_image(darktable.develop, newimgid))
-    {
-      dt_dev_reload_history_items(darktable.develop);
-      dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
-      dt_dev_modules_update_multishow(darktable.develop);
-    }
+  /* if current image in develop reload history */
+  if(dt_dev_is_current_image(darktable.develop, newimgid))
+  {
+    dt_dev_reload_history_items(darktable.develop);
+    dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
+    dt_dev_modules_update_multishow(darktable.develop);
+  }
 
-    /* update xmp file */
-    dt_image_synch_xmp(newimgid);
+  /* update xmp file */
+  dt_image_synch_xmp(newimgid);
 
-    /* remove old obsolete thumbnails */
-    dt_mipmap_cache_remove(darktable.mipmap_cache, newimgid);
-    dt_image_reset_final_size(newimgid);
+  /* remove old obsolete thumbnails */
+  dt_mipmap_cache_remove(darktable.mipmap_cache, newimgid);
+  dt_image_reset_final_size(newimgid);
 
-    /* update the aspect ratio. recompute only if really needed for performance reasons */
-    if(darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
-      dt_image_set_aspect_ratio(newimgid);
-    else
-      dt_image_reset_aspect_ratio(newimgid);
+  /* update the aspect ratio. recompute only if really needed for performance reasons */
+  if(darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
+    dt_image_set_aspect_ratio(newimgid);
+  else
+    dt_image_reset_aspect_ratio(newimgid);
+}
+
+void dt_styles_apply_to_image(const char *name, const gboolean duplicate, const int32_t imgid)
+{
+  int id = 0;
+
+  if((id = dt_styles_get_id_by_name(name)) != 0)
+  {
+    GList *si_list = _styles_get_apply_items(id);
+    _styles_apply_items_to_image(name, si_list, duplicate, imgid);
+    g_list_free_full(si_list, dt_style_item_free);
 
     /* if we have created a duplicate, reset collected images */
     if(duplicate) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
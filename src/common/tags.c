@@ -122,6 +122,8 @@ static void _pop_undo_execute(const int imgid, GList *before, GList *after)
 
   _bulk_remove_tags(imgid, tobe_removed_list);
   _bulk_add_tags(tobe_added_list);
+  // the tags may be used to sort or filter the collections
+  dt_collection_images_changed();
 
   g_free(tobe_removed_list);
   g_free(tobe_added_list);
@@ -277,6 +279,7 @@ guint dt_tag_remove(const guint tagid, gboolean final)
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, tagid);
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
+    dt_collection_images_changed();
 
     /* raise signal of tags change to refresh keywords module */
     dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
@@ -302,6 +305,7 @@ void dt_tag_delete_tag_batch(const char *flatlist)
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
   g_free(query);
+  dt_collection_images_changed();
 }
 
 guint dt_tag_remove_list(GList *tag_list)
@@ -366,7 +370,7 @@ void dt_tag_rename(const guint tagid, const gchar *new_tagname)
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, new_tagname, -1, SQLITE_TRANSIENT);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
-
+  dt_collection_images_changed();
 }
 
 gboolean dt_tag_exists(const char *name, guint *tagid)
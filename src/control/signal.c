@@ -133,6 +133,9 @@ static dt_signal_description _signal_description[DT_SIGNAL_COUNT] = {
   { "dt-control-pickerdata-ready", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_generic, 2,
     pointer_2arg, NULL, FALSE }, // DT_SIGNAL_CONTROL_PICKERDATA_REAEDY
 
+  { "dt-develop-histogram-ready", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__VOID, 0,
+    NULL, NULL, FALSE }, // DT_SIGNAL_DEVELOP_HISTOGRAM_READY
+
 };
 
 static GType _signal_type;
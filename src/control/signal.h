@@ -204,6 +204,11 @@ typedef enum dt_signal_t
   */
   DT_SIGNAL_CONTROL_PICKERDATA_READY,
 
+  /** \brief This signal is raised when the background job has published a new display histogram
+    no param, no returned value
+  */
+  DT_SIGNAL_DEVELOP_HISTOGRAM_READY,
+
   /* do not touch !*/
   DT_SIGNAL_COUNT
 } dt_signal_t;
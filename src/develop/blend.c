@@ -177,102 +177,35 @@ static inline void _PX_COPY(const float *src, float *dst)
   dst[2] = src[2];
 }
 
-static inline float _blendif_factor(dt_iop_colorspace_type_t cst, const float *input, const float *output,
-                                    const unsigned int blendif, const float *parameters,
-                                    const unsigned int mask_mode, const unsigned int mask_combine,
-                                    const dt_iop_order_iccprofile_info_t *work_profile)
+/* blendif parameters digested once per process() call, so that the per pixel code only deals with the
+ * channels that actually restrict the mask */
+typedef struct _blendif_data_t
 {
-  float result = 1.0f;
-  float scaled[DEVELOP_BLENDIF_SIZE] = { 0.5f };
-  unsigned int channel_mask = 0;
-
-  if(!(mask_mode & DEVELOP_MASK_CONDITIONAL)) return (mask_combine & DEVELOP_COMBINE_INCL) ? 0.0f : 1.0f;
-
-  switch(cst)
-  {
-    case iop_cs_Lab:
-      scaled[DEVELOP_BLENDIF_L_in] =clamp_range_f(input[0]/100.0f, 0.0f, 1.0f); // L scaled to 0..1
-      scaled[DEVELOP_BLENDIF_A_in]
-          =clamp_range_f((input[1]+128.0f)/256.0f, 0.0f, 1.0f); // a scaled to 0..1
-      scaled[DEVELOP_BLENDIF_B_in]
-          =clamp_range_f((input[2]+128.0f)/256.0f, 0.0f, 1.0f);                 // b scaled to 0..1
-      scaled[DEVELOP_BLENDIF_L_out] =clamp_range_f(output[0]/100.0f, 0.0f, 1.0f); // L scaled to 0..1
-      scaled[DEVELOP_BLENDIF_A_out]
-          =clamp_range_f((output[1]+128.0f)/256.0f, 0.0f, 1.0f); // a scaled to 0..1
-      scaled[DEVELOP_BLENDIF_B_out]
-          =clamp_range_f((output[2]+128.0f)/256.0f, 0.0f, 1.0f); // b scaled to 0..1
-
-      if(blendif & 0x7f00) // do we need to consider LCh ?
-      {
-        float LCH_input[3];
-        float LCH_output[3];
-        dt_Lab_2_LCH(input, LCH_input);
-        dt_Lab_2_LCH(output, LCH_output);
-
-        scaled[DEVELOP_BLENDIF_C_in] =clamp_range_f(LCH_input[1]/(128.0f*sqrtf(2.0f)), 0.0f,
-                                                    1.0f);                     // C scaled to 0..1
-        scaled[DEVELOP_BLENDIF_h_in] =clamp_range_f(LCH_input[2], 0.0f, 1.0f); // h scaled to 0..1
-
-        scaled[DEVELOP_BLENDIF_C_out] =clamp_range_f(LCH_output[1]/(128.0f*sqrtf(2.0f)), 0.0f,
-                                                     1.0f);                      // C scaled to 0..1
-        scaled[DEVELOP_BLENDIF_h_out] =clamp_range_f(LCH_output[2], 0.0f, 1.0f); // h scaled to 0..1
-      }
-
-      channel_mask = DEVELOP_BLENDIF_Lab_MASK;
-
-      break;
-    case iop_cs_rgb:
-      if(work_profile == NULL)
-        scaled[DEVELOP_BLENDIF_GRAY_in] =clamp_range_f(0.3f*input[0]+0.59f*input[1]+0.11f*input[2], 0.0f,
-                                                       1.0f); // Gray scaled to 0..1
-      else
-        scaled[DEVELOP_BLENDIF_GRAY_in] =clamp_range_f(dt_ioppr_get_rgb_matrix_luminance(input,
-                                                                                         work_profile->matrix_in,
-                                                                                         work_profile->lut_in,
-                                                                                         work_profile->unbounded_coeffs_in,
-                                                                                         work_profile->lutsize,
-                                                                                         work_profile->nonlinearlut), 0.0f,
-                                                       1.0f);                // Gray scaled to 0..1
-      scaled[DEVELOP_BLENDIF_RED_in] =clamp_range_f(input[0], 0.0f, 1.0f);   // Red
-      scaled[DEVELOP_BLENDIF_GREEN_in] =clamp_range_f(input[1], 0.0f, 1.0f); // Green
-      scaled[DEVELOP_BLENDIF_BLUE_in] =clamp_range_f(input[2], 0.0f, 1.0f);  // Blue
-      if(work_profile == NULL)
-        scaled[DEVELOP_BLENDIF_GRAY_out] =clamp_range_f(0.3f*output[0]+0.59f*output[1]+0.11f*output[2],
-                                                        0.0f, 1.0f); // Gray scaled to 0..1
-      else
-        scaled[DEVELOP_BLENDIF_GRAY_out] =clamp_range_f(dt_ioppr_get_rgb_matrix_luminance(output,
-                                                                                          work_profile->matrix_in,
-                                                                                          work_profile->lut_in,
-                                                                                          work_profile->unbounded_coeffs_in,
-                                                                                          work_profile->lutsize,
-                                                                                          work_profile->nonlinearlut),
-                                                        0.0f, 1.0f);           // Gray scaled to 0..1
-      scaled[DEVELOP_BLENDIF_RED_out] =clamp_range_f(output[0], 0.0f, 1.0f);   // Red
-      scaled[DEVELOP_BLENDIF_GREEN_out] =clamp_range_f(output[1], 0.0f, 1.0f); // Green
-      scaled[DEVELOP_BLENDIF_BLUE_out] =clamp_range_f(output[2], 0.0f, 1.0f);  // Blue
-
-      if(blendif & 0x7f00) // do we need to consider HSL ?
-      {
-        float HSL_input[3];
-        float HSL_output[3];
-        dt_RGB_2_HSL(input, HSL_input);
-        dt_RGB_2_HSL(output, HSL_output);
-
-        scaled[DEVELOP_BLENDIF_H_in] =clamp_range_f(HSL_input[0], 0.0f, 1.0f); // H scaled to 0..1
-        scaled[DEVELOP_BLENDIF_S_in] =clamp_range_f(HSL_input[1], 0.0f, 1.0f); // S scaled to 0..1
-        scaled[DEVELOP_BLENDIF_l_in] =clamp_range_f(HSL_input[2], 0.0f, 1.0f); // L scaled to 0..1
-
-        scaled[DEVELOP_BLENDIF_H_out] =clamp_range_f(HSL_output[0], 0.0f, 1.0f); // H scaled to 0..1
-        scaled[DEVELOP_BLENDIF_S_out] =clamp_range_f(HSL_output[1], 0.0f, 1.0f); // S scaled to 0..1
-        scaled[DEVELOP_BLENDIF_l_out] =clamp_range_f(HSL_output[2], 0.0f, 1.0f); // L scaled to 0..1
-      }
-
-      channel_mask = DEVELOP_BLENDIF_RGB_MASK;
+  int conditional;         // the parametric mask is used at all
+  int incl;                // mask_combine & DEVELOP_COMBINE_INCL
+  int need_polar;          // LCh resp. HSL channels are used
+  float constant;          // factor of all channels spanning the whole range (0 or 1)
+  int nchannels;           // number of active channels
+  int channel[DEVELOP_BLENDIF_SIZE];
+  int invert[DEVELOP_BLENDIF_SIZE];
+  float parameters[4 * DEVELOP_BLENDIF_SIZE];
+  float rise[DEVELOP_BLENDIF_SIZE]; // width of the increasing ramp, as used in the division
+  float fall[DEVELOP_BLENDIF_SIZE]; // width of the decreasing ramp
+} _blendif_data_t;
+
+static void _blendif_prepare(_blendif_data_t *bi, const dt_iop_colorspace_type_t cst, const unsigned int blendif,
+                             const float *parameters, const unsigned int mask_mode,
+                             const unsigned int mask_combine)
+{
+  memset(bi, 0, sizeof(*bi));
+  bi->incl = (mask_combine & DEVELOP_COMBINE_INCL) ? 1 : 0;
+  bi->constant = 1.0f;
+  bi->conditional = (mask_mode & DEVELOP_MASK_CONDITIONAL) && (cst == iop_cs_Lab || cst == iop_cs_rgb);
+  if(!bi->conditional) return;
 
-      break;
-    default:
-      return (mask_combine & DEVELOP_COMBINE_INCL) ? 0.0f : 1.0f; // not implemented for other color spaces
-  }
+  const unsigned int channel_mask = (cst == iop_cs_Lab) ? DEVELOP_BLENDIF_Lab_MASK : DEVELOP_BLENDIF_RGB_MASK;
+  bi->need_polar = (blendif & 0x7f00) ? 1 : 0;
+  memcpy(bi->parameters, parameters, sizeof(bi->parameters));
 
   for(int ch = 0; ch <= DEVELOP_BLENDIF_MAX; ch++)
   {
@@ -280,37 +213,118 @@ static inline float _blendif_factor(dt_iop_colorspace_type_t cst, const float *i
 
     if((blendif & (1 << ch)) == 0) // deal with channels where sliders span the whole range
     {
-      result *= !(blendif & (1 << (ch + 16))) == !(mask_combine & DEVELOP_COMBINE_INCL) ? 1.0f : 0.0f;
+      bi->constant *= !(blendif & (1 << (ch + 16))) == !bi->incl ? 1.0f : 0.0f;
       continue;
     }
 
+    const int k = bi->nchannels++;
+    bi->channel[k] = ch;
+    bi->invert[k] = (blendif & (1 << (ch + 16))) != 0;
+    bi->rise[k] = fmaxf(0.01f, parameters[4 * ch + 1] - parameters[4 * ch + 0]);
+    bi->fall[k] = fmaxf(0.01f, parameters[4 * ch + 3] - parameters[4 * ch + 2]);
+  }
+}
+
+static inline void _blendif_scale_Lab(const float *input, const float *output, float *scaled,
+                                      const int need_polar)
+{
+  scaled[DEVELOP_BLENDIF_L_in] =clamp_range_f(input[0]/100.0f, 0.0f, 1.0f); // L scaled to 0..1
+  scaled[DEVELOP_BLENDIF_A_in]
+      =clamp_range_f((input[1]+128.0f)/256.0f, 0.0f, 1.0f); // a scaled to 0..1
+  scaled[DEVELOP_BLENDIF_B_in]
+      =clamp_range_f((input[2]+128.0f)/256.0f, 0.0f, 1.0f);                 // b scaled to 0..1
+  scaled[DEVELOP_BLENDIF_L_out] =clamp_range_f(output[0]/100.0f, 0.0f, 1.0f); // L scaled to 0..1
+  scaled[DEVELOP_BLENDIF_A_out]
+      =clamp_range_f((output[1]+128.0f)/256.0f, 0.0f, 1.0f); // a scaled to 0..1
+  scaled[DEVELOP_BLENDIF_B_out]
+      =clamp_range_f((output[2]+128.0f)/256.0f, 0.0f, 1.0f); // b scaled to 0..1
+
+  if(need_polar) // do we need to consider LCh ?
+  {
+    float LCH_input[3];
+    float LCH_output[3];
+    dt_Lab_2_LCH(input, LCH_input);
+    dt_Lab_2_LCH(output, LCH_output);
+
+    scaled[DEVELOP_BLENDIF_C_in] =clamp_range_f(LCH_input[1]/(128.0f*sqrtf(2.0f)), 0.0f,
+                                                1.0f);                     // C scaled to 0..1
+    scaled[DEVELOP_BLENDIF_h_in] =clamp_range_f(LCH_input[2], 0.0f, 1.0f); // h scaled to 0..1
+
+    scaled[DEVELOP_BLENDIF_C_out] =clamp_range_f(LCH_output[1]/(128.0f*sqrtf(2.0f)), 0.0f,
+                                                 1.0f);                      // C scaled to 0..1
+    scaled[DEVELOP_BLENDIF_h_out] =clamp_range_f(LCH_output[2], 0.0f, 1.0f); // h scaled to 0..1
+  }
+}
+
+static inline float _blendif_gray(const float *pixel, const dt_iop_order_iccprofile_info_t *const work_profile)
+{
+  if(work_profile == NULL)
+    return clamp_range_f(0.3f*pixel[0]+0.59f*pixel[1]+0.11f*pixel[2], 0.0f, 1.0f);
+  else
+    return clamp_range_f(dt_ioppr_get_rgb_matrix_luminance(pixel,
+                                                           work_profile->matrix_in,
+                                                           work_profile->lut_in,
+                                                           work_profile->unbounded_coeffs_in,
+                                                           work_profile->lutsize,
+                                                           work_profile->nonlinearlut), 0.0f, 1.0f);
+}
+
+static inline void _blendif_scale_rgb(const float *input, const float *output, float *scaled,
+                                      const int need_polar, const dt_iop_order_iccprofile_info_t *const work_profile)
+{
+  scaled[DEVELOP_BLENDIF_GRAY_in] = _blendif_gray(input, work_profile);     // Gray scaled to 0..1
+  scaled[DEVELOP_BLENDIF_RED_in] =clamp_range_f(input[0], 0.0f, 1.0f);   // Red
+  scaled[DEVELOP_BLENDIF_GREEN_in] =clamp_range_f(input[1], 0.0f, 1.0f); // Green
+  scaled[DEVELOP_BLENDIF_BLUE_in] =clamp_range_f(input[2], 0.0f, 1.0f);  // Blue
+  scaled[DEVELOP_BLENDIF_GRAY_out] = _blendif_gray(output, work_profile);   // Gray scaled to 0..1
+  scaled[DEVELOP_BLENDIF_RED_out] =clamp_range_f(output[0], 0.0f, 1.0f);   // Red
+  scaled[DEVELOP_BLENDIF_GREEN_out] =clamp_range_f(output[1], 0.0f, 1.0f); // Green
+  scaled[DEVELOP_BLENDIF_BLUE_out] =clamp_range_f(output[2], 0.0f, 1.0f);  // Blue
+
+  if(need_polar) // do we need to consider HSL ?
+  {
+    float HSL_input[3];
+    float HSL_output[3];
+    dt_RGB_2_HSL(input, HSL_input);
+    dt_RGB_2_HSL(output, HSL_output);
+
+    scaled[DEVELOP_BLENDIF_H_in] =clamp_range_f(HSL_input[0], 0.0f, 1.0f); // H scaled to 0..1
+    scaled[DEVELOP_BLENDIF_S_in] =clamp_range_f(HSL_input[1], 0.0f, 1.0f); // S scaled to 0..1
+    scaled[DEVELOP_BLENDIF_l_in] =clamp_range_f(HSL_input[2], 0.0f, 1.0f); // L scaled to 0..1
+
+    scaled[DEVELOP_BLENDIF_H_out] =clamp_range_f(HSL_output[0], 0.0f, 1.0f); // H scaled to 0..1
+    scaled[DEVELOP_BLENDIF_S_out] =clamp_range_f(HSL_output[1], 0.0f, 1.0f); // S scaled to 0..1
+    scaled[DEVELOP_BLENDIF_l_out] =clamp_range_f(HSL_output[2], 0.0f, 1.0f); // L scaled to 0..1
+  }
+}
+
+static inline float _blendif_factor(const _blendif_data_t *const bi, const float *const scaled)
+{
+  float result = bi->constant;
+
+  for(int k = 0; k < bi->nchannels; k++)
+  {
     if(result <= 0.000001f) break; // no need to continue if we are already at or close to zero
 
+    const int ch = bi->channel[k];
+    const float *const p = bi->parameters + 4 * ch;
+    const float x = scaled[ch];
     float factor;
-    if(scaled[ch] >= parameters[4 * ch + 1] && scaled[ch] <= parameters[4 * ch + 2])
-    {
+    if(x >= p[1] && x <= p[2])
       factor = 1.0f;
-    }
-    else if(scaled[ch] > parameters[4 * ch + 0] && scaled[ch] < parameters[4 * ch + 1])
-    {
-      factor
-          = (scaled[ch] - parameters[4 * ch + 0]) / fmaxf(0.01f, parameters[4 * ch + 1] - parameters[4 * ch + 0]);
-    }
-    else if(scaled[ch] > parameters[4 * ch + 2] && scaled[ch] < parameters[4 * ch + 3])
-    {
-      factor = 1.0f
-               - (scaled[ch] - parameters[4 * ch + 2])
-                     / fmaxf(0.01f, parameters[4 * ch + 3] - parameters[4 * ch + 2]);
-    }
+    else if(x > p[0] && x < p[1])
+      factor = (x - p[0]) / bi->rise[k];
+    else if(x > p[2] && x < p[3])
+      factor = 1.0f - (x - p[2]) / bi->fall[k];
     else
       factor = 0.0f;
 
-    if((blendif & (1 << (ch + 16))) != 0) factor = 1.0f - factor; // inverted channel?
+    if(bi->invert[k]) factor = 1.0f - factor; // inverted channel?
 
-    result *= ((mask_combine & DEVELOP_COMBINE_INCL) ? 1.0f - factor : factor);
+    result *= (bi->incl ? 1.0f - factor : factor);
   }
 
-  return (mask_combine & DEVELOP_COMBINE_INCL) ? 1.0f - result : result;
+  return bi->incl ? 1.0f - result : result;
 }
 
 static inline void _blend_colorspace_channel_range(dt_iop_colorspace_type_t cst, float *min, float *max)
@@ -366,24 +380,70 @@ static inline void _blend_noop(const _blend_buffer_desc_t *bd, const float *a, f
 }
 
 
-/* generate blend mask */
-static void _blend_make_mask(const _blend_buffer_desc_t *bd, const unsigned int blendif,
-                             const float *blendif_parameters, const unsigned int mask_mode,
-                             const unsigned int mask_combine, const float gopacity, const float *a, const float *b,
-                             float *mask, const dt_iop_order_iccprofile_info_t *const work_profile)
+/* generate blend mask. the colorspace is a compile time constant in the specializations below, so that
+ * the colorspace dispatch and the unused conversions are folded away from the per pixel loop */
+static inline void _blend_make_mask_cst(const dt_iop_colorspace_type_t cst, const _blend_buffer_desc_t *bd,
+                                        const _blendif_data_t *const bi, const unsigned int mask_combine,
+                                        const float gopacity, const float *a, const float *b, float *mask,
+                                        const dt_iop_order_iccprofile_info_t *const work_profile)
 {
+  const int incl = (mask_combine & DEVELOP_COMBINE_INCL) ? 1 : 0;
+  const int inv = (mask_combine & DEVELOP_COMBINE_INV) ? 1 : 0;
   for(size_t i = 0, j = 0; j < bd->stride; i++, j += bd->ch)
   {
-    float form = mask[i];
-    float conditional = _blendif_factor(bd->cst, &a[j], &b[j], blendif, blendif_parameters, mask_mode,
-                                        mask_combine, work_profile);
-    float opacity = (mask_combine & DEVELOP_COMBINE_INCL) ? 1.0f - (1.0f - form) * (1.0f - conditional)
-                                                          : form * conditional;
-    opacity = (mask_combine & DEVELOP_COMBINE_INV) ? 1.0f - opacity : opacity;
+    const float form = mask[i];
+    float conditional;
+    if(cst == iop_cs_Lab || cst == iop_cs_rgb)
+    {
+      float scaled[DEVELOP_BLENDIF_SIZE] = { 0.5f };
+      if(cst == iop_cs_Lab)
+        _blendif_scale_Lab(&a[j], &b[j], scaled, bi->need_polar);
+      else
+        _blendif_scale_rgb(&a[j], &b[j], scaled, bi->need_polar, work_profile);
+      conditional = _blendif_factor(bi, scaled);
+    }
+    else
+      conditional = incl ? 0.0f : 1.0f;
+    float opacity = incl ? 1.0f - (1.0f - form) * (1.0f - conditional) : form * conditional;
+    opacity = inv ? 1.0f - opacity : opacity;
     mask[i] = opacity * gopacity;
   }
 }
 
+static void _blend_make_mask_Lab(const _blend_buffer_desc_t *bd, const _blendif_data_t *const bi,
+                                 const unsigned int mask_combine, const float gopacity, const float *a,
+                                 const float *b, float *mask, const dt_iop_order_iccprofile_info_t *const work_profile)
+{
+  _blend_make_mask_cst(iop_cs_Lab, bd, bi, mask_combine, gopacity, a, b, mask, work_profile);
+}
+
+static void _blend_make_mask_rgb(const _blend_buffer_desc_t *bd, const _blendif_data_t *const bi,
+                                 const unsigned int mask_combine, const float gopacity, const float *a,
+                                 const float *b, float *mask, const dt_iop_order_iccprofile_info_t *const work_profile)
+{
+  _blend_make_mask_cst(iop_cs_rgb, bd, bi, mask_combine, gopacity, a, b, mask, work_profile);
+}
+
+/* without conditional mask only the drawn mask and the global opacity remain */
+static void _blend_make_mask_none(const _blend_buffer_desc_t *bd, const _blendif_data_t *const bi,
+                                  const unsigned int mask_combine, const float gopacity, const float *a,
+                                  const float *b, float *mask, const dt_iop_order_iccprofile_info_t *const work_profile)
+{
+  _blend_make_mask_cst(iop_cs_NONE, bd, bi, mask_combine, gopacity, a, b, mask, work_profile);
+}
+
+typedef void(_blend_make_mask_func)(const _blend_buffer_desc_t *bd, const _blendif_data_t *const bi,
+                                    const unsigned int mask_combine, const float gopacity, const float *a,
+                                    const float *b, float *mask,
+                                    const dt_iop_order_iccprofile_info_t *const work_profile);
+
+static _blend_make_mask_func *_choose_make_mask_func(const _blendif_data_t *const bi,
+                                                     const dt_iop_colorspace_type_t cst)
+{
+  if(!bi->conditional) return _blend_make_mask_none;
+  return (cst == iop_cs_Lab) ? _blend_make_mask_Lab : _blend_make_mask_rgb;
+}
+
 /* normal blend with clamping */
 static void _blend_normal_bounded(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask)
 {
@@ -2464,6 +2524,196 @@ static void display_channel(const _blend_buffer_desc_t *bd, const float *a, floa
 }
 
 
+/* vectorized rows of the most used modes. the mode, the colorspace and the pixel layout are compile time
+ * constants of _blend_simd_row(), so that each specialization below is a single loop over the pixels of a
+ * row, without any dispatch left in it, which the compiler vectorizes across pixels. the arithmetic is the
+ * one of the generic row functions above. */
+typedef enum _blend_simd_mode_t
+{
+  _BLEND_SIMD_NORMAL_BOUNDED,
+  _BLEND_SIMD_NORMAL_UNBOUNDED,
+  _BLEND_SIMD_LIGHTEN,
+  _BLEND_SIMD_DARKEN,
+  _BLEND_SIMD_MULTIPLY,
+  _BLEND_SIMD_AVERAGE,
+  _BLEND_SIMD_ADD,
+  _BLEND_SIMD_SUBSTRACT,
+  _BLEND_SIMD_SCREEN
+} _blend_simd_mode_t;
+
+// one channel of a mode which blends channel by channel, [min, max] is the range of the channel
+static inline float _blend_simd_channel(const _blend_simd_mode_t mode, const float a, const float b,
+                                        const float o, const float min, const float max)
+{
+  switch(mode)
+  {
+    case _BLEND_SIMD_NORMAL_BOUNDED:
+      return clamp_range_f(a * (1.0f - o) + b * o, min, max);
+    case _BLEND_SIMD_NORMAL_UNBOUNDED:
+      return a * (1.0f - o) + b * o;
+    case _BLEND_SIMD_LIGHTEN:
+      return clamp_range_f(a * (1.0f - o) + fmaxf(a, b) * o, min, max);
+    case _BLEND_SIMD_DARKEN:
+      return clamp_range_f(a * (1.0f - o) + fminf(a, b) * o, min, max);
+    case _BLEND_SIMD_MULTIPLY:
+      return clamp_range_f(a * (1.0f - o) + (a * b) * o, min, max);
+    case _BLEND_SIMD_AVERAGE:
+      return clamp_range_f(a * (1.0f - o) + (a + b) / 2.0f * o, min, max);
+    case _BLEND_SIMD_ADD:
+      return clamp_range_f(a * (1.0f - o) + (a + b) * o, min, max);
+    case _BLEND_SIMD_SUBSTRACT:
+      return clamp_range_f(a * (1.0f - o) + ((b + a) - (fabsf(min + max))) * o, min, max);
+    case _BLEND_SIMD_SCREEN:
+    default:
+    {
+      const float lmax = max + fabsf(min);
+      const float la = clamp_range_f(a + fabsf(min), 0.0f, lmax);
+      const float lb = clamp_range_f(b + fabsf(min), 0.0f, lmax);
+      return clamp_range_f(la * (1.0f - o) + (lmax - (lmax - la) * (lmax - lb)) * o, 0.0f, lmax) - fabsf(min);
+    }
+  }
+}
+
+// one scaled Lab pixel. in lighten, darken, multiply and screen a and b follow the change of lightness.
+static inline void _blend_simd_Lab_pixel(const _blend_simd_mode_t mode, const float *const ta, float *const tb,
+                                         const float o)
+{
+  if(mode == _BLEND_SIMD_LIGHTEN || mode == _BLEND_SIMD_DARKEN)
+  {
+    const float tbo = tb[0];
+    const float l = (mode == _BLEND_SIMD_LIGHTEN) ? (ta[0] > tb[0] ? ta[0] : tb[0])
+                                                  : (ta[0] < tb[0] ? ta[0] : tb[0]);
+    tb[0] = clamp_range_f(ta[0] * (1.0f - o) + l * o, 0.0f, 1.0f);
+    const float d = fabsf(tbo - tb[0]);
+    tb[1] = clamp_range_f(ta[1] * (1.0f - d) + 0.5f * (ta[1] + tb[1]) * d, -1.0f, 1.0f);
+    tb[2] = clamp_range_f(ta[2] * (1.0f - d) + 0.5f * (ta[2] + tb[2]) * d, -1.0f, 1.0f);
+  }
+  else if(mode == _BLEND_SIMD_MULTIPLY || mode == _BLEND_SIMD_SCREEN)
+  {
+    const float la = clamp_range_f(ta[0], 0.0f, 1.0f);
+    const float lb = clamp_range_f(tb[0], 0.0f, 1.0f);
+    const float l = (mode == _BLEND_SIMD_MULTIPLY) ? la * lb : 1.0f - (1.0f - la) * (1.0f - lb);
+    const float f = (mode == _BLEND_SIMD_MULTIPLY) ? 1.0f : 0.5f;
+    const float div = ta[0] > 0.01f ? ta[0] : 0.01f;
+    tb[0] = clamp_range_f(la * (1.0f - o) + l * o, 0.0f, 1.0f);
+    tb[1] = clamp_range_f(ta[1] * (1.0f - o) + f * (ta[1] + tb[1]) * tb[0] / div * o, -1.0f, 1.0f);
+    tb[2] = clamp_range_f(ta[2] * (1.0f - o) + f * (ta[2] + tb[2]) * tb[0] / div * o, -1.0f, 1.0f);
+  }
+  else
+  {
+    tb[0] = _blend_simd_channel(mode, ta[0], tb[0], o, 0.0f, 1.0f);
+    tb[1] = _blend_simd_channel(mode, ta[1], tb[1], o, -1.0f, 1.0f);
+    tb[2] = _blend_simd_channel(mode, ta[2], tb[2], o, -1.0f, 1.0f);
+  }
+}
+
+/* n pixels of ch channels. Lab and rgb come with 4 channels and get the opacity in the alpha channel, raw
+ * with 1 or 4 channels leaves the fourth one alone. Lab rows are vectorized across pixels, an rgb or raw
+ * pixel of 4 channels is blended as one vector. */
+static inline void _blend_simd_row(const _blend_simd_mode_t mode, const dt_iop_colorspace_type_t cst,
+                                   const size_t ch, const size_t n, const float *const restrict a,
+                                   float *const restrict b, const float *const restrict mask)
+{
+  if(cst == iop_cs_Lab)
+  {
+    for(size_t i = 0; i < n; i++)
+    {
+      const size_t j = 4 * i;
+      const float o = mask[i];
+      float ta[3], tb[3];
+      _blend_Lab_scale(&a[j], ta);
+      _blend_Lab_scale(&b[j], tb);
+      _blend_simd_Lab_pixel(mode, ta, tb, o);
+      _blend_Lab_rescale(tb, &b[j]);
+      b[j + 3] = o;
+    }
+  }
+  else if(ch == 1)
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i = 0; i < n; i++) b[i] = _blend_simd_channel(mode, a[i], b[i], mask[i], 0.0f, 1.0f);
+  }
+  else
+  {
+    for(size_t i = 0; i < n; i++)
+    {
+      const float *const restrict pa = a + 4 * i;
+      float *const restrict pb = b + 4 * i;
+      const float o = mask[i];
+      const float alpha = (cst == iop_cs_rgb) ? o : pb[3];
+      if(mode == _BLEND_SIMD_SCREEN)
+      {
+        // clamping the inputs in a loop of their own keeps the compiler from giving up on the nested clamps
+        float la[4], lb[4];
+#ifdef _OPENMP
+#pragma omp simd aligned(pa, pb : 16)
+#endif
+        for(int k = 0; k < 4; k++)
+        {
+          la[k] = clamp_range_f(pa[k] + 0.0f, 0.0f, 1.0f);
+          lb[k] = clamp_range_f(pb[k] + 0.0f, 0.0f, 1.0f);
+        }
+#ifdef _OPENMP
+#pragma omp simd aligned(pb : 16)
+#endif
+        for(int k = 0; k < 4; k++)
+          pb[k] = clamp_range_f(la[k] * (1.0f - o) + (1.0f - (1.0f - la[k]) * (1.0f - lb[k])) * o, 0.0f, 1.0f) - 0.0f;
+      }
+      else
+      {
+#ifdef _OPENMP
+#pragma omp simd aligned(pa, pb : 16)
+#endif
+        for(int k = 0; k < 4; k++) pb[k] = _blend_simd_channel(mode, pa[k], pb[k], o, 0.0f, 1.0f);
+      }
+      pb[3] = alpha;
+    }
+  }
+}
+
+typedef struct _blend_simd_rows_t
+{
+  _blend_row_func *Lab, *rgb, *raw1, *raw4;
+} _blend_simd_rows_t;
+
+#define _BLEND_SIMD_ROWS(name, mode)                                                                              \
+  __DT_CLONE_TARGETS__                                                                                            \
+  static void _blend_##name##_Lab(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask)   \
+  {                                                                                                               \
+    _blend_simd_row(mode, iop_cs_Lab, 4, bd->stride / 4, a, b, mask);                                             \
+  }                                                                                                               \
+  __DT_CLONE_TARGETS__                                                                                            \
+  static void _blend_##name##_rgb(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask)   \
+  {                                                                                                               \
+    _blend_simd_row(mode, iop_cs_rgb, 4, bd->stride / 4, a, b, mask);                                             \
+  }                                                                                                               \
+  __DT_CLONE_TARGETS__                                                                                            \
+  static void _blend_##name##_raw1(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask)  \
+  {                                                                                                               \
+    _blend_simd_row(mode, iop_cs_RAW, 1, bd->stride, a, b, mask);                                                 \
+  }                                                                                                               \
+  __DT_CLONE_TARGETS__                                                                                            \
+  static void _blend_##name##_raw4(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask)  \
+  {                                                                                                               \
+    _blend_simd_row(mode, iop_cs_RAW, 4, bd->stride / 4, a, b, mask);                                             \
+  }                                                                                                               \
+  static const _blend_simd_rows_t _blend_##name##_rows                                                            \
+      = { _blend_##name##_Lab, _blend_##name##_rgb, _blend_##name##_raw1, _blend_##name##_raw4 };
+
+_BLEND_SIMD_ROWS(simd_normal_bounded, _BLEND_SIMD_NORMAL_BOUNDED)
+_BLEND_SIMD_ROWS(simd_normal_unbounded, _BLEND_SIMD_NORMAL_UNBOUNDED)
+_BLEND_SIMD_ROWS(simd_lighten, _BLEND_SIMD_LIGHTEN)
+_BLEND_SIMD_ROWS(simd_darken, _BLEND_SIMD_DARKEN)
+_BLEND_SIMD_ROWS(simd_multiply, _BLEND_SIMD_MULTIPLY)
+_BLEND_SIMD_ROWS(simd_average, _BLEND_SIMD_AVERAGE)
+_BLEND_SIMD_ROWS(simd_add, _BLEND_SIMD_ADD)
+_BLEND_SIMD_ROWS(simd_substract, _BLEND_SIMD_SUBSTRACT)
+_BLEND_SIMD_ROWS(simd_screen, _BLEND_SIMD_SCREEN)
+
+#undef _BLEND_SIMD_ROWS
+
 _blend_row_func *dt_develop_choose_blend_func(const unsigned int blend_mode)
 {
   _blend_row_func *blend = NULL;
@@ -2578,6 +2828,54 @@ _blend_row_func *dt_develop_choose_blend_func(const unsigned int blend_mode)
   return blend;
 }
 
+/* the blend operator for one colorspace and pixel layout: a vectorized row for the common modes, the
+ * generic row function otherwise */
+static _blend_row_func *_choose_blend_func(const unsigned int blend_mode, const dt_iop_colorspace_type_t cst,
+                                           const int ch)
+{
+  const _blend_simd_rows_t *rows = NULL;
+  switch(blend_mode)
+  {
+    case DEVELOP_BLEND_LIGHTEN:
+      rows = &_blend_simd_lighten_rows;
+      break;
+    case DEVELOP_BLEND_DARKEN:
+      rows = &_blend_simd_darken_rows;
+      break;
+    case DEVELOP_BLEND_MULTIPLY:
+      rows = &_blend_simd_multiply_rows;
+      break;
+    case DEVELOP_BLEND_AVERAGE:
+      rows = &_blend_simd_average_rows;
+      break;
+    case DEVELOP_BLEND_ADD:
+      rows = &_blend_simd_add_rows;
+      break;
+    case DEVELOP_BLEND_SUBSTRACT:
+      rows = &_blend_simd_substract_rows;
+      break;
+    case DEVELOP_BLEND_SCREEN:
+      rows = &_blend_simd_screen_rows;
+      break;
+    case DEVELOP_BLEND_NORMAL:
+    case DEVELOP_BLEND_BOUNDED:
+      rows = &_blend_simd_normal_bounded_rows;
+      break;
+    case DEVELOP_BLEND_NORMAL2:
+    case DEVELOP_BLEND_UNBOUNDED:
+      rows = &_blend_simd_normal_unbounded_rows;
+      break;
+    default:
+      break;
+  }
+
+  if(rows && cst == iop_cs_Lab && ch == 4) return rows->Lab;
+  if(rows && cst == iop_cs_rgb && ch == 4) return rows->rgb;
+  if(rows && cst == iop_cs_RAW && ch == 1) return rows->raw1;
+  if(rows && cst == iop_cs_RAW && ch == 4) return rows->raw4;
+  return dt_develop_choose_blend_func(blend_mode);
+}
+
 void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                               const void *const ivoid, void *const ovoid, const struct dt_iop_roi_t *const roi_in,
                               const struct dt_iop_roi_t *const roi_out)
@@ -2643,6 +2941,17 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
   // get the clipped opacity value  0 - 1
   const float opacity = fminf(fmaxf(0.0f, (d->opacity / 100.0f)), 1.0f);
 
+  // a drawn and/or parametric mask which doesn't need to be post-processed as a whole buffer is generated
+  // row by row inside the blending loop below, while the pixels are still in cache.
+  const _Bool mask_parametric = !(mask_mode == DEVELOP_MASK_ENABLED || suppress_mask)
+                                && !(mask_mode & DEVELOP_MASK_RASTER);
+  const _Bool mask_fused = mask_parametric && !mask_feather && !mask_blur && !mask_tone_curve;
+  _blendif_data_t blendif_data;
+  _blendif_prepare(&blendif_data, cst, d->blendif, d->blendif_parameters, d->mask_mode, d->mask_combine);
+  const _blendif_data_t *const bi = &blendif_data;
+  _blend_make_mask_func *const make_mask = _choose_make_mask_func(bi, cst);
+  const unsigned int mask_combine = d->mask_combine;
+
   // allocate space for blend mask
   float *_mask = dt_alloc_align(64, buffsize * sizeof(float));
   if(!_mask)
@@ -2742,22 +3051,24 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
       for(size_t i = 0; i < buffsize; i++) mask[i] = fill;
     }
 
-    // get parametric mask (if any) and apply global opacity
+    // get parametric mask (if any) and apply global opacity, unless done in the blending loop
+    if(!mask_fused)
+    {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-    dt_omp_firstprivate(bch, ch, cst, d, oheight, opacity, ivoid, iwidth, \
-                        mask, owidth, ovoid, work_profile, xoffs, yoffs)
+      dt_omp_firstprivate(bch, bi, ch, cst, make_mask, mask_combine, oheight, opacity, ivoid, iwidth, \
+                          mask, owidth, ovoid, work_profile, xoffs, yoffs)
 #endif
-    for(size_t y = 0; y < oheight; y++)
-    {
-      size_t iindex = ((y + yoffs) * iwidth + xoffs) * ch;
-      size_t oindex = y * owidth * ch;
-      _blend_buffer_desc_t bd = { .cst = cst, .stride = (size_t)owidth * ch, .ch = ch, .bch = bch };
-      float *in = (float *)ivoid + iindex;
-      float *out = (float *)ovoid + oindex;
-      float *m = mask + y * owidth;
-      _blend_make_mask(&bd, d->blendif, d->blendif_parameters, d->mask_mode, d->mask_combine, opacity, in, out, m,
-                       work_profile);
+      for(size_t y = 0; y < oheight; y++)
+      {
+        size_t iindex = ((y + yoffs) * iwidth + xoffs) * ch;
+        size_t oindex = y * owidth * ch;
+        _blend_buffer_desc_t bd = { .cst = cst, .stride = (size_t)owidth * ch, .ch = ch, .bch = bch };
+        float *in = (float *)ivoid + iindex;
+        float *out = (float *)ovoid + oindex;
+        float *m = mask + y * owidth;
+        make_mask(&bd, bi, mask_combine, opacity, in, out, m, work_profile);
+      }
     }
 
     if(mask_feather)
@@ -2847,11 +3158,11 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
 
   // now apply blending with per-pixel opacity value as defined in mask
   // select the blend operator
-  _blend_row_func *const blend = dt_develop_choose_blend_func(d->blend_mode);
+  _blend_row_func *const blend = _choose_blend_func(d->blend_mode, cst, ch);
 #ifdef _OPENMP
 #pragma omp parallel for default(none)                                                                            \
-  dt_omp_firstprivate(bch, blend, ch, cst, ivoid, iwidth, mask, \
-                      mask_display, oheight, ovoid, owidth, \
+  dt_omp_firstprivate(bch, bi, blend, ch, cst, ivoid, iwidth, make_mask, mask, mask_combine, mask_fused, \
+                      mask_display, oheight, opacity, ovoid, owidth, \
                         request_mask_display, work_profile, xoffs, yoffs)
 #endif
   for(size_t y = 0; y < oheight; y++)
@@ -2863,6 +3174,8 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
     float *out = (float *)ovoid + oindex;
     float *m = mask + y * owidth;
 
+    if(mask_fused) make_mask(&bd, bi, mask_combine, opacity, in, out, m, work_profile);
+
     if(request_mask_display & DT_DEV_PIXELPIPE_DISPLAY_ANY)
       display_channel(&bd, in, out, m, request_mask_display, work_profile);
     else
@@ -46,6 +46,8 @@
 #define DT_DEV_AVERAGE_DELAY_START 250
 #define DT_DEV_PREVIEW_AVERAGE_DELAY_START 50
 #define DT_DEV_AVERAGE_DELAY_COUNT 5
+// full pipe runs slower than this (in ms) get a coarse pass first when progressive rendering is on
+#define DT_DEV_PROGRESSIVE_DELAY 100
 #define DT_IOP_ORDER_INFO (darktable.unmuted & DT_DEBUG_IOPORDER)
 
 const gchar *dt_dev_histogram_type_names[DT_DEV_HISTOGRAM_N] = { "logarithmic", "linear", "waveform" };
@@ -83,6 +85,13 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
   dev->histogram = NULL;
   dev->histogram_pre_tonecurve = NULL;
   dev->histogram_pre_levels = NULL;
+  dt_pthread_mutex_init(&dev->histogram_async.lock, NULL);
+  dev->histogram_async.pending = NULL;
+  dev->histogram_async.queued = FALSE;
+  dev->histogram_async.converted = NULL;
+  dev->histogram_async.converted_size = 0;
+  dev->histogram_async.bins = NULL;
+  dev->histogram_async.waveform_tmp = NULL;
   gchar *mode = dt_conf_get_string("plugins/darkroom/histogram/mode");
   if(g_strcmp0(mode, "linear") == 0)
     dev->histogram_type = DT_DEV_HISTOGRAM_LINEAR;
@@ -92,6 +101,9 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
     dev->histogram_type = DT_DEV_HISTOGRAM_WAVEFORM;
   g_free(mode);
 
+  dev->prefetch_direction = 0;
+  dev->prefetch_generation = 0;
+
   dev->forms = NULL;
   dev->form_visible = NULL;
   dev->form_gui = NULL;
@@ -127,6 +139,8 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
     dev->histogram_waveform_height = 175;
     dev->histogram_waveform_stride = 4 * dev->histogram_waveform_width;
     dev->histogram_waveform = (uint8_t *)calloc(dev->histogram_waveform_height * dev->histogram_waveform_stride, sizeof(uint8_t));
+    dev->histogram_async.bins = (uint32_t *)calloc(4 * 256, sizeof(uint32_t));
+    dev->histogram_async.waveform_tmp = (uint8_t *)calloc(dev->histogram_waveform_height * dev->histogram_waveform_stride, sizeof(uint8_t));
   }
 
   dev->iop_instance = 0;
@@ -210,6 +224,12 @@ void dt_dev_cleanup(dt_develop_t *dev)
   free(dev->histogram_pre_tonecurve);
   free(dev->histogram_pre_levels);
   free(dev->histogram_waveform);
+  // the control threads are gone by now, so no histogram job can still hold these
+  dt_pthread_mutex_destroy(&dev->histogram_async.lock);
+  dt_free_align(dev->histogram_async.pending);
+  dt_free_align(dev->histogram_async.converted);
+  free(dev->histogram_async.bins);
+  free(dev->histogram_async.waveform_tmp);
 
   g_list_free_full(dev->forms, (void (*)(void *))dt_masks_free_form);
   g_list_free_full(dev->allforms, (void (*)(void *))dt_masks_free_form);
@@ -489,6 +509,22 @@ restart:
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_PREVIEW2_PIPE_FINISHED);
 }
 
+// how much smaller than the displayed scale a coarse pass should be rendered, 1 for none.
+// only worth it while interacting with a pipe that is known to be slow.
+static int _dev_progressive_coarse(const dt_develop_t *dev, const dt_dev_pixelpipe_change_t pipe_changed,
+                                   const int wd, const int ht)
+{
+  if(!dev->gui_attached || dev->image_loading || pipe_changed == DT_DEV_PIPE_UNCHANGED) return 1;
+  if(dev->average_delay <= DT_DEV_PROGRESSIVE_DELAY) return 1;
+  if(!dt_conf_get_bool("darkroom/ui/progressive_rendering")) return 1;
+
+  // aim for a coarse pass that is about as fast as the threshold, cost goes with the area
+  const int coarse = dev->average_delay > 4 * DT_DEV_PROGRESSIVE_DELAY ? 4 : 2;
+  // not worth it for tiny views
+  if(MIN(wd, ht) / coarse < 64) return 1;
+  return coarse;
+}
+
 void dt_dev_process_image_job(dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&dev->pipe_mutex);
@@ -590,6 +626,38 @@ restart:
   x = MAX(0, scale * dev->pipe->processed_width  * (.5 + zoom_x) - wd / 2);
   y = MAX(0, scale * dev->pipe->processed_height * (.5 + zoom_y) - ht / 2);
 
+  // progressive rendering: publish a coarse version of the same view first, the gui upscales it
+  // until the full resolution run below replaces it.
+  const int coarse = _dev_progressive_coarse(dev, pipe_changed, wd, ht);
+  if(coarse > 1)
+  {
+    dt_get_times(&start);
+    dev->pipe->coarse = coarse;
+    const int err = dt_dev_pixelpipe_process(dev->pipe, dev, x / coarse, y / coarse, (wd + coarse - 1) / coarse,
+                                             (ht + coarse - 1) / coarse, scale / coarse);
+    dev->pipe->coarse = 1;
+    if(err)
+    {
+      if(dev->image_force_reload)
+      {
+        dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+        dt_control_log_busy_leave();
+        dev->image_status = DT_DEV_PIXELPIPE_INVALID;
+        dt_pthread_mutex_unlock(&dev->pipe_mutex);
+        return;
+      }
+      else
+        goto restart;
+    }
+    dt_show_times(&start, "[dev_process_image] coarse pixel pipeline processing");
+    if(dev->pipe->changed != DT_DEV_PIPE_UNCHANGED) goto restart;
+
+    dev->pipe->backbuf_scale = scale;
+    dev->pipe->backbuf_zoom_x = zoom_x;
+    dev->pipe->backbuf_zoom_y = zoom_y;
+    dt_control_queue_redraw_center();
+  }
+
   dt_get_times(&start);
   if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale))
   {
@@ -183,6 +183,27 @@ typedef struct dt_develop_t
   uint8_t *histogram_waveform;
   uint32_t histogram_waveform_width, histogram_waveform_height, histogram_waveform_stride;
   dt_dev_histogram_type_t histogram_type;
+  // histogram and waveform are binned by a background job from a subsampled copy of the preview
+  // pipe's gamma input. histogram, histogram_max and histogram_waveform* above are published under
+  // histogram_async.lock, readers have to take it too.
+  struct
+  {
+    dt_pthread_mutex_t lock;
+    // latest buffer handed over by the preview pipe, NULL if nothing is pending. owned by the job
+    // once taken, a newer buffer replaces an older one that was not picked up yet.
+    float *pending;
+    int width, height;
+    int crop_x, crop_y, crop_width, crop_height;
+    gboolean waveform;
+    const struct dt_iop_order_iccprofile_info_t *profile_from, *profile_to;
+    // a job is queued or running and will pick up pending
+    gboolean queued;
+    // scratch kept across runs, only touched by the job
+    float *converted;
+    size_t converted_size;
+    uint32_t *bins;
+    uint8_t *waveform_tmp;
+  } histogram_async;
 
   // list of forms iop can use for masks or whatever
   GList *forms;
@@ -191,6 +212,11 @@ typedef struct dt_develop_t
   // all forms to be linked here for cleanup:
   GList *allforms;
 
+  // speculative loading of the neighbours in the filmstrip: direction of the last navigation step
+  // (+1/-1, 0 if unknown) and a generation counter that invalidates queued prefetches when it changes.
+  int prefetch_direction;
+  gint prefetch_generation;
+
   //full preview stuff
   int full_preview;
   int full_preview_last_zoom, full_preview_last_closeup;
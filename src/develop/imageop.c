@@ -23,6 +23,7 @@
 #include "common/debug.h"
 #include "common/exif.h"
 #include "common/dtpthread.h"
+#include "common/file_location.h"
 #include "common/imageio_rawspeed.h"
 #include "common/interpolation.h"
 #include "common/iop_group.h"
@@ -50,6 +51,7 @@
 #endif
 
 #include <assert.h>
+#include <glib/gstdio.h>
 #include <gmodule.h>
 #include <math.h>
 #include <stdlib.h>
@@ -328,6 +330,8 @@ int dt_iop_load_module_so(void *m, const char *libname, const char *op)
     module->distort_backtransform = default_distort_backtransform;
   if(!g_module_symbol(module->module, "distort_mask", (gpointer) & (module->distort_mask)))
     module->distort_mask = NULL;
+  if(!g_module_symbol(module->module, "fuse_raw_frontend", (gpointer) & (module->fuse_raw_frontend)))
+    module->fuse_raw_frontend = NULL;
 
   if(!g_module_symbol(module->module, "modify_roi_in", (gpointer) & (module->modify_roi_in)))
     module->modify_roi_in = dt_iop_modify_roi_in;
@@ -456,6 +460,7 @@ int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt
   module->distort_transform = so->distort_transform;
   module->distort_backtransform = so->distort_backtransform;
   module->distort_mask = so->distort_mask;
+  module->fuse_raw_frontend = so->fuse_raw_frontend;
   module->modify_roi_in = so->modify_roi_in;
   module->modify_roi_out = so->modify_roi_out;
   module->legacy_params = so->legacy_params;
@@ -1444,10 +1449,128 @@ static void dt_iop_init_module_so(void *m)
   }
 }
 
-void dt_iop_load_modules_so(void)
+// the presets snapshot is only good for the very same modules, parameter versions and darktable,
+// and for the language the preset names got translated to
+static gchar *_presets_snapshot_key(void)
 {
+  GString *key = g_string_new(darktable_package_version);
+  g_string_append_printf(key, " blendop %d", dt_develop_blend_version());
+  for(const gchar *const *language = g_get_language_names(); *language; language++)
+    g_string_append_printf(key, " %s", *language);
+  // the settings the modules' init_presets() look at when creating their presets
+  const char *confs[] = { "plugins/darkroom/sharpen/auto_apply", "plugins/darkroom/basecurve/auto_apply",
+                          "plugins/darkroom/basecurve/auto_apply_percamera_presets" };
+  for(size_t k = 0; k < G_N_ELEMENTS(confs); k++)
+    g_string_append_printf(key, " %s=%d", confs[k], dt_conf_get_bool(confs[k]));
+  for(const GList *iop = darktable.iop; iop; iop = g_list_next(iop))
+  {
+    dt_iop_module_so_t *module = (dt_iop_module_so_t *)iop->data;
+    g_string_append_printf(key, " %s %d", module->op, module->version());
+  }
+  gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key->str, -1);
+  g_string_free(key, TRUE);
+  return checksum;
+}
+
+static void _presets_snapshot_path(char *path, const size_t bufsize)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(path, bufsize, "%s/presets_snapshot.db", cachedir);
+}
+
+// copies the presets of the last run into the empty presets table, if they match key
+static gboolean _presets_snapshot_restore(const char *key)
+{
+  char path[PATH_MAX] = { 0 };
+  _presets_snapshot_path(path, sizeof(path));
+  if(!g_file_test(path, G_FILE_TEST_IS_REGULAR)) return FALSE;
+
+  sqlite3 *db = dt_database_get(darktable.db);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "ATTACH DATABASE ?1 AS snapshot", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, path, -1, SQLITE_TRANSIENT);
+  const gboolean attached = (sqlite3_step(stmt) == SQLITE_DONE);
+  sqlite3_finalize(stmt);
+  if(!attached) return FALSE;
+
+  gboolean restored = FALSE;
+  // a broken or foreign file fails to prepare, that just means taking the slow path
+  if(sqlite3_prepare_v2(db, "SELECT 1 FROM snapshot.meta WHERE key = ?1", -1, &stmt, NULL) == SQLITE_OK)
+  {
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, key, -1, SQLITE_TRANSIENT);
+    const gboolean valid = (sqlite3_step(stmt) == SQLITE_ROW);
+    sqlite3_finalize(stmt);
+    restored = valid
+               && sqlite3_exec(db, "INSERT INTO data.presets SELECT * FROM snapshot.presets", NULL, NULL, NULL)
+                      == SQLITE_OK;
+  }
+  sqlite3_exec(db, "DETACH DATABASE snapshot", NULL, NULL, NULL);
+  return restored;
+}
+
+// writes the presets all modules just created for the next run. other instances might be doing
+// the same, so the snapshot is written aside and renamed into place.
+static void _presets_snapshot_store(const char *key)
+{
+  char path[PATH_MAX] = { 0 };
+  _presets_snapshot_path(path, sizeof(path));
+  gchar *tmp = g_strdup_printf("%s.%08x", path, g_random_int());
+  g_unlink(tmp);
+
+  sqlite3 *db = dt_database_get(darktable.db);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "ATTACH DATABASE ?1 AS snapshot", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, tmp, -1, SQLITE_TRANSIENT);
+  const gboolean attached = (sqlite3_step(stmt) == SQLITE_DONE);
+  sqlite3_finalize(stmt);
+  if(!attached)
+  {
+    g_free(tmp);
+    return;
+  }
+
+  gboolean stored = sqlite3_exec(db, "CREATE TABLE snapshot.meta (key VARCHAR)", NULL, NULL, NULL) == SQLITE_OK
+                    && sqlite3_exec(db, "CREATE TABLE snapshot.presets AS SELECT * FROM data.presets", NULL, NULL,
+                                    NULL) == SQLITE_OK;
+  if(stored)
+  {
+    DT_DEBUG_SQLITE3_PREPARE_V2(db, "INSERT INTO snapshot.meta (key) VALUES (?1)", -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, key, -1, SQLITE_TRANSIENT);
+    stored = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+  }
+  sqlite3_exec(db, "DETACH DATABASE snapshot", NULL, NULL, NULL);
+
+  if(!stored || g_rename(tmp, path)) g_unlink(tmp);
+  g_free(tmp);
+}
+
+void dt_iop_load_modules_so(const gboolean presets_snapshot)
+{
+  if(!presets_snapshot)
+  {
+    darktable.iop = dt_module_load_modules("/plugins", sizeof(dt_iop_module_so_t), dt_iop_load_module_so,
+                                           dt_iop_init_module_so, NULL);
+    return;
+  }
+
+  // headless instances on a throw-away presets table: every module writing its presets and
+  // upgrading the legacy ones is the same work on each run, so restore the outcome of the
+  // last run instead.
   darktable.iop = dt_module_load_modules("/plugins", sizeof(dt_iop_module_so_t), dt_iop_load_module_so,
-                                         dt_iop_init_module_so, NULL);
+                                         NULL, NULL);
+  gchar *key = _presets_snapshot_key();
+  if(_presets_snapshot_restore(key))
+  {
+    dt_print(DT_DEBUG_PERF, "[iop] restored the presets from the snapshot\n");
+  }
+  else
+  {
+    for(GList *iop = darktable.iop; iop; iop = g_list_next(iop)) dt_iop_init_module_so(iop->data);
+    _presets_snapshot_store(key);
+  }
+  g_free(key);
 }
 
 int dt_iop_load_module(dt_iop_module_t *module, dt_iop_module_so_t *module_so, dt_develop_t *dev)
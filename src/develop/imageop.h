@@ -32,6 +32,18 @@ typedef struct dt_iop_roi_t
   float scale;
 } dt_iop_roi_t;
 
+/** per-photosite arithmetic of the point-wise raw modules, collected through fuse_raw_frontend()
+ * so the pipe can run them as a single pass over the mosaic. the tables are indexed by
+ * [row % 6][col % 6] of the output buffer, which covers the bayer and the x-trans pattern. */
+typedef struct dt_iop_raw_frontend_t
+{
+  int csx, csy; // crop offset into the input buffer
+  float sub[6][6];
+  float div[6][6];
+  float mul[6][6];
+  float clip;
+} dt_iop_raw_frontend_t;
+
 #include "common/darktable.h"
 #include "common/introspection.h"
 #include "common/opencl.h"
@@ -272,6 +284,10 @@ typedef struct dt_iop_module_so_t
   void (*distort_mask)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                        float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out);
 
+  int (*fuse_raw_frontend)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                           dt_iop_raw_frontend_t *fe, struct dt_iop_buffer_dsc_t *dsc,
+                           const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out);
+
   // introspection related callbacks
   gboolean have_introspection;
   dt_introspection_t *(*get_introspection)(void);
@@ -526,6 +542,10 @@ typedef struct dt_iop_module_t
   /** apply the image distortion to a single channel float buffer. only needed by iops that distort the image */
   void (*distort_mask)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                        float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out);
+  /** fold the per-pixel work on the raw mosaic into the fused raw front-end, see iop_api.h */
+  int (*fuse_raw_frontend)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                           dt_iop_raw_frontend_t *fe, struct dt_iop_buffer_dsc_t *dsc,
+                           const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out);
 
   /** Key accelerator registration callbacks */
   void (*connect_key_accels)(struct dt_iop_module_t *self);
@@ -542,8 +562,10 @@ typedef struct dt_iop_module_t
 
 } dt_iop_module_t;
 
-/** loads and inits the modules in the plugins/ directory. */
-void dt_iop_load_modules_so(void);
+/** loads and inits the modules in the plugins/ directory. with presets_snapshot, the presets are restored
+ * from the snapshot of a previous run with the same modules, or one is taken. only for an empty presets
+ * table which is thrown away at exit. */
+void dt_iop_load_modules_so(const gboolean presets_snapshot);
 /** cleans up the dlopen refs. */
 void dt_iop_unload_modules_so(void);
 /** load a module for a given .so */
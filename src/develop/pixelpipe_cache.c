@@ -122,6 +122,19 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_
   return hash;
 }
 
+uint64_t dt_dev_pixelpipe_cache_hash_input(dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi_in)
+{
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  uint64_t hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, roi_in, pipe, g_list_index(pipe->nodes, piece));
+  // the preview pipe runs on a downscaled copy, so the same roi does not mean the same pixels
+  const int dim[2] = { pipe->iwidth, pipe->iheight };
+  const char *str = (const char *)dim;
+  for(size_t i = 0; i < sizeof(dim); i++) hash = ((hash << 5) + hash) ^ str[i];
+  str = (const char *)&pipe->iscale;
+  for(size_t i = 0; i < sizeof(float); i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
 {
   // search for hash in cache
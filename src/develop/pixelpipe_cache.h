@@ -21,6 +21,7 @@
 #include <inttypes.h>
 
 struct dt_dev_pixelpipe_t;
+struct dt_dev_pixelpipe_iop_t;
 struct dt_iop_buffer_dsc_t;
 struct dt_iop_roi_t;
 
@@ -55,6 +56,9 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache);
 /** creates a hopefully unique hash from the complete module stack up to the module-th. */
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const struct dt_iop_roi_t *roi,
                                      struct dt_dev_pixelpipe_t *pipe, int module);
+/** hash of the input buffer of piece for roi_in, also telling apart pipes fed from different sized
+ * buffers. for modules keeping data derived from their input around across runs. */
+uint64_t dt_dev_pixelpipe_cache_hash_input(struct dt_dev_pixelpipe_iop_t *piece, const struct dt_iop_roi_t *roi_in);
 
 /** returns the float data buffer for the given hash from the cache. if the hash does not match any
   * cache line, the least recently used cache line will be cleared and an empty buffer is returned
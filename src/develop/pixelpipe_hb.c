@@ -17,12 +17,14 @@
     You should have received a copy of the GNU General Public License
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include "common/bilateral.h"
 #include "common/color_picker.h"
 #include "common/colorspaces.h"
 #include "common/histogram.h"
 #include "common/imageio.h"
 #include "common/opencl.h"
 #include "common/iop_order.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include "control/signal.h"
 #include "develop/blend.h"
@@ -154,6 +156,8 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->nodes = NULL;
   pipe->backbuf_size = size;
   if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
+  // only the darkroom center view renders coarse runs, don't know their size either
+  if(!dt_dev_pixelpipe_cache_init(&(pipe->coarse_cache), entries, 0)) return 0;
   pipe->cache_obsolete = 0;
   pipe->backbuf = NULL;
   pipe->backbuf_scale = 0.f;
@@ -164,6 +168,8 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->output_backbuf_width = 0;
   pipe->output_backbuf_height = 0;
   pipe->output_imgid = 0;
+  pipe->coarse = 1;
+  pipe->output_backbuf_coarse = 1;
 
   pipe->processing = 0;
   pipe->shutdown = 0;
@@ -182,6 +188,7 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->iop_order_list = NULL;
   pipe->forms = NULL;
   pipe->store_all_raster_masks = FALSE;
+  pipe->fuse_raw_frontend = dt_conf_get_bool("pixelpipe_fuse_raw_frontend");
 
   return 1;
 }
@@ -214,6 +221,8 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   dt_dev_pixelpipe_cleanup_nodes(pipe);
   // so now it's safe to clean up cache:
   dt_dev_pixelpipe_cache_cleanup(&(pipe->cache));
+  dt_dev_pixelpipe_cache_cleanup(&(pipe->coarse_cache));
+  dt_bilateral_cache_drop(pipe);
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
   dt_pthread_mutex_destroy(&(pipe->backbuf_mutex));
   dt_pthread_mutex_destroy(&(pipe->busy_mutex));
@@ -913,93 +922,29 @@ static void _pixelpipe_pick_primary_colorpicker(dt_develop_t *dev, const float *
   if(xform_rgb2rgb) cmsDeleteTransform(xform_rgb2rgb);
 }
 
-static void _pixelpipe_final_histogram(dt_develop_t *dev, const float *const input, const dt_iop_roi_t *roi_in)
+// bins a buffer already converted to the histogram profile, returns the max over the rgb channels
+static uint32_t _pixelpipe_final_histogram(const float *const input, const dt_histogram_roi_t *const histogram_roi,
+                                           uint32_t **histogram)
 {
-  float *img_tmp = NULL;
-
   dt_dev_histogram_collection_params_t histogram_params = { 0 };
   const dt_iop_colorspace_type_t cst = iop_cs_rgb;
   dt_dev_histogram_stats_t histogram_stats = { .bins_count = 256, .ch = 4, .pixels = 0 };
   uint32_t histogram_max[4] = { 0 };
-  dt_histogram_roi_t histogram_roi = { .width = roi_in->width, .height = roi_in->height,
-                                      .crop_x = 0, .crop_y = 0, .crop_width = 0, .crop_height = 0 };
-
-  // Constraining the area if the colorpicker is active in area mode
-  if(dev->gui_module && !strcmp(dev->gui_module->op, "colorout")
-     && dev->gui_module->request_color_pick != DT_REQUEST_COLORPICK_OFF
-     && darktable.lib->proxy.colorpicker.restrict_histogram)
-  {
-    if(darktable.lib->proxy.colorpicker.size == DT_COLORPICKER_SIZE_BOX)
-    {
-      histogram_roi.crop_x = MIN(roi_in->width, MAX(0, dev->gui_module->color_picker_box[0] * roi_in->width));
-      histogram_roi.crop_y = MIN(roi_in->height, MAX(0, dev->gui_module->color_picker_box[1] * roi_in->height));
-      histogram_roi.crop_width = roi_in->width - MIN(roi_in->width, MAX(0, dev->gui_module->color_picker_box[2] * roi_in->width));
-      histogram_roi.crop_height = roi_in->height - MIN(roi_in->height, MAX(0, dev->gui_module->color_picker_box[3] * roi_in->height));
-    }
-    else
-    {
-      histogram_roi.crop_x = MIN(roi_in->width, MAX(0, dev->gui_module->color_picker_point[0] * roi_in->width));
-      histogram_roi.crop_y = MIN(roi_in->height, MAX(0, dev->gui_module->color_picker_point[1] * roi_in->height));
-      histogram_roi.crop_width = roi_in->width - MIN(roi_in->width, MAX(0, dev->gui_module->color_picker_point[0] * roi_in->width));
-      histogram_roi.crop_height = roi_in->height - MIN(roi_in->height, MAX(0, dev->gui_module->color_picker_point[1] * roi_in->height));
-    }
-  }
-
-  dt_colorspaces_color_profile_type_t histogram_type = DT_COLORSPACE_SRGB;
-  gchar *histogram_filename = NULL;
-  gchar _histogram_filename[1] = { 0 };
-
-  dt_ioppr_get_histogram_profile_type(&histogram_type, &histogram_filename);
-  if(histogram_filename == NULL) histogram_filename = _histogram_filename;
-
-  if((histogram_type != darktable.color_profiles->display_type)
-     || (histogram_type == DT_COLORSPACE_FILE
-         && strcmp(histogram_filename, darktable.color_profiles->display_filename)))
-  {
-    img_tmp = dt_alloc_align(64, roi_in->width * roi_in->height * 4 * sizeof(float));
-
-    const dt_iop_order_iccprofile_info_t *const profile_info_from
-        = dt_ioppr_add_profile_info_to_list(dev, darktable.color_profiles->display_type,
-                                            darktable.color_profiles->display_filename, INTENT_PERCEPTUAL);
-    const dt_iop_order_iccprofile_info_t *const profile_info_to
-        = dt_ioppr_add_profile_info_to_list(dev, histogram_type, histogram_filename, INTENT_PERCEPTUAL);
 
-    dt_ioppr_transform_image_colorspace_rgb(input, img_tmp, roi_in->width, roi_in->height, profile_info_from,
-                                            profile_info_to, "final histogram");
-  }
-
-  dt_times_t start_time = { 0 };
-  if(darktable.unmuted & DT_DEBUG_PERF) dt_get_times(&start_time);
-
-  dev->histogram_max = 0;
-  memset(dev->histogram, 0, sizeof(uint32_t) * 4 * 256);
-
-  histogram_params.roi = &histogram_roi;
+  histogram_params.roi = histogram_roi;
   histogram_params.bins_count = 256;
   histogram_params.mul = histogram_params.bins_count - 1;
 
-  dt_histogram_helper(&histogram_params, &histogram_stats, cst, iop_cs_NONE, (img_tmp) ? img_tmp: input, &dev->histogram, FALSE, NULL);
-  dt_histogram_max_helper(&histogram_stats, cst, iop_cs_NONE, &dev->histogram, histogram_max);
-  dev->histogram_max = MAX(MAX(histogram_max[0], histogram_max[1]), histogram_max[2]);
-
-  if(img_tmp) dt_free_align(img_tmp);
-
-  if(darktable.unmuted & DT_DEBUG_PERF)
-  {
-    dt_times_t end_time = { 0 };
-    dt_get_times(&end_time);
-    fprintf(stderr, "final histogram took %.3f secs (%.3f CPU)\n", end_time.clock - start_time.clock, end_time.user - start_time.user);
-  }
+  dt_histogram_helper(&histogram_params, &histogram_stats, cst, iop_cs_NONE, input, histogram, FALSE, NULL);
+  dt_histogram_max_helper(&histogram_stats, cst, iop_cs_NONE, histogram, histogram_max);
+  return MAX(MAX(histogram_max[0], histogram_max[1]), histogram_max[2]);
 }
 
-static void _pixelpipe_final_histogram_waveform(dt_develop_t *dev, const float *const input, const dt_iop_roi_t *roi_in)
+// renders the waveform into the given buffer, returns the number of columns used
+static int _pixelpipe_final_histogram_waveform(const float *const input, const dt_iop_roi_t *roi_in,
+                                               const int waveform_height, const int waveform_stride,
+                                               uint8_t *const waveform)
 {
-  dt_times_t start_time = { 0 };
-  if(darktable.unmuted & DT_DEBUG_PERF) dt_get_times(&start_time);
-
-  const int waveform_height = dev->histogram_waveform_height;
-  const int waveform_stride = dev->histogram_waveform_stride;
-  uint8_t *const waveform = dev->histogram_waveform;
   // Use integral sized bins for columns, as otherwise they will be
   // unequal and have banding. Rely on GUI to smoothly do horizontal
   // scaling.
@@ -1008,14 +953,13 @@ static void _pixelpipe_final_histogram_waveform(dt_develop_t *dev, const float *
   // width and # of bins.
   const int bin_width = ceilf((float)(roi_in->width) / (float)(waveform_stride/4));
   const int waveform_width = ceilf(roi_in->width / (float)bin_width);
-  dev->histogram_waveform_width = waveform_width;
 
   // max input size should be 1440x900, and with a bin_width of 1,
   // that makes a maximum possible count of 900 in buf, while even if
   // waveform buffer is 128 (about smallest possible), bin_width is
   // 12, making max count of 10,800, still much smaller than uint16_t
   uint16_t *buf = (uint16_t *)calloc(waveform_width * waveform_height * 3, sizeof(uint16_t));
-  memset(dev->histogram_waveform, 0, sizeof(uint8_t) * waveform_height * waveform_stride);
+  memset(waveform, 0, sizeof(uint8_t) * waveform_height * waveform_stride);
 
   // 1.0 is at 8/9 of the height!
   const double _height = (double)(waveform_height - 1);
@@ -1100,12 +1044,216 @@ static void _pixelpipe_final_histogram_waveform(dt_develop_t *dev, const float *
   free(cache);
   free(buf);
 
-  if(darktable.unmuted & DT_DEBUG_PERF)
+  return waveform_width;
+}
+
+static void _pixelpipe_final_histogram_job_state(dt_job_t *job, dt_job_state_t state)
+{
+  // a job pushed out of the queue never runs, let the next preview run queue a fresh one
+  if(state != DT_JOB_STATE_DISCARDED) return;
+  dt_develop_t *dev = (dt_develop_t *)dt_control_job_get_params(job);
+  dt_pthread_mutex_lock(&dev->histogram_async.lock);
+  dev->histogram_async.queued = FALSE;
+  dt_pthread_mutex_unlock(&dev->histogram_async.lock);
+}
+
+static int32_t _pixelpipe_final_histogram_job_run(dt_job_t *job)
+{
+  dt_develop_t *dev = (dt_develop_t *)dt_control_job_get_params(job);
+
+  // keep going as long as the preview pipe hands over new buffers, older ones are dropped on the way
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&dev->histogram_async.lock);
+    float *const input = dev->histogram_async.pending;
+    if(!input)
+    {
+      dev->histogram_async.queued = FALSE;
+      dt_pthread_mutex_unlock(&dev->histogram_async.lock);
+      break;
+    }
+    dev->histogram_async.pending = NULL;
+    const dt_iop_roi_t roi = { .width = dev->histogram_async.width, .height = dev->histogram_async.height };
+    const dt_histogram_roi_t histogram_roi = { .width = roi.width, .height = roi.height,
+                                               .crop_x = dev->histogram_async.crop_x,
+                                               .crop_y = dev->histogram_async.crop_y,
+                                               .crop_width = dev->histogram_async.crop_width,
+                                               .crop_height = dev->histogram_async.crop_height };
+    const gboolean waveform = dev->histogram_async.waveform;
+    const dt_iop_order_iccprofile_info_t *const profile_from = dev->histogram_async.profile_from;
+    const dt_iop_order_iccprofile_info_t *const profile_to = dev->histogram_async.profile_to;
+    dt_pthread_mutex_unlock(&dev->histogram_async.lock);
+
+    dt_times_t start_time = { 0 };
+    if(darktable.unmuted & DT_DEBUG_PERF) dt_get_times(&start_time);
+
+    const float *histogram_in = input;
+    if(profile_from && profile_to)
+    {
+      const size_t size = (size_t)roi.width * roi.height * 4;
+      if(dev->histogram_async.converted_size < size)
+      {
+        dt_free_align(dev->histogram_async.converted);
+        dev->histogram_async.converted = dt_alloc_align(64, size * sizeof(float));
+        dev->histogram_async.converted_size = dev->histogram_async.converted ? size : 0;
+      }
+      if(dev->histogram_async.converted)
+      {
+        dt_ioppr_transform_image_colorspace_rgb(input, dev->histogram_async.converted, roi.width, roi.height,
+                                                profile_from, profile_to, "final histogram");
+        histogram_in = dev->histogram_async.converted;
+      }
+    }
+
+    const uint32_t histogram_max = _pixelpipe_final_histogram(histogram_in, &histogram_roi,
+                                                              &dev->histogram_async.bins);
+
+    // the waveform is rendered from the display referred data
+    int waveform_width = 0;
+    if(waveform)
+      waveform_width = _pixelpipe_final_histogram_waveform(input, &roi, dev->histogram_waveform_height,
+                                                           dev->histogram_waveform_stride,
+                                                           dev->histogram_async.waveform_tmp);
+
+    dt_free_align(input);
+
+    dt_pthread_mutex_lock(&dev->histogram_async.lock);
+    memcpy(dev->histogram, dev->histogram_async.bins, sizeof(uint32_t) * 4 * 256);
+    dev->histogram_max = histogram_max;
+    if(waveform)
+    {
+      memcpy(dev->histogram_waveform, dev->histogram_async.waveform_tmp,
+             sizeof(uint8_t) * dev->histogram_waveform_height * dev->histogram_waveform_stride);
+      dev->histogram_waveform_width = waveform_width;
+    }
+    dt_pthread_mutex_unlock(&dev->histogram_async.lock);
+
+    if(darktable.unmuted & DT_DEBUG_PERF)
+    {
+      dt_times_t end_time = { 0 };
+      dt_get_times(&end_time);
+      fprintf(stderr, "final histogram%s took %.3f secs (%.3f CPU)\n", waveform ? " and waveform" : "",
+              end_time.clock - start_time.clock, end_time.user - start_time.user);
+    }
+
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_HISTOGRAM_READY);
+  }
+
+  return 0;
+}
+
+// hands a subsampled copy of the gamma input (or of its 8-bit output if the input is gone) over to the
+// histogram job, so the preview pipe does not wait for binning, profile conversion or the waveform.
+static void _pixelpipe_queue_final_histogram(dt_develop_t *dev, const float *const input,
+                                             const uint8_t *const output, const dt_iop_roi_t *roi_in)
+{
+  // the waveform wants at least one input pixel per column, the histogram is fine with a quarter of them
+  const int factor = CLAMP(roi_in->width / (int)(dev->histogram_waveform_stride / 4), 1, 2);
+  const int width = (roi_in->width + factor - 1) / factor;
+  const int height = (roi_in->height + factor - 1) / factor;
+
+  float *const buf = (float *)dt_alloc_align(64, (size_t)width * height * 4 * sizeof(float));
+  if(!buf) return;
+
+  const int in_width = roi_in->width;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(input, output, buf, width, height, in_width, factor) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    float *out = buf + (size_t)4 * width * j;
+    const size_t in_row = (size_t)in_width * j * factor;
+    for(int i = 0; i < width; i++, out += 4)
+    {
+      const size_t k = 4 * (in_row + (size_t)i * factor);
+      if(input)
+      {
+        for(int c = 0; c < 3; c++) out[c] = input[k + c];
+      }
+      else
+      {
+        // gamma writes bgr
+        for(int c = 0; c < 3; c++) out[c] = (float)output[k + (2 - c)] * (1.f / 255.f);
+      }
+      out[3] = 0.f;
+    }
+  }
+
+  int crop_x = 0, crop_y = 0, crop_width = 0, crop_height = 0;
+  // Constraining the area if the colorpicker is active in area mode
+  if(dev->gui_module && !strcmp(dev->gui_module->op, "colorout")
+     && dev->gui_module->request_color_pick != DT_REQUEST_COLORPICK_OFF
+     && darktable.lib->proxy.colorpicker.restrict_histogram)
+  {
+    if(darktable.lib->proxy.colorpicker.size == DT_COLORPICKER_SIZE_BOX)
+    {
+      crop_x = MIN(width, MAX(0, dev->gui_module->color_picker_box[0] * width));
+      crop_y = MIN(height, MAX(0, dev->gui_module->color_picker_box[1] * height));
+      crop_width = width - MIN(width, MAX(0, dev->gui_module->color_picker_box[2] * width));
+      crop_height = height - MIN(height, MAX(0, dev->gui_module->color_picker_box[3] * height));
+    }
+    else
+    {
+      crop_x = MIN(width, MAX(0, dev->gui_module->color_picker_point[0] * width));
+      crop_y = MIN(height, MAX(0, dev->gui_module->color_picker_point[1] * height));
+      crop_width = width - MIN(width, MAX(0, dev->gui_module->color_picker_point[0] * width));
+      crop_height = height - MIN(height, MAX(0, dev->gui_module->color_picker_point[1] * height));
+    }
+  }
+
+  dt_colorspaces_color_profile_type_t histogram_type = DT_COLORSPACE_SRGB;
+  gchar *histogram_filename = NULL;
+  gchar _histogram_filename[1] = { 0 };
+
+  dt_ioppr_get_histogram_profile_type(&histogram_type, &histogram_filename);
+  if(histogram_filename == NULL) histogram_filename = _histogram_filename;
+
+  const dt_iop_order_iccprofile_info_t *profile_from = NULL;
+  const dt_iop_order_iccprofile_info_t *profile_to = NULL;
+  if((histogram_type != darktable.color_profiles->display_type)
+     || (histogram_type == DT_COLORSPACE_FILE
+         && strcmp(histogram_filename, darktable.color_profiles->display_filename)))
+  {
+    profile_from = dt_ioppr_add_profile_info_to_list(dev, darktable.color_profiles->display_type,
+                                                     darktable.color_profiles->display_filename, INTENT_PERCEPTUAL);
+    profile_to = dt_ioppr_add_profile_info_to_list(dev, histogram_type, histogram_filename, INTENT_PERCEPTUAL);
+  }
+
+  dt_pthread_mutex_lock(&dev->histogram_async.lock);
+  dt_free_align(dev->histogram_async.pending);
+  dev->histogram_async.pending = buf;
+  dev->histogram_async.width = width;
+  dev->histogram_async.height = height;
+  dev->histogram_async.crop_x = crop_x;
+  dev->histogram_async.crop_y = crop_y;
+  dev->histogram_async.crop_width = crop_width;
+  dev->histogram_async.crop_height = crop_height;
+  // this HAS to be done on the float input data, otherwise we get really ugly artifacts due to rounding
+  // issues when putting colors into the bins.
+  // FIXME: is above comment true now that waveform is scaled via Cairo?
+  dev->histogram_async.waveform = input && dev->histogram_type == DT_DEV_HISTOGRAM_WAVEFORM;
+  dev->histogram_async.profile_from = profile_from;
+  dev->histogram_async.profile_to = profile_to;
+  const gboolean queue = !dev->histogram_async.queued;
+  dev->histogram_async.queued = TRUE;
+  dt_pthread_mutex_unlock(&dev->histogram_async.lock);
+
+  // a running job picks the new buffer up before it finishes
+  if(!queue) return;
+
+  dt_job_t *job = dt_control_job_create(&_pixelpipe_final_histogram_job_run, "%s", "final histogram");
+  if(!job)
   {
-    dt_times_t end_time = { 0 };
-    dt_get_times(&end_time);
-    fprintf(stderr, "final histogram waveform took %.3f secs (%.3f CPU)\n", end_time.clock - start_time.clock, end_time.user - start_time.user);
+    dt_pthread_mutex_lock(&dev->histogram_async.lock);
+    dev->histogram_async.queued = FALSE;
+    dt_pthread_mutex_unlock(&dev->histogram_async.lock);
+    return;
   }
+  dt_control_job_set_params(job, dev, NULL);
+  dt_control_job_set_state_callback(job, &_pixelpipe_final_histogram_job_state);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
 }
 
 // returns 1 if blend process need the module default colorspace
@@ -1125,6 +1273,219 @@ static int _transform_for_blend(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *p
   return ret;
 }
 
+#define DT_RAW_FRONTEND_MAX_MODULES 8
+
+// the chain of point-wise raw modules which is processed in one pass, see fuse_raw_frontend() in iop_api.h
+typedef struct dt_dev_raw_frontend_chain_t
+{
+  int count;
+  GList *modules[DT_RAW_FRONTEND_MAX_MODULES]; // last module of the chain first
+  GList *pieces[DT_RAW_FRONTEND_MAX_MODULES];
+  int pos;             // pipe position of rawprepare
+  dt_iop_roi_t roi_in; // region of the pipe input read by rawprepare
+  dt_iop_raw_frontend_t fe;
+  dt_iop_buffer_dsc_t dsc; // pipe format after the last module of the chain
+} dt_dev_raw_frontend_chain_t;
+
+static inline gboolean _skip_piece(dt_develop_t *dev, dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece)
+{
+  return !piece->enabled
+         || (dev->gui_module && dev->gui_module->operation_tags_filter() & module->operation_tags());
+}
+
+// collects the chain rawprepare .. `modules' if all enabled modules in between can be fused.
+// leaves pipe->dsc untouched, the hooks work on a copy which is only applied once the chain is processed.
+static gboolean _raw_frontend_chain(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, GList *modules, GList *pieces,
+                                    int pos, const dt_iop_roi_t *roi_out, dt_dev_raw_frontend_chain_t *chain)
+{
+  if(!pipe->fuse_raw_frontend || pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return FALSE;
+  if(!((dt_iop_module_t *)modules->data)->fuse_raw_frontend) return FALSE;
+#ifdef HAVE_OPENCL
+  if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0) return FALSE;
+#endif
+
+  chain->count = 0;
+  for(; modules; modules = g_list_previous(modules), pieces = g_list_previous(pieces), pos--)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(_skip_piece(dev, module, piece)) continue;
+
+    const dt_develop_blend_params_t *const bp = (const dt_develop_blend_params_t *)piece->blendop_data;
+    if(!module->fuse_raw_frontend || chain->count == DT_RAW_FRONTEND_MAX_MODULES
+       || (bp && bp->mask_mode != DEVELOP_MASK_DISABLED)
+       || module->request_color_pick != DT_REQUEST_COLORPICK_OFF || (piece->request_histogram & DT_REQUEST_ON)
+       // keep the input of the focused module in the cache
+       || module == dev->gui_module)
+      return FALSE;
+
+    chain->modules[chain->count] = modules;
+    chain->pieces[chain->count] = pieces;
+    chain->count++;
+
+    if(!strcmp(module->op, "rawprepare")) break;
+  }
+  if(!modules || chain->count < 2) return FALSE;
+  chain->pos = pos;
+
+  // rawprepare has to work on the pipe input directly
+  for(GList *m = g_list_previous(modules), *p = g_list_previous(pieces); m;
+      m = g_list_previous(m), p = g_list_previous(p))
+    if(!_skip_piece(dev, (dt_iop_module_t *)m->data, (dt_dev_pixelpipe_iop_t *)p->data)) return FALSE;
+
+  dt_iop_module_t *rawprepare = (dt_iop_module_t *)modules->data;
+  dt_dev_pixelpipe_iop_t *rp_piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  if(pipe->shutdown)
+  {
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    return FALSE;
+  }
+  // all but rawprepare have to pass the roi through unchanged
+  for(int k = 0; k < chain->count - 1; k++)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)chain->modules[k]->data;
+    dt_iop_roi_t roi_in;
+    module->modify_roi_in(module, (dt_dev_pixelpipe_iop_t *)chain->pieces[k]->data, roi_out, &roi_in);
+    if(memcmp(&roi_in, roi_out, sizeof(dt_iop_roi_t)))
+    {
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+      return FALSE;
+    }
+  }
+  rawprepare->modify_roi_in(rawprepare, rp_piece, roi_out, &chain->roi_in);
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+
+  dt_develop_tiling_t tiling = { 0 };
+  rawprepare->tiling_callback(rawprepare, rp_piece, &chain->roi_in, roi_out, &tiling);
+  if(!dt_tiling_piece_fits_host_memory(MAX(chain->roi_in.width, roi_out->width),
+                                       MAX(chain->roi_in.height, roi_out->height), sizeof(float), tiling.factor,
+                                       tiling.overhead))
+    return FALSE;
+
+  dt_iop_raw_frontend_t *fe = &chain->fe;
+  fe->csx = fe->csy = 0;
+  for(int j = 0; j < 6; j++)
+    for(int i = 0; i < 6; i++)
+    {
+      fe->sub[j][i] = 0.0f;
+      fe->div[j][i] = fe->mul[j][i] = 1.0f;
+    }
+  fe->clip = INFINITY;
+
+  // walk the chain in pipe order, the same way process_rec() sets up the formats
+  get_output_format(NULL, pipe, NULL, dev, &chain->dsc);
+  for(int k = chain->count - 1; k >= 0; k--)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)chain->modules[k]->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)chain->pieces[k]->data;
+    piece->dsc_out = piece->dsc_in = chain->dsc;
+    module->output_format(module, pipe, piece, &piece->dsc_out);
+    chain->dsc = piece->dsc_out;
+    if(module->fuse_raw_frontend(module, piece, fe, &chain->dsc, module == rawprepare ? &chain->roi_in : roi_out,
+                                 roi_out))
+      return FALSE;
+    piece->dsc_out = chain->dsc;
+  }
+
+  return TRUE;
+}
+
+static void _raw_frontend_process(const dt_iop_raw_frontend_t *const fe, const void *const ivoid,
+                                  const dt_iop_buffer_dsc_t *const in_dsc, float *const out,
+                                  const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const int in_float = (in_dsc->datatype == TYPE_FLOAT);
+
+  // one row per iteration: all the modules are applied while the row is in cache
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(fe, in_float, ivoid, out, roi_in, roi_out) \
+  schedule(static)
+#endif
+  for(int j = 0; j < roi_out->height; j++)
+  {
+    const float *const sub = fe->sub[j % 6];
+    const float *const div = fe->div[j % 6];
+    const float *const mul = fe->mul[j % 6];
+    const float clip = fe->clip;
+    const size_t pin = (size_t)roi_in->width * (j + fe->csy) + fe->csx;
+    float *const row = out + (size_t)roi_out->width * j;
+
+    if(in_float)
+    {
+      const float *const in = (const float *const)ivoid + pin;
+      for(int i = 0; i < roi_out->width; i++)
+      {
+        const int c = i % 6;
+        row[i] = MIN(clip, ((in[i] - sub[c]) / div[c]) * mul[c]);
+      }
+    }
+    else
+    {
+      const uint16_t *const in = (const uint16_t *const)ivoid + pin;
+      for(int i = 0; i < roi_out->width; i++)
+      {
+        const int c = i % 6;
+        row[i] = MIN(clip, ((in[i] - sub[c]) / div[c]) * mul[c]);
+      }
+    }
+  }
+}
+
+static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                        void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
+                                        const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos);
+
+// processes a chain set up by _raw_frontend_chain() into the cache line of its last module
+static int _raw_frontend_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                     dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
+                                     dt_dev_raw_frontend_chain_t *chain, const uint64_t hash, const size_t bufsize)
+{
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+
+  GList *rp_modules = chain->modules[chain->count - 1];
+  GList *rp_pieces = chain->pieces[chain->count - 1];
+  if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, &chain->roi_in,
+                                  g_list_previous(rp_modules), g_list_previous(rp_pieces), chain->pos - 1))
+    return 1;
+
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  if(pipe->shutdown)
+  {
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    return 1;
+  }
+
+  **out_format = chain->dsc;
+  (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  _raw_frontend_process(&chain->fe, input, input_format, (float *)*output, &chain->roi_in, roi_out);
+
+  for(int k = 0; k < chain->count; k++)
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)chain->pieces[k]->data;
+    piece->processed_roi_in = (k == chain->count - 1) ? chain->roi_in : *roi_out;
+    piece->processed_roi_out = *roi_out;
+  }
+
+  // in case we get this buffer from the cache in the future, cache some stuff:
+  **out_format = pipe->dsc = chain->dsc;
+
+  dt_show_times_f(&start, "[dev_pixelpipe]", "processed raw front-end (%d modules) on CPU [%s]", chain->count,
+                  _pipe_type_to_str(pipe->type));
+
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+  return 0;
+}
+
 // recursive helper for process:
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
@@ -1195,6 +1556,10 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
 
   // 3) input -> output
+  dt_dev_raw_frontend_chain_t chain;
+  if(modules && _raw_frontend_chain(pipe, dev, modules, pieces, pos, roi_out, &chain))
+    return _raw_frontend_process_rec(pipe, dev, output, out_format, roi_out, &chain, hash, bufsize);
+
   if(!modules)
   {
     // 3a) import input array with given scale and roi
@@ -2555,31 +2920,9 @@ post_process_collect_info:
       // FIXME: input may not be available, so we use the output from gamma
       // this may lead to some rounding errors
       if(input == NULL)
-      {
-        float *input_tmp = (float *)dt_alloc_align(64, roi_out->width * roi_out->height * 4 * sizeof(float));
-        const uint8_t *const pixel = (uint8_t *)*output;
-
-        const int imgsize = roi_out->height * roi_out->width * 4;
-        for(int i = 0; i < imgsize; i += 4)
-        {
-          for(int c = 0; c < 3; c++) input_tmp[i + c] = ((float)pixel[i + (2 - c)]) * (1.f / 255.f);
-          input_tmp[i + 3] = 0.f;
-        }
-
-        _pixelpipe_final_histogram(dev, (const float *const)input_tmp, roi_out);
-
-        dt_free_align(input_tmp);
-      }
+        _pixelpipe_queue_final_histogram(dev, NULL, (const uint8_t *const)*output, roi_out);
       else
-        _pixelpipe_final_histogram(dev, (const float *const)input, &roi_in);
-
-      // this HAS to be done on the float input data, otherwise we get really ugly artifacts due to rounding
-      // issues when putting colors into the bins.
-      // FIXME: is above comment true now that waveform is scaled via Cairo?
-      if(input && dev->histogram_type == DT_DEV_HISTOGRAM_WAVEFORM)
-      {
-        _pixelpipe_final_histogram_waveform(dev, (const float *const )input, &roi_in);
-      }
+        _pixelpipe_queue_final_histogram(dev, (const float *const)input, NULL, &roi_in);
 
       dt_pthread_mutex_unlock(&pipe->busy_mutex);
     }
@@ -2687,10 +3030,21 @@ static int dt_dev_pixelpipe_process_rec_and_backcopy(dt_dev_pixelpipe_t *pipe, d
 }
 
 
+// coarse runs work on their own cache lines: everything below only knows pipe->cache, so the two are
+// exchanged for the duration of the run.
+static void _pixelpipe_swap_coarse_cache(dt_dev_pixelpipe_t *pipe)
+{
+  const dt_dev_pixelpipe_cache_t tmp = pipe->cache;
+  pipe->cache = pipe->coarse_cache;
+  pipe->coarse_cache = tmp;
+}
+
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
                              float scale)
 {
   pipe->processing = 1;
+  const gboolean coarse = pipe->coarse > 1;
+  if(coarse) _pixelpipe_swap_coarse_cache(pipe);
   pipe->opencl_enabled = dt_opencl_update_settings(); // update enabled flag and profile from preferences
   pipe->devid = (pipe->opencl_enabled) ? dt_opencl_lock_device(pipe->type)
                                        : -1; // try to get/lock opencl resource
@@ -2723,7 +3077,7 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
 restart:
 
   // check if we should obsolete caches
-  if(pipe->cache_obsolete) dt_dev_pixelpipe_cache_flush(&(pipe->cache));
+  if(pipe->cache_obsolete) dt_dev_pixelpipe_flush_caches(pipe);
   pipe->cache_obsolete = 0;
 
   // mask display off as a starting point
@@ -2793,6 +3147,7 @@ restart:
   // ... and in case of other errors ...
   if(err)
   {
+    if(coarse) _pixelpipe_swap_coarse_cache(pipe);
     pipe->processing = 0;
     return 1;
   }
@@ -2819,9 +3174,12 @@ restart:
     if(pipe->output_backbuf)
       memcpy(pipe->output_backbuf, pipe->backbuf, (size_t)pipe->output_backbuf_width * pipe->output_backbuf_height * 4 * sizeof(uint8_t));
     pipe->output_imgid = pipe->image.id;
+    pipe->output_backbuf_coarse = pipe->coarse;
   }
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
 
+  if(coarse) _pixelpipe_swap_coarse_cache(pipe);
+
   // printf("pixelpipe homebrew process end\n");
   pipe->processing = 0;
   return 0;
@@ -2830,6 +3188,7 @@ restart:
 void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_flush(&pipe->cache);
+  dt_dev_pixelpipe_cache_flush(&pipe->coarse_cache);
 }
 
 void dt_dev_pixelpipe_get_dimensions(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int width_in,
@@ -92,6 +92,8 @@ typedef struct dt_dev_pixelpipe_t
 {
   // store history/zoom caches
   dt_dev_pixelpipe_cache_t cache;
+  // lines of the coarse runs of progressive rendering, kept apart so they don't push out the full ones
+  dt_dev_pixelpipe_cache_t coarse_cache;
   // set to non-zero in order to obsolete old cache entries on next pixelpipe run
   int cache_obsolete;
   // input buffer
@@ -123,6 +125,10 @@ typedef struct dt_dev_pixelpipe_t
   uint8_t *output_backbuf;
   int output_backbuf_width, output_backbuf_height;
   int output_imgid;
+  // progressive rendering: the next run is a coarse one at 1/coarse of the displayed scale,
+  // output_backbuf_coarse tells the gui how much to upscale what it got.
+  int coarse;
+  int output_backbuf_coarse;
   // working?
   int processing;
   // shutting down?
@@ -158,6 +164,8 @@ typedef struct dt_dev_pixelpipe_t
   GList *forms;
   // the masks generated in the pipe for later reusal are inside dt_dev_pixelpipe_iop_t
   gboolean store_all_raster_masks;
+  // run the point-wise raw modules as one pass if possible
+  gboolean fuse_raw_frontend;
 } dt_dev_pixelpipe_t;
 
 struct dt_develop_t;
@@ -67,6 +67,9 @@
 #define LSD_DENSITY_TH 0.7                  // LSD: minimal density of region points in rectangle
 #define LSD_N_BINS 1024                     // LSD: number of bins in pseudo-ordering of gradient modulus
 #define LSD_GAMMA 0.45                      // gamma correction to apply on raw images prior to line detection
+#define LSD_BAND_OVERLAP 16                 // LSD: rows shared by neighbouring bands of the image
+#define LSD_BAND_MIN_HEIGHT 256             // LSD: minimum height of a band, smaller images are done in one piece
+#define LSD_MERGE_ANGLE 2.0                 // LSD: max difference in degrees of two segments cut at a band border
 #define RANSAC_RUNS 400                     // how many iterations to run in ransac
 #define RANSAC_EPSILON 2                    // starting value for ransac epsilon (in -log10 units)
 #define RANSAC_EPSILON_STEP 1               // step size of epsilon optimization (log10 units)
@@ -206,9 +209,7 @@ typedef enum dt_iop_ashift_enhance_t
 {
   ASHIFT_ENHANCE_NONE       = 0,
   ASHIFT_ENHANCE_EDGES      = 1 << 0,
-  ASHIFT_ENHANCE_DETAIL     = 1 << 1,
-  ASHIFT_ENHANCE_HORIZONTAL = 0x100,
-  ASHIFT_ENHANCE_VERTICAL   = 0x200
+  ASHIFT_ENHANCE_DETAIL     = 1 << 1
 } dt_iop_ashift_enhance_t;
 
 typedef enum dt_iop_ashift_mode_t
@@ -1137,132 +1138,70 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
 }
 
 // simple conversion of rgb image into greyscale variant suitable for line segment detection
-// the lsd routines expect input as *double, roughly in the range [0.0; 256.0]
-static void rgb2grey256(const float *in, double *out, const int width, const int height)
+// the lsd routines expect input roughly in the range [0.0; 256.0]
+static void rgb2grey256(const float *const in, float *const out, const int width, const int height)
 {
   const int ch = 4;
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, ch) \
-  shared(in, out) \
+  dt_omp_firstprivate(height, width, ch, in, out) \
   schedule(static)
 #endif
   for(int j = 0; j < height; j++)
   {
     const float *inp = in + (size_t)ch * j * width;
-    double *outp = out + (size_t)j * width;
-    for(int i = 0; i < width; i++, inp += ch, outp++)
+    float *outp = out + (size_t)j * width;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int i = 0; i < width; i++)
     {
-      *outp = (0.3f * inp[0] + 0.59f * inp[1] + 0.11f * inp[2]) * 256.0;
+      outp[i] = (0.3f * inp[ch * i] + 0.59f * inp[ch * i + 1] + 0.11f * inp[ch * i + 2]) * 256.0f;
     }
   }
 }
 
-// sobel edge enhancement in one direction
-static void edge_enhance_1d(const double *in, double *out, const int width, const int height,
-                            dt_iop_ashift_enhance_t dir)
+// sobel edge enhancement in both directions at once, in single precision.
+// writes the gradient magnitude into the double precision buffer LSD works on
+static void edge_enhance(const float *const in, double *const out, const int width, const int height)
 {
-  // Sobel kernels for both directions
-  const double hkernel[3][3] = { { 1.0, 0.0, -1.0 }, { 2.0, 0.0, -2.0 }, { 1.0, 0.0, -1.0 } };
-  const double vkernel[3][3] = { { 1.0, 2.0, 1.0 }, { 0.0, 0.0, 0.0 }, { -1.0, -2.0, -1.0 } };
-  const int kwidth = 3;
-  const int khwidth = kwidth / 2;
-
-  // select kernel
-  const double *kernel = (dir == ASHIFT_ENHANCE_HORIZONTAL) ? (const double *)hkernel : (const double *)vkernel;
+  if(width < 3 || height < 3)
+  {
+    memset(out, 0, sizeof(double) * width * height);
+    return;
+  }
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, khwidth, kwidth) \
-  shared(in, out, kernel) \
+  dt_omp_firstprivate(height, width, in, out) \
   schedule(static)
 #endif
-  // loop over image pixels and perform sobel convolution
-  for(int j = khwidth; j < height - khwidth; j++)
+  for(int j = 1; j < height - 1; j++)
   {
-    const double *inp = in + (size_t)j * width + khwidth;
-    double *outp = out + (size_t)j * width + khwidth;
-    for(int i = khwidth; i < width - khwidth; i++, inp++, outp++)
-    {
-      double sum = 0.0f;
-      for(int jj = 0; jj < kwidth; jj++)
-      {
-        const int k = jj * kwidth;
-        const int l = (jj - khwidth) * width;
-        for(int ii = 0; ii < kwidth; ii++)
-        {
-          sum += inp[l + ii - khwidth] * kernel[k + ii];
-        }
-      }
-      *outp = sum;
-    }
-  }
+    const float *const up = in + (size_t)(j - 1) * width;
+    const float *const mid = in + (size_t)j * width;
+    const float *const down = in + (size_t)(j + 1) * width;
+    double *const outp = out + (size_t)j * width;
 
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, khwidth) \
-  shared(out) \
-  schedule(static)
+#pragma omp simd
 #endif
-  // border fill in output buffer, so we don't get pseudo lines at image frame
-  for(int j = 0; j < height; j++)
-    for(int i = 0; i < width; i++)
+    for(int i = 1; i < width - 1; i++)
     {
-      double val = out[j * width + i];
-
-      if(j < khwidth)
-        val = out[(khwidth - j) * width + i];
-      else if(j >= height - khwidth)
-        val = out[(j - khwidth) * width + i];
-      else if(i < khwidth)
-        val = out[j * width + (khwidth - i)];
-      else if(i >= width - khwidth)
-        val = out[j * width + (i - khwidth)];
-
-      out[j * width + i] = val;
-
-      // jump over center of image
-      if(i == khwidth && j >= khwidth && j < height - khwidth) i = width - khwidth;
+      // kernels { 1, 0, -1 }, { 2, 0, -2 }, { 1, 0, -1 } and its transpose
+      const float gx = (up[i - 1] - up[i + 1]) + 2.0f * (mid[i - 1] - mid[i + 1]) + (down[i - 1] - down[i + 1]);
+      const float gy = (up[i - 1] + 2.0f * up[i] + up[i + 1]) - (down[i - 1] + 2.0f * down[i] + down[i + 1]);
+      outp[i] = sqrtf(gx * gx + gy * gy);
     }
-}
-
-// edge enhancement in both directions
-static int edge_enhance(const double *in, double *out, const int width, const int height)
-{
-  double *Gx = NULL;
-  double *Gy = NULL;
 
-  Gx = malloc((size_t)width * height * sizeof(double));
-  if(Gx == NULL) goto error;
-
-  Gy = malloc((size_t)width * height * sizeof(double));
-  if(Gy == NULL) goto error;
-
-  // perform edge enhancement in both directions
-  edge_enhance_1d(in, Gx, width, height, ASHIFT_ENHANCE_HORIZONTAL);
-  edge_enhance_1d(in, Gy, width, height, ASHIFT_ENHANCE_VERTICAL);
-
-// calculate absolute values
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width) \
-  shared(Gx, Gy, out) \
-  schedule(static)
-#endif
-  for(size_t k = 0; k < (size_t)width * height; k++)
-  {
-    out[k] = sqrt(Gx[k] * Gx[k] + Gy[k] * Gy[k]);
+    // border fill in output buffer, so we don't get pseudo lines at image frame
+    outp[0] = outp[1];
+    outp[width - 1] = outp[width - 2];
   }
 
-  free(Gx);
-  free(Gy);
-  return TRUE;
-
-error:
-  if(Gx) free(Gx);
-  if(Gy) free(Gy);
-  return FALSE;
+  memcpy(out, out + width, sizeof(double) * width);
+  memcpy(out + (size_t)(height - 1) * width, out + (size_t)(height - 2) * width, sizeof(double) * width);
 }
 
 // XYZ -> sRGB matrix
@@ -1367,13 +1306,167 @@ static void gamma_correct(const float *in, float *out, const int width, const in
   }
 }
 
+// join segment b into segment a if they are the two parts of a line cut at a band border:
+// nearly parallel, within each other's width and overlapping or touching along their direction
+static int lsd_merge_segments(double *a, const double *b, const double cos_max)
+{
+  const double ax = a[2] - a[0], ay = a[3] - a[1];
+  const double bx = b[2] - b[0], by = b[3] - b[1];
+  const double alen = sqrt(ax * ax + ay * ay);
+  const double blen = sqrt(bx * bx + by * by);
+  if(alen == 0.0 || blen == 0.0) return FALSE;
+
+  const double ux = ax / alen, uy = ay / alen;
+  if(fabs(ux * bx + uy * by) / blen < cos_max) return FALSE;
+
+  // distance of b's end points to the line through a
+  const double tolerance = fmax(a[4], b[4]);
+  if(fabs(-uy * (b[0] - a[0]) + ux * (b[1] - a[1])) > tolerance) return FALSE;
+  if(fabs(-uy * (b[2] - a[0]) + ux * (b[3] - a[1])) > tolerance) return FALSE;
+
+  // positions of all end points along a
+  const double t[4] = { 0.0, alen, ux * (b[0] - a[0]) + uy * (b[1] - a[1]),
+                        ux * (b[2] - a[0]) + uy * (b[3] - a[1]) };
+  const double bmin = fmin(t[2], t[3]), bmax = fmax(t[2], t[3]);
+  if(bmin > alen + LSD_BAND_OVERLAP || bmax < -LSD_BAND_OVERLAP) return FALSE;
+
+  const double p[4][2] = { { a[0], a[1] }, { a[2], a[3] }, { b[0], b[1] }, { b[2], b[3] } };
+  int lo = 0, hi = 0;
+  for(int k = 1; k < 4; k++)
+  {
+    if(t[k] < t[lo]) lo = k;
+    if(t[k] > t[hi]) hi = k;
+  }
+
+  a[0] = p[lo][0];
+  a[1] = p[lo][1];
+  a[2] = p[hi][0];
+  a[3] = p[hi][1];
+  a[4] = fmax(a[4], b[4]);
+  a[5] = (alen * a[5] + blen * b[5]) / (alen + blen);
+  a[6] = fmax(a[6], b[6]);
+  return TRUE;
+}
+
+// run LSD on overlapping horizontal bands of the image in parallel. a band keeps the
+// segments centered in its own rows, so that the overlap doesn't give duplicates, and
+// segments cut at a band border are joined afterwards. the number of tests in LSD's
+// false alarm estimate depends on the size of the band, so a few more (short) segments
+// may pass than on the whole image. output as for LineSegmentDetection()
+static double *line_segment_detection_bands(int *n_out, double *img, const int width, const int height)
+{
+  const int nbands = MIN(MIN(dt_get_num_threads(), 32), height / LSD_BAND_MIN_HEIGHT);
+  if(nbands <= 1)
+    return LineSegmentDetection(n_out, img, width, height, LSD_SCALE, LSD_SIGMA_SCALE, LSD_QUANT,
+                                LSD_ANG_TH, LSD_LOG_EPS, LSD_DENSITY_TH, LSD_N_BINS, NULL, NULL, NULL);
+
+  double *band_lines[32] = { NULL };
+  int band_count[32] = { 0 };
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(img, width, height, nbands) \
+  shared(band_lines, band_count) \
+  schedule(dynamic)
+#endif
+  for(int b = 0; b < nbands; b++)
+  {
+    const int y0 = MAX(0, b * height / nbands - LSD_BAND_OVERLAP);
+    const int y1 = MIN(height, (b + 1) * height / nbands + LSD_BAND_OVERLAP);
+    band_lines[b] = LineSegmentDetection(&band_count[b], img + (size_t)y0 * width, width, y1 - y0,
+                                         LSD_SCALE, LSD_SIGMA_SCALE, LSD_QUANT, LSD_ANG_TH, LSD_LOG_EPS,
+                                         LSD_DENSITY_TH, LSD_N_BINS, NULL, NULL, NULL);
+  }
+
+  int total = 0;
+  for(int b = 0; b < nbands; b++) total += band_count[b];
+
+  double *lines = malloc(sizeof(double) * 7 * MAX(total, 1));
+  uint32_t *bands = malloc(sizeof(uint32_t) * MAX(total, 1));
+  int count = 0;
+
+  for(int b = 0; b < nbands; b++)
+  {
+    const int y0 = MAX(0, b * height / nbands - LSD_BAND_OVERLAP);
+    const double core0 = b * height / nbands;
+    const double core1 = (b + 1) * height / nbands;
+    for(int n = 0; n < band_count[b]; n++)
+    {
+      const double *l = band_lines[b] + 7 * n;
+      const double cy = y0 + 0.5 * (l[1] + l[3]);
+      if(cy < core0 || cy >= core1) continue;
+      double *o = lines + 7 * count;
+      memcpy(o, l, sizeof(double) * 7);
+      o[1] += y0;
+      o[3] += y0;
+      bands[count++] = 1u << b;
+    }
+    free(band_lines[b]);
+  }
+
+  // join the pieces of lines crossing band borders. only segments reaching close
+  // to a border may need it, and pieces found in the same band are kept apart
+  int *candidates = malloc(sizeof(int) * MAX(count, 1));
+  int ncandidates = 0;
+  for(int n = 0; n < count; n++)
+  {
+    const double *l = lines + 7 * n;
+    for(int b = 1; b < nbands; b++)
+    {
+      const double border = b * height / nbands;
+      if(fmin(fabs(l[1] - border), fabs(l[3] - border)) < 2 * LSD_BAND_OVERLAP)
+      {
+        candidates[ncandidates++] = n;
+        break;
+      }
+    }
+  }
+
+  const double cos_max = cos(LSD_MERGE_ANGLE * M_PI / 180.0);
+  gboolean merged = TRUE;
+  while(merged)
+  {
+    merged = FALSE;
+    for(int i = 0; i < ncandidates; i++)
+    {
+      const int a = candidates[i];
+      if(bands[a] == 0) continue;
+      for(int j = i + 1; j < ncandidates; j++)
+      {
+        const int b = candidates[j];
+        if(bands[b] == 0 || (bands[a] & bands[b])) continue;
+        if(!lsd_merge_segments(lines + 7 * a, lines + 7 * b, cos_max)) continue;
+        bands[a] |= bands[b];
+        bands[b] = 0;
+        merged = TRUE;
+      }
+    }
+  }
+  free(candidates);
+
+  // drop the segments that have been joined into others
+  int kept = 0;
+  for(int n = 0; n < count; n++)
+  {
+    if(bands[n] == 0) continue;
+    if(kept != n) memcpy(lines + 7 * kept, lines + 7 * n, sizeof(double) * 7);
+    kept++;
+  }
+  count = kept;
+
+  free(bands);
+  *n_out = count;
+  return lines;
+}
+
 // do actual line_detection based on LSD algorithm and return results according
 // to this module's conventions
 static int line_detect(float *in, const int width, const int height, const int x_off, const int y_off,
                        const float scale, dt_iop_ashift_line_t **alines, int *lcount, int *vcount, int *hcount,
                        float *vweight, float *hweight, dt_iop_ashift_enhance_t enhance, const int is_raw)
 {
-  double *greyscale = NULL;
+  float *greyscale = NULL;
+  double *lsd_in = NULL;
   double *lsd_lines = NULL;
   dt_iop_ashift_line_t *ashift_lines = NULL;
 
@@ -1395,26 +1488,35 @@ static int line_detect(float *in, const int width, const int height, const int x
   }
 
   // allocate intermediate buffers
-  greyscale = malloc((size_t)width * height * sizeof(double));
+  greyscale = dt_alloc_align(64, (size_t)width * height * sizeof(float));
   if(greyscale == NULL) goto error;
+  lsd_in = dt_alloc_align(64, (size_t)width * height * sizeof(double));
+  if(lsd_in == NULL) goto error;
 
   // convert to greyscale image
   rgb2grey256(in, greyscale, width, height);
 
-  // if requested perform an additional edge enhancement step
+  // if requested perform an additional edge enhancement step,
+  // either way LSD wants its input in double precision
   if(enhance & ASHIFT_ENHANCE_EDGES)
   {
-    (void)edge_enhance(greyscale, greyscale, width, height);
+    edge_enhance(greyscale, lsd_in, width, height);
+  }
+  else
+  {
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(greyscale, lsd_in, height, width) \
+  schedule(static)
+#endif
+    for(size_t k = 0; k < (size_t)width * height; k++) lsd_in[k] = greyscale[k];
   }
 
   // call the line segment detector LSD;
   // LSD stores the number of found lines in lines_count.
   // it returns structural details as vector 'double lines[7 * lines_count]'
   int lines_count;
-  lsd_lines = LineSegmentDetection(&lines_count, greyscale, width, height,
-                                   LSD_SCALE, LSD_SIGMA_SCALE, LSD_QUANT,
-                                   LSD_ANG_TH, LSD_LOG_EPS, LSD_DENSITY_TH,
-                                   LSD_N_BINS, NULL, NULL, NULL);
+  lsd_lines = line_segment_detection_bands(&lines_count, lsd_in, width, height);
 
   // we count the lines that we really want to use
   int lct = 0;
@@ -1533,12 +1635,14 @@ static int line_detect(float *in, const int width, const int height, const int x
 
   // free intermediate buffers
   free(lsd_lines);
-  free(greyscale);
+  dt_free_align(lsd_in);
+  dt_free_align(greyscale);
   return lct > 0 ? TRUE : FALSE;
 
 error:
   free(lsd_lines);
-  free(greyscale);
+  dt_free_align(lsd_in);
+  dt_free_align(greyscale);
   return FALSE;
 }
 
@@ -1616,45 +1720,83 @@ error:
 }
 
 
-// swap two integer values
-static inline void swap(int *a, int *b)
+// evaluate the model made of lines index_set[a] and index_set[b] against the whole set: returns
+// its quality or a negative value if the two lines don't give a valid model, adds the number of
+// lines rejected as outliers to *eliminated and, if inout is given, marks lines within the model
+static float ransac_model(const dt_iop_ashift_line_t *lines, const int *index_set, const int set_count,
+                          const int a, const int b, const float total_weight, const float epsilon,
+                          const int xmin, const int xmax, const int ymin, const int ymax,
+                          int *eliminated, int *inout)
 {
-  int tmp = *a;
-  *a = *b;
-  *b = tmp;
-}
+  const float *L1 = lines[index_set[a]].L;
+  const float *L2 = lines[index_set[b]].L;
+
+  // get intersection point (ideally a vantage point)
+  float V[3];
+  vec3prodn(V, L1, L2);
+
+  // catch special cases:
+  // a) L1 and L2 are identical -> V is NULL -> no valid vantage point
+  // b) vantage point lies inside image frame (no chance to correct for this case)
+  if(vec3isnull(V) ||
+     (fabs(V[2]) > 0.0f &&
+      V[0]/V[2] >= xmin &&
+      V[1]/V[2] >= ymin &&
+      V[0]/V[2] <= xmax &&
+      V[1]/V[2] <= ymax))
+    return -1.0f;
+
+  // normalize V so that x^2 + y^2 + z^2 = 1
+  vec3norm(V, V);
+
+  // go through all other lines, check if they are within the model and sum up
+  // a quality parameter for all lines within the model
+  float quality = 0.0f;
+  int out = 0;
+  for(int n = 0; n < set_count; n++)
+  {
+    // the two lines constituting the model are part of the set
+    if(n == a || n == b)
+    {
+      if(inout) inout[n] = 1;
+      continue;
+    }
 
-// do complete permutations
-static int quickperm(int *a, int *p, const int N, int *i)
-{
-  if(*i >= N) return FALSE;
+    // L is normalized so that x^2 + y^2 = 1
+    const float *L3 = lines[index_set[n]].L;
 
-  p[*i]--;
-  int j = (*i % 2 == 1) ? p[*i] : 0;
-  swap(&a[j], &a[*i]);
-  *i = 1;
-  while(p[*i] == 0)
-  {
-    p[*i] = *i;
-    (*i)++;
-  }
-  return TRUE;
-}
+    // we take the absolute value of the dot product of V and L as a measure
+    // of the "distance" between point and line. Note that this is not the real euclidean
+    // distance but - with the given normalization - just a pragmatically selected number
+    // that goes to zero if V lies on L and increases the more V and L are apart
+    const float d = fabs(vec3scalar(V, L3));
 
-// Fisher-Yates shuffle
-static void shuffle(int *a, const int N)
-{
-  for(int i = 0; i < N; i++)
-  {
-    int j = i + rand() % (N - i);
-    swap(&a[j], &a[i]);
+    // depending on d we either include or exclude the point from the set
+    const int in = (d < epsilon) ? 1 : 0;
+    if(inout) inout[n] = in;
+
+    if(in)
+    {
+      // a quality parameter that depends 1/3 on the number of lines within the model,
+      // 1/3 on their weight, and 1/3 on their weighted distance d to the vantage point
+      quality += 0.33f / (float)set_count
+                 + 0.33f * lines[index_set[n]].weight / total_weight
+                 + 0.33f * (1.0f - d / epsilon) * (float)set_count * lines[index_set[n]].weight / total_weight;
+    }
+    else
+      out++;
   }
+
+  *eliminated += out;
+  return quality;
 }
 
-// factorial function
-static int fact(const int n)
+// draw the two lines of a random model
+static inline void ransac_sample(int *a, int *b, const int set_count)
 {
-  return (n == 1 ? 1 : n * fact(n - 1));
+  *a = rand() % set_count;
+  *b = rand() % (set_count - 1);
+  if(*b >= *a) (*b)++;
 }
 
 // We use a pseudo-RANSAC algorithm to elminiate ouliers from our set of lines. The
@@ -1673,174 +1815,134 @@ static int fact(const int n)
 // note: the actual percentage of outliers removed in the final run will be lower because we
 // will finally look for the best quality model with the optimized epsilon and that quality value also
 // encloses the number of good lines
+// A model only depends on the pair of lines it is made of, so the pairs are drawn up front and
+// the models of a self-tuning step, as well as those of the final runs, are evaluated in parallel.
 static void ransac(const dt_iop_ashift_line_t *lines, int *index_set, int *inout_set,
                   const int set_count, const float total_weight, const int xmin, const int xmax,
                   const int ymin, const int ymax)
 {
   if(set_count < 3) return;
 
-  const size_t set_size = set_count * sizeof(int);
-  int *best_set = malloc(set_size);
-  memcpy(best_set, index_set, set_size);
-  int *best_inout = calloc(1, set_size);
-
-  float best_quality = 0.0f;
-
   // hurdle value epsilon for rejecting a line as an outlier will be self-tuning
   // in a number of dry runs
   float epsilon = pow(10.0f, -RANSAC_EPSILON);
   float epsilon_step = RANSAC_EPSILON_STEP;
-  // some accounting variables for self-tuning
-  int lines_eliminated = 0;
-  int valid_runs = 0;
-
-  // number of runs to optimize epsilon
-  const int optiruns = RANSAC_OPTIMIZATION_STEPS * RANSAC_OPTIMIZATION_DRY_RUNS;
-  // go for complete permutations on small set sizes, else for random sample consensus
-  const int riter = (set_count > RANSAC_HURDLE) ? RANSAC_RUNS : fact(set_count);
 
-  // some data needed for quickperm
-  int *perm = malloc((set_count + 1) * sizeof(int));
-  for(int n = 0; n < set_count + 1; n++) perm[n] = n;
-  int piter = 1;
+  // go for all pairs of lines on small set sizes, else for random sample consensus
+  const int npairs = set_count * (set_count - 1) / 2;
+  const int riter = (set_count > RANSAC_HURDLE) ? RANSAC_RUNS : npairs;
+  const int nsamples = MAX(riter, RANSAC_OPTIMIZATION_DRY_RUNS);
+  int *sample_a = malloc(sizeof(int) * nsamples);
+  int *sample_b = malloc(sizeof(int) * nsamples);
+  float *quality = malloc(sizeof(float) * nsamples);
 
-  // inout holds good/bad qualification for each line
-  int *inout = malloc(set_size);
+  // not worth waking up threads for a handful of lines
+  const int parallel = set_count > 64;
 
-  for(int r = 0; r < optiruns + riter; r++)
+  for(int step = 0; step < RANSAC_OPTIMIZATION_STEPS; step++)
   {
-    // get random or systematic variation of index set
-    if(set_count > RANSAC_HURDLE || r < optiruns)
-      shuffle(index_set, set_count);
-    else
-      (void)quickperm(index_set, perm, set_count, &piter);
-
-    // summed quality evaluation of this run
-    float quality = 0.0f;
-
-    // we build a model ouf of the first two lines
-    const float *L1 = lines[index_set[0]].L;
-    const float *L2 = lines[index_set[1]].L;
-
-    // get intersection point (ideally a vantage point)
-    float V[3];
-    vec3prodn(V, L1, L2);
-
-    // catch special cases:
-    // a) L1 and L2 are identical -> V is NULL -> no valid vantage point
-    // b) vantage point lies inside image frame (no chance to correct for this case)
-    if(vec3isnull(V) ||
-       (fabs(V[2]) > 0.0f &&
-        V[0]/V[2] >= xmin &&
-        V[1]/V[2] >= ymin &&
-        V[0]/V[2] <= xmax &&
-        V[1]/V[2] <= ymax))
-    {
-      // no valid model
-      quality = 0.0f;
-    }
-    else
-    {
-      // valid model
+    // the models are drawn in sequence, rand() is not thread safe
+    for(int r = 0; r < RANSAC_OPTIMIZATION_DRY_RUNS; r++) ransac_sample(&sample_a[r], &sample_b[r], set_count);
 
-      // normalize V so that x^2 + y^2 + z^2 = 1
-      vec3norm(V, V);
+    // some accounting variables for self-tuning
+    int lines_eliminated = 0;
+    int valid_runs = 0;
 
-      // the two lines constituting the model are part of the set
-      inout[0] = 1;
-      inout[1] = 1;
-
-      // go through all remaining lines, check if they are within the model, and
-      // mark that fact in inout[].
-      // summarize a quality parameter for all lines within the model
-      for(int n = 2; n < set_count; n++)
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(lines, index_set, set_count, total_weight, epsilon, xmin, xmax, ymin, ymax, \
+                      sample_a, sample_b) \
+  reduction(+ : lines_eliminated, valid_runs) \
+  schedule(static) if(parallel)
+#endif
+    for(int r = 0; r < RANSAC_OPTIMIZATION_DRY_RUNS; r++)
+    {
+      int eliminated = 0;
+      if(ransac_model(lines, index_set, set_count, sample_a[r], sample_b[r], total_weight, epsilon,
+                      xmin, xmax, ymin, ymax, &eliminated, NULL) >= 0.0f)
       {
-        // L is normalized so that x^2 + y^2 = 1
-        const float *L3 = lines[index_set[n]].L;
-
-        // we take the absolute value of the dot product of V and L as a measure
-        // of the "distance" between point and line. Note that this is not the real euclidean
-        // distance but - with the given normalization - just a pragmatically selected number
-        // that goes to zero if V lies on L and increases the more V and L are apart
-        const float d = fabs(vec3scalar(V, L3));
-
-        // depending on d we either include or exclude the point from the set
-        inout[n] = (d < epsilon) ? 1 : 0;
-
-        float q;
-
-        if(inout[n] == 1)
-        {
-          // a quality parameter that depends 1/3 on the number of lines within the model,
-          // 1/3 on their weight, and 1/3 on their weighted distance d to the vantage point
-          q = 0.33f / (float)set_count
-              + 0.33f * lines[index_set[n]].weight / total_weight
-              + 0.33f * (1.0f - d / epsilon) * (float)set_count * lines[index_set[n]].weight / total_weight;
-        }
-        else
-        {
-          q = 0.0f;
-          lines_eliminated++;
-        }
-
-        quality += q;
+        lines_eliminated += eliminated;
+        valid_runs++;
       }
-      valid_runs++;
     }
 
-    if(r < optiruns)
+    if(valid_runs > 0)
     {
-      // on last run of each self-tuning step
-      if((r % RANSAC_OPTIMIZATION_DRY_RUNS) == (RANSAC_OPTIMIZATION_DRY_RUNS - 1) && (valid_runs > 0))
-      {
 #ifdef ASHIFT_DEBUG
-        printf("ransac self-tuning (run %d): epsilon %f", r, epsilon);
+      printf("ransac self-tuning (step %d): epsilon %f", step, epsilon);
 #endif
-        // average ratio of lines that we eliminated with the given epsilon
-        float ratio = 100.0f * (float)lines_eliminated / ((float)set_count * valid_runs);
-        // adjust epsilon accordingly
-        if(ratio < RANSAC_ELIMINATION_RATIO)
-          epsilon = pow(10.0f, log10(epsilon) - epsilon_step);
-        else if(ratio > RANSAC_ELIMINATION_RATIO)
-          epsilon = pow(10.0f, log10(epsilon) + epsilon_step);
+      // average ratio of lines that we eliminated with the given epsilon
+      float ratio = 100.0f * (float)lines_eliminated / ((float)set_count * valid_runs);
+      // adjust epsilon accordingly
+      if(ratio < RANSAC_ELIMINATION_RATIO)
+        epsilon = pow(10.0f, log10(epsilon) - epsilon_step);
+      else if(ratio > RANSAC_ELIMINATION_RATIO)
+        epsilon = pow(10.0f, log10(epsilon) + epsilon_step);
 #ifdef ASHIFT_DEBUG
-        printf(" (elimination ratio %f) -> %f\n", ratio, epsilon);
+      printf(" (elimination ratio %f) -> %f\n", ratio, epsilon);
 #endif
-        // reduce step-size for next optimization round
-        epsilon_step /= 2.0f;
-        lines_eliminated = 0;
-        valid_runs = 0;
-      }
+      // reduce step-size for next optimization round
+      epsilon_step /= 2.0f;
     }
-    else
-    {
-      // in the "real" runs check against the best model found so far
-      if(quality > best_quality)
+  }
+
+  // the "real" runs
+  if(set_count > RANSAC_HURDLE)
+  {
+    for(int r = 0; r < riter; r++) ransac_sample(&sample_a[r], &sample_b[r], set_count);
+  }
+  else
+  {
+    int r = 0;
+    for(int a = 0; a < set_count; a++)
+      for(int b = a + 1; b < set_count; b++, r++)
       {
-        memcpy(best_set, index_set, set_size);
-        memcpy(best_inout, inout, set_size);
-        best_quality = quality;
+        sample_a[r] = a;
+        sample_b[r] = b;
       }
-    }
+  }
 
-#ifdef ASHIFT_DEBUG
-    // report some statistics
-    int count = 0, lastcount = 0;
-    for(int n = 0; n < set_count; n++) count += best_inout[n];
-    for(int n = 0; n < set_count; n++) lastcount += inout[n];
-    printf("ransac run %d: best qual %.6f, eps %.6f, line count %d of %d (this run: qual %.5f, count %d (%2f%%))\n", r,
-           best_quality, epsilon, count, set_count, quality, lastcount, 100.0f * lastcount / (float)set_count);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(lines, index_set, set_count, total_weight, epsilon, xmin, xmax, ymin, ymax, \
+                      sample_a, sample_b, quality, riter) \
+  schedule(static) if(parallel)
 #endif
+  for(int r = 0; r < riter; r++)
+  {
+    int eliminated = 0;
+    quality[r] = ransac_model(lines, index_set, set_count, sample_a[r], sample_b[r], total_weight, epsilon,
+                              xmin, xmax, ymin, ymax, &eliminated, NULL);
+  }
+
+  // check against the best model found so far, the first one wins on a tie
+  float best_quality = 0.0f;
+  int best = -1;
+  for(int r = 0; r < riter; r++)
+  {
+    if(quality[r] > best_quality)
+    {
+      best_quality = quality[r];
+      best = r;
+    }
   }
 
-  // store back best set
-  memcpy(index_set, best_set, set_size);
-  memcpy(inout_set, best_inout, set_size);
+  // store back the lines within the best model
+  int eliminated = 0;
+  if(best >= 0)
+    (void)ransac_model(lines, index_set, set_count, sample_a[best], sample_b[best], total_weight, epsilon,
+                       xmin, xmax, ymin, ymax, &eliminated, inout_set);
+  else
+    memset(inout_set, 0, sizeof(int) * set_count);
+
+#ifdef ASHIFT_DEBUG
+  printf("ransac: best qual %.6f, eps %.6f, line count %d of %d\n", best_quality, epsilon,
+         set_count - eliminated, set_count);
+#endif
 
-  free(inout);
-  free(perm);
-  free(best_inout);
-  free(best_set);
+  free(quality);
+  free(sample_b);
+  free(sample_a);
 }
 
 
@@ -244,7 +244,11 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
     const size_t basebuffer = width * height * channels * sizeof(float);
     const int rad = MIN(roi_in->width, ceilf(256 * roi_in->scale / piece->iscale));
 
-    tiling->factor = 2.0f + (float)local_laplacian_memory_use(width, height) / basebuffer;
+    // the cpu code streams the gamma levels, the opencl one doesn't
+    const size_t memory_use = piece->pipe->devid >= 0 ? local_laplacian_memory_use_cl(width, height)
+                                                      : local_laplacian_memory_use(width, height);
+
+    tiling->factor = 2.0f + (float)memory_use / basebuffer;
     tiling->maxbuf
         = fmax(1.0f, (float)local_laplacian_singlebuffer_size(width, height) / basebuffer);
     tiling->overhead = 0;
@@ -299,11 +303,17 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 
   if(d->mode == s_mode_bilateral)
   {
-    dt_bilateral_t *b = dt_bilateral_init(roi_in->width, roi_in->height, sigma_s, sigma_r);
-    dt_bilateral_splat(b, (float *)i);
-    dt_bilateral_blur(b);
-    dt_bilateral_slice(b, (float *)i, (float *)o, d->detail);
-    dt_bilateral_free(b);
+    // the grid does not depend on detail, so it is reused while that slider is dragged.
+    // tiles keep a private grid.
+    const uint64_t hash = piece->pipe->tiling ? 0 : dt_dev_pixelpipe_cache_hash_input(piece, roi_in);
+    dt_bilateral_t *b
+        = dt_bilateral_acquire(piece->pipe, hash, (float *)i, roi_in->width, roi_in->height, sigma_s,
+                               sigma_r);
+    if(b)
+    {
+      dt_bilateral_slice(b, (float *)i, (float *)o, d->detail);
+      dt_bilateral_release(b);
+    }
   }
   else // s_mode_local_laplacian
   {
@@ -328,11 +338,17 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
   if(d->mode == s_mode_bilateral)
   {
-    dt_bilateral_t *b = dt_bilateral_init(roi_in->width, roi_in->height, sigma_s, sigma_r);
-    dt_bilateral_splat(b, (float *)i);
-    dt_bilateral_blur(b);
-    dt_bilateral_slice(b, (float *)i, (float *)o, d->detail);
-    dt_bilateral_free(b);
+    // the grid does not depend on detail, so it is reused while that slider is dragged.
+    // tiles keep a private grid.
+    const uint64_t hash = piece->pipe->tiling ? 0 : dt_dev_pixelpipe_cache_hash_input(piece, roi_in);
+    dt_bilateral_t *b
+        = dt_bilateral_acquire(piece->pipe, hash, (float *)i, roi_in->width, roi_in->height, sigma_s,
+                               sigma_r);
+    if(b)
+    {
+      dt_bilateral_slice(b, (float *)i, (float *)o, d->detail);
+      dt_bilateral_release(b);
+    }
   }
   else // s_mode_local_laplacian
   {
@@ -39,25 +39,36 @@
 
 #define ROUND_POSISTIVE(f) ((unsigned int)((f)+0.5))
 
-DT_MODULE(1)
+#define BINS (256)
+
+DT_MODULE(2)
+
+typedef enum dt_iop_rlce_method_t
+{
+  DT_RLCE_METHOD_EXACT = 0, // histogram of the window around every pixel
+  DT_RLCE_METHOD_TILED = 1  // histograms of tiles, mapping interpolated in between
+} dt_iop_rlce_method_t;
 
 typedef struct dt_iop_rlce_params_t
 {
   double radius;
   double slope;
+  dt_iop_rlce_method_t method;
 } dt_iop_rlce_params_t;
 
 typedef struct dt_iop_rlce_gui_data_t
 {
   GtkBox *vbox1, *vbox2;
-  GtkWidget *label1, *label2;
+  GtkWidget *label1, *label2, *label3;
   GtkWidget *scale1, *scale2; // radie pixels, slope
+  GtkWidget *method;
 } dt_iop_rlce_gui_data_t;
 
 typedef struct dt_iop_rlce_data_t
 {
   double radius;
   double slope;
+  dt_iop_rlce_method_t method;
 } dt_iop_rlce_data_t;
 
 
@@ -81,6 +92,213 @@ int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
   return iop_cs_rgb;
 }
 
+int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version, void *new_params,
+                  const int new_version)
+{
+  if(old_version == 1 && new_version == 2)
+  {
+    typedef struct dt_iop_rlce_params_v1_t
+    {
+      double radius;
+      double slope;
+    } dt_iop_rlce_params_v1_t;
+
+    const dt_iop_rlce_params_v1_t *o = old_params;
+    dt_iop_rlce_params_t *n = new_params;
+
+    n->radius = o->radius;
+    n->slope = o->slope;
+    n->method = DT_RLCE_METHOD_EXACT; // keep old edits looking exactly the same
+
+    return 0;
+  }
+  return 1;
+}
+
+/* clip histogram and redistribute clipped entries */
+static void clip_histogram(int *const clippedhist, const int limit)
+{
+  int ce = 0, ceb = 0;
+  do
+  {
+    ceb = ce;
+    ce = 0;
+    for(int b = 0; b <= BINS; b++)
+    {
+      int d = clippedhist[b] - limit;
+      if(d > 0)
+      {
+        ce += d;
+        clippedhist[b] = limit;
+      }
+    }
+
+    int d = (ce / (float)(BINS + 1));
+    int m = ce % (BINS + 1);
+    for(int b = 0; b <= BINS; b++) clippedhist[b] += d;
+
+    if(m != 0)
+    {
+      int s = BINS / (float)m;
+      for(int b = 0; b <= BINS; b += s) ++clippedhist[b];
+    }
+  } while(ce != ceb);
+}
+
+static inline void apply_row(const float *in, float *out, const float *const dest, const int width,
+                             const int ch)
+{
+  for(int r = 0; r < width; r++)
+  {
+    float H, S, L;
+    rgb2hsl(in, &H, &S, &L);
+    // hsl2rgb(out,H,S,( L / dest[r] ) * (L-lsmin) + lsmin );
+    hsl2rgb(out, H, S, dest[r]);
+    out += ch;
+    in += ch;
+  }
+}
+
+/* the tiles form a grid anchored at the origin of the image, in the coordinates of the
+ * scaled image which rois are given in. they are as large as the window in the full
+ * image, so that the darkroom, its preview and the export all see the same tiles
+ * wherever they look at the image, and the mapping doesn't move while panning. */
+static float tile_size(const dt_iop_rlce_data_t *const d, const dt_dev_pixelpipe_iop_t *const piece,
+                       const float scale)
+{
+  return MAX(MAX(2.0f * d->radius / piece->iscale + 1.0f, 16.0f) * scale, 4.0f);
+}
+
+// first pixel of tile k along an axis, by pixel centers
+static inline int tile_start(const int k, const float tile)
+{
+  return (int)ceilf(k * tile - 0.5f);
+}
+
+static inline int tile_of(const int pixel, const float tile)
+{
+  return (int)floorf((pixel + 0.5f) / tile);
+}
+
+void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                   const dt_iop_roi_t *const roi_out, dt_iop_roi_t *roi_in)
+{
+  const dt_iop_rlce_data_t *const d = (dt_iop_rlce_data_t *)piece->data;
+  *roi_in = *roi_out;
+  if(d->method != DT_RLCE_METHOD_TILED) return;
+
+  // whole tiles, and those next to them which the pixels at the border interpolate with
+  const float tile = tile_size(d, piece, roi_out->scale);
+  const int full_width = floorf(piece->buf_in.width * roi_out->scale);
+  const int full_height = floorf(piece->buf_in.height * roi_out->scale);
+  const int x0 = MAX(0, tile_start(tile_of(roi_out->x, tile) - 1, tile));
+  const int y0 = MAX(0, tile_start(tile_of(roi_out->y, tile) - 1, tile));
+  const int x1 = MIN(full_width, tile_start(tile_of(roi_out->x + roi_out->width - 1, tile) + 2, tile));
+  const int y1 = MIN(full_height, tile_start(tile_of(roi_out->y + roi_out->height - 1, tile) + 2, tile));
+
+  // never less than what is asked for, even if the image is smaller at this scale
+  roi_in->x = MIN(x0, roi_out->x);
+  roi_in->y = MIN(y0, roi_out->y);
+  roi_in->width = MAX(x1, roi_out->x + roi_out->width) - roi_in->x;
+  roi_in->height = MAX(y1, roi_out->y + roi_out->height) - roi_in->y;
+}
+
+/* contrast limited adaptive histogram equalization of tiles of the size of the
+ * window: the clipped histogram and its mapping are computed once per tile, and
+ * every pixel interpolates bilinearly between the mappings of the four tiles
+ * around it. the cost per pixel doesn't depend on radius and bins any more.
+ * luminance and ivoid cover roi_in, ovoid covers roi_out. */
+static void process_tiled(const float *const luminance, const float *const ivoid, float *const ovoid,
+                          const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out, const int ch,
+                          const float tile, const float slope)
+{
+  const int width = roi_in->width;
+  const int height = roi_in->height;
+  // the tiles of the grid which roi_in has a part of
+  const int kx0 = tile_of(roi_in->x, tile), ky0 = tile_of(roi_in->y, tile);
+  const int tiles_x = tile_of(roi_in->x + width - 1, tile) - kx0 + 1;
+  const int tiles_y = tile_of(roi_in->y + height - 1, tile) - ky0 + 1;
+  float *const luts = dt_alloc_align(64, sizeof(float) * (BINS + 1) * tiles_x * tiles_y);
+  const size_t destbuf_size = roi_out->width;
+  float *const dest_buf = dt_alloc_align(64, sizeof(float) * destbuf_size * dt_get_num_threads());
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(height, kx0, ky0, luminance, luts, roi_in, slope, tile, tiles_x, tiles_y, width) \
+  schedule(dynamic)
+#endif
+  for(int t = 0; t < tiles_x * tiles_y; t++)
+  {
+    const int kx = kx0 + t % tiles_x, ky = ky0 + t / tiles_x;
+    const int x0 = MAX(0, tile_start(kx, tile) - roi_in->x);
+    const int x1 = MIN(width, tile_start(kx + 1, tile) - roi_in->x);
+    const int y0 = MAX(0, tile_start(ky, tile) - roi_in->y);
+    const int y1 = MIN(height, tile_start(ky + 1, tile) - roi_in->y);
+
+    int hist[BINS + 1] = { 0 };
+    for(int yi = y0; yi < y1; yi++)
+      for(int xi = x0; xi < x1; xi++)
+        ++hist[ROUND_POSISTIVE(luminance[(size_t)yi * width + xi] * (float)BINS)];
+
+    const int n = MAX(x1 - x0, 0) * MAX(y1 - y0, 0);
+    clip_histogram(hist, (int)(slope * n / BINS + 0.5f));
+
+    int hMin = 0;
+    while(hMin < BINS && hist[hMin] == 0) hMin++;
+    int cdfMax = 0;
+    for(int b = hMin; b <= BINS; b++) cdfMax += hist[b];
+    const int cdfMin = hist[hMin];
+
+    // a tile of a single value has nothing to equalize
+    float *const lut = luts + (size_t)t * (BINS + 1);
+    int cdf = 0;
+    for(int b = 0; b <= BINS; b++)
+    {
+      if(b >= hMin) cdf += hist[b];
+      lut[b] = (cdfMax > cdfMin) ? MAX(cdf - cdfMin, 0) / (float)(cdfMax - cdfMin) : b / (float)BINS;
+    }
+  }
+
+  const int dx = roi_out->x - roi_in->x, dy = roi_out->y - roi_in->y;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, dest_buf, destbuf_size, dx, dy, ivoid, kx0, ky0, luminance, luts, ovoid, roi_out, \
+                      tile, tiles_x, tiles_y, width) \
+  schedule(static)
+#endif
+  for(int j = 0; j < roi_out->height; j++)
+  {
+    // tile centers are at (k + 0.5) * tile
+    const float fy = (roi_out->y + j + 0.5f) / tile - 0.5f - ky0;
+    const int ty0 = CLAMPS((int)floorf(fy), 0, tiles_y - 1);
+    const int ty1 = MIN(ty0 + 1, tiles_y - 1);
+    const float wy = CLAMPS(fy - ty0, 0.0f, 1.0f);
+
+    const float *const lm = luminance + (size_t)(j + dy) * width + dx;
+    float *dest = dest_buf + destbuf_size * dt_get_thread_num();
+    for(int i = 0; i < roi_out->width; i++)
+    {
+      const float fx = (roi_out->x + i + 0.5f) / tile - 0.5f - kx0;
+      const int tx0 = CLAMPS((int)floorf(fx), 0, tiles_x - 1);
+      const int tx1 = MIN(tx0 + 1, tiles_x - 1);
+      const float wx = CLAMPS(fx - tx0, 0.0f, 1.0f);
+
+      const int v = ROUND_POSISTIVE(lm[i] * (float)BINS);
+      const float *const l0 = luts + (size_t)ty0 * tiles_x * (BINS + 1) + v;
+      const float *const l1 = luts + (size_t)ty1 * tiles_x * (BINS + 1) + v;
+      const float top = (1.0f - wx) * l0[tx0 * (BINS + 1)] + wx * l0[tx1 * (BINS + 1)];
+      const float bottom = (1.0f - wx) * l1[tx0 * (BINS + 1)] + wx * l1[tx1 * (BINS + 1)];
+      dest[i] = (1.0f - wy) * top + wy * bottom;
+    }
+
+    apply_row(ivoid + ((size_t)(j + dy) * width + dx) * ch, ovoid + (size_t)j * roi_out->width * ch, dest,
+              roi_out->width, ch);
+  }
+
+  dt_free_align(dest_buf);
+  dt_free_align(luts);
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -88,19 +306,19 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const int ch = piece->colors;
 
   // PASS1: Get a luminance map of image...
-  float *luminance = (float *)malloc(((size_t)roi_out->width * roi_out->height) * sizeof(float));
+  float *luminance = (float *)malloc(((size_t)roi_in->width * roi_in->height) * sizeof(float));
 // double lsmax=0.0,lsmin=1.0;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ch, ivoid, roi_out) \
+  dt_omp_firstprivate(ch, ivoid, roi_in) \
   shared(luminance) \
   schedule(static)
 #endif
-  for(int j = 0; j < roi_out->height; j++)
+  for(int j = 0; j < roi_in->height; j++)
   {
-    float *in = (float *)ivoid + (size_t)j * roi_out->width * ch;
-    float *lm = luminance + (size_t)j * roi_out->width;
-    for(int i = 0; i < roi_out->width; i++)
+    float *in = (float *)ivoid + (size_t)j * roi_in->width * ch;
+    float *lm = luminance + (size_t)j * roi_in->width;
+    for(int i = 0; i < roi_in->width; i++)
     {
       double pmax = CLIP(fmax(in[0], fmax(in[1], in[2]))); // Max value in RGB set
       double pmin = CLIP(fmin(in[0], fmin(in[1], in[2]))); // Min value in RGB set
@@ -114,10 +332,16 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   // Params
   const int rad = data->radius * roi_in->scale / piece->iscale;
 
-#define BINS (256)
-
   const float slope = data->slope;
 
+  if(data->method == DT_RLCE_METHOD_TILED)
+  {
+    process_tiled(luminance, (const float *)ivoid, (float *)ovoid, roi_in, roi_out, ch,
+                  tile_size(data, piece, roi_in->scale), slope);
+    free(luminance);
+    return;
+  }
+
   const size_t destbuf_size = roi_out->width;
   float *const dest_buf = malloc(destbuf_size * sizeof(float) * dt_get_num_threads());
 
@@ -181,33 +405,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
           ++hist[ROUND_POSISTIVE(luminance[(size_t)yi * roi_in->width + xMax1] * (float)BINS)];
       }
 
-      /* clip histogram and redistribute clipped entries */
       memcpy(clippedhist, hist, (BINS + 1) * sizeof(int));
-      int ce = 0, ceb = 0;
-      do
-      {
-        ceb = ce;
-        ce = 0;
-        for(int b = 0; b <= BINS; b++)
-        {
-          int d = clippedhist[b] - limit;
-          if(d > 0)
-          {
-            ce += d;
-            clippedhist[b] = limit;
-          }
-        }
-
-        int d = (ce / (float)(BINS + 1));
-        int m = ce % (BINS + 1);
-        for(int b = 0; b <= BINS; b++) clippedhist[b] += d;
-
-        if(m != 0)
-        {
-          int s = BINS / (float)m;
-          for(int b = 0; b <= BINS; b += s) ++clippedhist[b];
-        }
-      } while(ce != ceb);
+      clip_histogram(clippedhist, limit);
 
       /* build cdf of clipped histogram */
       unsigned int hMin = BINS;
@@ -228,26 +427,14 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     }
 
     // Apply row
-    float *in = ((float *)ivoid) + (size_t)j * roi_out->width * ch;
-    float *out = ((float *)ovoid) + (size_t)j * roi_out->width * ch;
-    for(int r = 0; r < roi_out->width; r++)
-    {
-      float H, S, L;
-      rgb2hsl(in, &H, &S, &L);
-      // hsl2rgb(out,H,S,( L / dest[r] ) * (L-lsmin) + lsmin );
-      hsl2rgb(out, H, S, dest[r]);
-      out += ch;
-      in += ch;
-      ld++;
-    }
+    apply_row(((float *)ivoid) + (size_t)j * roi_out->width * ch, ((float *)ovoid) + (size_t)j * roi_out->width * ch,
+              dest, roi_out->width, ch);
   }
 
   free(dest_buf);
 
   // Cleanup
   free(luminance);
-
-#undef BINS
 }
 
 static void radius_callback(GtkWidget *slider, gpointer user_data)
@@ -259,6 +446,15 @@ static void radius_callback(GtkWidget *slider, gpointer user_data)
   dt_dev_add_history_item(darktable.develop, self, TRUE);
 }
 
+static void method_callback(GtkWidget *widget, gpointer user_data)
+{
+  dt_iop_module_t *self = (dt_iop_module_t *)user_data;
+  if(self->dt->gui->reset) return;
+  dt_iop_rlce_params_t *p = (dt_iop_rlce_params_t *)self->params;
+  p->method = dt_bauhaus_combobox_get(widget);
+  dt_dev_add_history_item(darktable.develop, self, TRUE);
+}
+
 static void slope_callback(GtkWidget *slider, gpointer user_data)
 {
   dt_iop_module_t *self = (dt_iop_module_t *)user_data;
@@ -278,6 +474,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   d->radius = p->radius;
   d->slope = p->slope;
+  d->method = p->method;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -299,6 +496,7 @@ void gui_update(struct dt_iop_module_t *self)
   dt_iop_rlce_params_t *p = (dt_iop_rlce_params_t *)module->params;
   dt_bauhaus_slider_set(g->scale1, p->radius);
   dt_bauhaus_slider_set(g->scale2, p->slope);
+  dt_bauhaus_combobox_set(g->method, p->method);
 }
 
 void init(dt_iop_module_t *module)
@@ -308,7 +506,7 @@ void init(dt_iop_module_t *module)
   module->default_enabled = 0;
   module->params_size = sizeof(dt_iop_rlce_params_t);
   module->gui_data = NULL;
-  dt_iop_rlce_params_t tmp = (dt_iop_rlce_params_t){ 64, 1.25 };
+  dt_iop_rlce_params_t tmp = (dt_iop_rlce_params_t){ 64, 1.25, DT_RLCE_METHOD_TILED };
   memcpy(module->params, &tmp, sizeof(dt_iop_rlce_params_t));
   memcpy(module->default_params, &tmp, sizeof(dt_iop_rlce_params_t));
 }
@@ -352,6 +550,16 @@ void gui_init(struct dt_iop_module_t *self)
 
   g_signal_connect(G_OBJECT(g->scale1), "value-changed", G_CALLBACK(radius_callback), self);
   g_signal_connect(G_OBJECT(g->scale2), "value-changed", G_CALLBACK(slope_callback), self);
+
+  g->label3 = dtgtk_reset_label_new(_("method"), self, &p->method, sizeof(p->method));
+  gtk_box_pack_start(GTK_BOX(g->vbox1), g->label3, TRUE, TRUE, 0);
+  g->method = dt_bauhaus_combobox_new(self);
+  dt_bauhaus_combobox_add(g->method, _("exact"));
+  dt_bauhaus_combobox_add(g->method, _("fast"));
+  gtk_widget_set_tooltip_text(g->method, _("exact equalizes the window around every pixel,\n"
+                                           "fast equalizes tiles and blends between them"));
+  gtk_box_pack_start(GTK_BOX(g->vbox2), g->method, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(g->method), "value-changed", G_CALLBACK(method_callback), self);
 }
 
 void gui_cleanup(struct dt_iop_module_t *self)
@@ -2849,6 +2849,107 @@ static int demosaic_qual_flags(const dt_dev_pixelpipe_iop_t *const piece,
   return flags;
 }
 
+// full resolution rows demosaiced per band when downscaling
+#define DEMOSAIC_BAND_ROWS 512
+// bands start on a multiple of the bayer (8 rows in dcraw filters) and x-trans (6) periods
+#define DEMOSAIC_BAND_ALIGN 24
+
+// rows of context on either side of a band so that its inner rows come out exactly as in a
+// full frame demosaic. 0 if the method has to see the full frame.
+static int demosaic_band_margin(const dt_image_t *img, const uint32_t filters, const int method,
+                                const int qual_flags)
+{
+  if(method == DT_IOP_DEMOSAIC_PASSTHROUGH_MONOCHROME || (img->flags & DT_IMAGE_4BAYER)) return 0;
+
+  if(filters == 9u)
+  {
+    if(method == DT_IOP_DEMOSAIC_FDC && (qual_flags & DEMOSAIC_XTRANS_FULL)) return 0;
+    if(method >= DT_IOP_DEMOSAIC_MARKESTEIJN && (qual_flags & DEMOSAIC_XTRANS_FULL)) return 24; // pad_tile is 17
+    return 8;
+  }
+
+  if(method == DT_IOP_DEMOSAIC_AMAZE) return 32; // 16 pixel tile borders
+  return 8;
+}
+
+static void demosaic_band(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *const out,
+                          const float *const in, const dt_iop_roi_t *const roo, const dt_iop_roi_t *const roi,
+                          const int method, const int qual_flags)
+{
+  const dt_iop_demosaic_data_t *const data = (dt_iop_demosaic_data_t *)piece->data;
+  const uint32_t filters = piece->pipe->dsc.filters;
+  const uint8_t(*const xtrans)[6] = (const uint8_t(*const)[6])piece->pipe->dsc.xtrans;
+
+  if(filters == 9u)
+  {
+    if(method >= DT_IOP_DEMOSAIC_MARKESTEIJN && (qual_flags & DEMOSAIC_XTRANS_FULL))
+      xtrans_markesteijn_interpolate(out, in, roo, roi, xtrans, 1 + (method - DT_IOP_DEMOSAIC_MARKESTEIJN) * 2);
+    else
+      vng_interpolate(out, in, roo, roi, filters, xtrans, qual_flags & DEMOSAIC_ONLY_VNG_LINEAR);
+  }
+  else if(method == DT_IOP_DEMOSAIC_VNG4)
+    vng_interpolate(out, in, roo, roi, filters, xtrans, qual_flags & DEMOSAIC_ONLY_VNG_LINEAR);
+  else if(method != DT_IOP_DEMOSAIC_AMAZE)
+    demosaic_ppg(out, in, roo, roi, filters, data->median_thrs);
+  else
+    amaze_demosaic_RT(self, piece, in, out, roi, roo, filters);
+}
+
+// demosaic roi_in in horizontal bands and resample each band into the output right away, so the
+// full resolution image never exists in memory. gives the same result as demosaicing all of roi_in
+// followed by dt_iop_clip_and_zoom_roi().
+static void demosaic_zoom_bands(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *const out,
+                                const float *const in, const dt_iop_roi_t *const roi_in,
+                                const dt_iop_roi_t *const roi_out, const int method, const int qual_flags,
+                                const int margin)
+{
+  const struct dt_interpolation *itor = dt_interpolation_new(DT_INTERPOLATION_USERPREF);
+  const float scale = roi_out->scale;
+  const int width = roi_in->width, height = roi_in->height;
+
+  const int band_out = MAX(1, (int)(DEMOSAIC_BAND_ROWS * scale));
+  // input rows reached by the downsampling kernel beyond the projected output rows,
+  // see compute_downsampling_kernel() in interpolation.c
+  const int reach = (int)ceilf(itor->width / scale) + 2;
+  const int max_rows
+      = MIN(height, (int)ceilf(band_out / scale) + 2 * reach + 2 * margin + DEMOSAIC_BAND_ALIGN);
+
+  float *tmp = (float *)dt_alloc_align(64, (size_t)width * max_rows * 4 * sizeof(float));
+  if(!tmp)
+  {
+    fprintf(stderr, "[demosaic] not able to allocate band buffer\n");
+    return;
+  }
+
+  const dt_iop_roi_t full = { 0, 0, width, height, 1.0f };
+
+  for(int oy0 = 0; oy0 < roi_out->height; oy0 += band_out)
+  {
+    const int oy1 = MIN(oy0 + band_out, roi_out->height);
+
+    // rows the resampling of [oy0, oy1) reads, clamped to the frame like its border mode
+    const int need0 = CLAMP((int)floorf((oy0 - itor->width) / scale) - 1, 0, height - 1);
+    const int need1 = CLAMP((int)ceilf((oy1 - 1 + itor->width) / scale) + 2, need0 + 1, height);
+
+    int y0 = MAX(0, need0 - margin);
+    y0 -= y0 % DEMOSAIC_BAND_ALIGN;
+    const int y1 = MIN(height, MIN(need1 + margin, y0 + max_rows));
+
+    const dt_iop_roi_t roi = { roi_in->x, roi_in->y + y0, width, y1 - y0, 1.0f };
+    const dt_iop_roi_t roo = { 0, 0, width, y1 - y0, 1.0f };
+    demosaic_band(self, piece, tmp, in + (size_t)y0 * width, &roo, &roi, method, qual_flags);
+
+    // resample against the full frame geometry, the band holds all rows this touches.
+    // tmp is addressed as if it started at row 0 of the frame.
+    const dt_iop_roi_t band_out_roi = { 0, oy0, roi_out->width, oy1 - oy0, scale };
+    dt_interpolation_resample(itor, out + (size_t)4 * oy0 * roi_out->width, &band_out_roi,
+                              roi_out->width * 4 * sizeof(float), tmp - (size_t)4 * y0 * width, &full,
+                              width * 4 * sizeof(float));
+  }
+
+  dt_free_align(tmp);
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const i, void *const o,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -2877,8 +2978,12 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   {
     // Full demosaic and then scaling if needed
     const int scaled = (roi_out->width != roi_in->width || roi_out->height != roi_in->height);
+    // when downscaling, demosaic in bands and zoom each band into the output directly
+    const int margin = (scaled && roi_out->scale < 1.0f)
+                           ? demosaic_band_margin(img, piece->pipe->dsc.filters, demosaicing_method, qual_flags)
+                           : 0;
     float *tmp = (float *) o;
-    if(scaled)
+    if(scaled && !margin)
     {
       // demosaic and then clip and zoom
       // we demosaic at 1:1 the size of input roi, so make sure
@@ -2895,7 +3000,10 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     }
     else if(piece->pipe->dsc.filters == 9u)
     {
-      if(demosaicing_method == DT_IOP_DEMOSAIC_FDC && (qual_flags & DEMOSAIC_XTRANS_FULL))
+      if(margin)
+        demosaic_zoom_bands(self, piece, (float *)o, pixels, roi_in, roi_out, demosaicing_method, qual_flags,
+                            margin);
+      else if(demosaicing_method == DT_IOP_DEMOSAIC_FDC && (qual_flags & DEMOSAIC_XTRANS_FULL))
         xtrans_fdc_interpolate(self, tmp, pixels, &roo, &roi, xtrans);
       else if(demosaicing_method >= DT_IOP_DEMOSAIC_MARKESTEIJN && (qual_flags & DEMOSAIC_XTRANS_FULL))
         xtrans_markesteijn_interpolate(tmp, pixels, &roo, &roi, xtrans,
@@ -2932,7 +3040,9 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
         }
       }
 
-      if(demosaicing_method == DT_IOP_DEMOSAIC_VNG4 || (img->flags & DT_IMAGE_4BAYER))
+      if(margin)
+        demosaic_zoom_bands(self, piece, (float *)o, in, roi_in, roi_out, demosaicing_method, qual_flags, margin);
+      else if(demosaicing_method == DT_IOP_DEMOSAIC_VNG4 || (img->flags & DT_IMAGE_4BAYER))
       {
         vng_interpolate(tmp, in, &roo, &roi, piece->pipe->dsc.filters, xtrans, qual_flags & DEMOSAIC_ONLY_VNG_LINEAR);
         if (img->flags & DT_IMAGE_4BAYER)
@@ -2950,7 +3060,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       if(!(img->flags & DT_IMAGE_4BAYER) && data->green_eq != DT_IOP_GREEN_EQ_NO) dt_free_align(in);
     }
 
-    if(scaled)
+    if(scaled && !margin)
     {
       roi = *roi_out;
       dt_iop_clip_and_zoom_roi((float *)o, tmp, &roi, &roo, roi.width, roo.width);
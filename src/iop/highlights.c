@@ -864,6 +864,25 @@ static void process_clip(dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
     dt_unreachable_codepath();
 }
 
+int fuse_raw_frontend(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, dt_iop_raw_frontend_t *fe,
+                      dt_iop_buffer_dsc_t *dsc, const dt_iop_roi_t *const roi_in,
+                      const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_highlights_data_t *const data = (dt_iop_highlights_data_t *)piece->data;
+
+  // reconstruction needs the neighbourhood, only clipping is point-wise
+  if(!dsc->filters || data->mode != DT_IOP_HIGHLIGHTS_CLIP) return 1;
+
+  const float clip
+      = data->clip * fminf(dsc->processed_maximum[0], fminf(dsc->processed_maximum[1], dsc->processed_maximum[2]));
+  fe->clip = fminf(fe->clip, clip);
+
+  const float m = fmaxf(fmaxf(dsc->processed_maximum[0], dsc->processed_maximum[1]), dsc->processed_maximum[2]);
+  for(int k = 0; k < 3; k++) dsc->processed_maximum[k] = m;
+
+  return 0;
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -46,6 +46,7 @@ struct dt_dev_pixelpipe_iop_t;
 struct dt_iop_roi_t;
 struct dt_develop_tiling_t;
 struct dt_iop_buffer_dsc_t;
+struct dt_iop_raw_frontend_t;
 
 #ifndef DT_IOP_PARAMS_T
 #define DT_IOP_PARAMS_T
@@ -215,6 +216,13 @@ int distort_backtransform(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_
 void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                   float *const out, const struct dt_iop_roi_t *const roi_in, const struct dt_iop_roi_t *const roi_out);
 
+/** point-wise modules on the raw mosaic (rawprepare, temperature, highlights) can describe their
+ * work in fe and apply the side effects of process() on the pipe format dsc instead. the pipe then
+ * runs the whole chain as one pass. return non-zero if the current parameters can't be fused. */
+int fuse_raw_frontend(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                      struct dt_iop_raw_frontend_t *fe, struct dt_iop_buffer_dsc_t *dsc,
+                      const struct dt_iop_roi_t *const roi_in, const struct dt_iop_roi_t *const roi_out);
+
 // introspection related callbacks, will be auto-implemented if DT_MODULE_INTROSPECTION() is used,
 int introspection_init(struct dt_iop_module_so_t *self, int api_version);
 dt_introspection_t *get_introspection(void);
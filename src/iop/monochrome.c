@@ -195,11 +195,23 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const float sigma_s = 20.0f / scale;
   const float detail = -1.0f; // bilateral base layer
 
-  dt_bilateral_t *b = dt_bilateral_init(roi_in->width, roi_in->height, sigma_s, sigma_r);
-  dt_bilateral_splat(b, (float *)o);
-  dt_bilateral_blur(b);
-  dt_bilateral_slice(b, (float *)o, (float *)o, detail);
-  dt_bilateral_free(b);
+  // the filter response only depends on the input and the filter itself, not on the
+  // highlights, so the grid is reused while those are adjusted. tiles keep a private grid.
+  uint64_t hash = 0;
+  if(!piece->pipe->tiling)
+  {
+    hash = dt_dev_pixelpipe_cache_hash_input(piece, roi_in);
+    const float filter[3] = { d->a, d->b, d->size };
+    const char *str = (const char *)filter;
+    for(size_t k = 0; k < sizeof(filter); k++) hash = ((hash << 5) + hash) ^ str[k];
+  }
+  dt_bilateral_t *b
+      = dt_bilateral_acquire(piece->pipe, hash, (float *)o, roi_in->width, roi_in->height, sigma_s, sigma_r);
+  if(b)
+  {
+    dt_bilateral_slice(b, (float *)o, (float *)o, detail);
+    dt_bilateral_release(b);
+  }
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
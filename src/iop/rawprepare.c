@@ -278,14 +278,14 @@ void output_format(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixel
   dsc->rawprepare.raw_white_point = d->rawprepare.raw_white_point;
 }
 
-static void adjust_xtrans_filters(dt_dev_pixelpipe_t *pipe,
+static void adjust_xtrans_filters(dt_dev_pixelpipe_t *pipe, dt_iop_buffer_dsc_t *dsc,
                                   uint32_t crop_x, uint32_t crop_y)
 {
   for(int i = 0; i < 6; ++i)
   {
     for(int j = 0; j < 6; ++j)
     {
-      pipe->dsc.xtrans[j][i] = pipe->image.buf_dsc.xtrans[(j + crop_y) % 6][(i + crop_x) % 6];
+      dsc->xtrans[j][i] = pipe->image.buf_dsc.xtrans[(j + crop_y) % 6][(i + crop_x) % 6];
     }
   }
 }
@@ -296,6 +296,38 @@ static int BL(const dt_iop_roi_t *const roi_out, const dt_iop_rawprepare_data_t
   return ((((row + roi_out->y + d->y) & 1) << 1) + ((col + roi_out->x + d->x) & 1));
 }
 
+int fuse_raw_frontend(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, dt_iop_raw_frontend_t *fe,
+                      dt_iop_buffer_dsc_t *dsc, const dt_iop_roi_t *const roi_in,
+                      const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_rawprepare_data_t *const d = (dt_iop_rawprepare_data_t *)piece->data;
+
+  // only the raw mosaic paths of process() are point-wise
+  if(!dsc->filters || piece->dsc_in.channels != 1
+     || (piece->dsc_in.datatype != TYPE_UINT16 && piece->dsc_in.datatype != TYPE_FLOAT))
+    return 1;
+
+  fe->csx = compute_proper_crop(piece, roi_in, d->x);
+  fe->csy = compute_proper_crop(piece, roi_in, d->y);
+
+  for(int j = 0; j < 6; j++)
+  {
+    for(int i = 0; i < 6; i++)
+    {
+      const int id = BL(roi_out, d, j, i);
+      fe->sub[j][i] = d->sub[id];
+      fe->div[j][i] = d->div[id];
+    }
+  }
+
+  dsc->filters = dt_rawspeed_crop_dcraw_filters(self->dev->image_storage.buf_dsc.filters, fe->csx, fe->csy);
+  adjust_xtrans_filters(piece->pipe, dsc, fe->csx, fe->csy);
+
+  for(int k = 0; k < 4; k++) dsc->processed_maximum[k] = 1.0f;
+
+  return 0;
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -331,7 +363,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     }
 
     piece->pipe->dsc.filters = dt_rawspeed_crop_dcraw_filters(self->dev->image_storage.buf_dsc.filters, csx, csy);
-    adjust_xtrans_filters(piece->pipe, csx, csy);
+    adjust_xtrans_filters(piece->pipe, &piece->pipe->dsc, csx, csy);
   }
   else if(piece->pipe->dsc.filters && piece->dsc_in.channels == 1 && piece->dsc_in.datatype == TYPE_FLOAT)
   { // raw mosaic, fp, unnormalized
@@ -358,7 +390,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     }
 
     piece->pipe->dsc.filters = dt_rawspeed_crop_dcraw_filters(self->dev->image_storage.buf_dsc.filters, csx, csy);
-    adjust_xtrans_filters(piece->pipe, csx, csy);
+    adjust_xtrans_filters(piece->pipe, &piece->pipe->dsc, csx, csy);
   }
   else
   { // pre-downsampled buffer that needs black/white scaling
@@ -463,7 +495,7 @@ void process_sse2(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const vo
     }
 
     piece->pipe->dsc.filters = dt_rawspeed_crop_dcraw_filters(self->dev->image_storage.buf_dsc.filters, csx, csy);
-    adjust_xtrans_filters(piece->pipe, csx, csy);
+    adjust_xtrans_filters(piece->pipe, &piece->pipe->dsc, csx, csy);
   }
   else if(piece->pipe->dsc.filters && piece->dsc_in.channels == 1 && piece->dsc_in.datatype == TYPE_FLOAT)
   { // raw mosaic, fp, unnormalized
@@ -514,7 +546,7 @@ void process_sse2(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const vo
     }
 
     piece->pipe->dsc.filters = dt_rawspeed_crop_dcraw_filters(self->dev->image_storage.buf_dsc.filters, csx, csy);
-    adjust_xtrans_filters(piece->pipe, csx, csy);
+    adjust_xtrans_filters(piece->pipe, &piece->pipe->dsc, csx, csy);
   }
   else
   { // pre-downsampled buffer that needs black/white scaling
@@ -607,7 +639,7 @@ int process_cl(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_
   if(piece->pipe->dsc.filters)
   {
     piece->pipe->dsc.filters = dt_rawspeed_crop_dcraw_filters(self->dev->image_storage.buf_dsc.filters, csx, csy);
-    adjust_xtrans_filters(piece->pipe, csx, csy);
+    adjust_xtrans_filters(piece->pipe, &piece->pipe->dsc, csx, csy);
   }
 
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = 1.0f;
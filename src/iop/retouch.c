@@ -4044,45 +4044,69 @@ static void retouch_fill(float *const in, dt_iop_roi_t *const roi_in, const int
   }
 }
 
+// temp images of a thread, kept for all the forms it processes
+typedef struct rt_scratch_t
+{
+  float *buf[2];
+  size_t size;
+} rt_scratch_t;
+
+// makes sure both temp images have room for size floats
+static int rt_scratch_reserve(rt_scratch_t *const scratch, const size_t size)
+{
+  if(scratch->size >= size) return 1;
+
+  for(int k = 0; k < 2; k++)
+  {
+    if(scratch->buf[k]) dt_free_align(scratch->buf[k]);
+    scratch->buf[k] = dt_alloc_align(64, size * sizeof(float));
+  }
+  scratch->size = (scratch->buf[0] && scratch->buf[1]) ? size : 0;
+  return scratch->size != 0;
+}
+
+static void rt_scratch_free(rt_scratch_t *const scratch)
+{
+  for(int k = 0; k < 2; k++)
+    if(scratch->buf[k]) dt_free_align(scratch->buf[k]);
+  memset(scratch, 0, sizeof(rt_scratch_t));
+}
+
 static void retouch_clone(float *const in, dt_iop_roi_t *const roi_in, const int ch, float *const mask_scaled,
                           dt_iop_roi_t *const roi_mask_scaled, const int dx, const int dy, const float opacity,
-                          const int use_sse)
+                          rt_scratch_t *const scratch, const int use_sse)
 {
-  // alloc temp image to avoid issues when areas self-intersects
-  float *img_src = dt_alloc_align(64, roi_mask_scaled->width * roi_mask_scaled->height * ch * sizeof(float));
-  if(img_src == NULL)
+  // temp image to avoid issues when areas self-intersects
+  if(!rt_scratch_reserve(scratch, (size_t)roi_mask_scaled->width * roi_mask_scaled->height * ch))
   {
     fprintf(stderr, "retouch_clone: error allocating memory for cloning\n");
-    goto cleanup;
+    return;
   }
+  float *const img_src = scratch->buf[0];
 
   // copy source image to tmp
   rt_copy_in_to_out(in, roi_in, img_src, roi_mask_scaled, ch, dx, dy);
 
   // clone it
   rt_copy_image_masked(img_src, in, roi_in, ch, mask_scaled, roi_mask_scaled, opacity, use_sse);
-
-cleanup:
-  if(img_src) dt_free_align(img_src);
 }
 
 static void retouch_blur(dt_iop_module_t *self, float *const in, dt_iop_roi_t *const roi_in, const int ch, float *const mask_scaled,
                          dt_iop_roi_t *const roi_mask_scaled, const float opacity, const int blur_type,
-                         const float blur_radius, dt_dev_pixelpipe_iop_t *piece, const int use_sse)
+                         const float blur_radius, dt_dev_pixelpipe_iop_t *piece, rt_scratch_t *const scratch,
+                         const int use_sse)
 {
   if(fabs(blur_radius) <= 0.1f) return;
 
   const float sigma = blur_radius * roi_in->scale / piece->iscale;
 
-  float *img_dest = NULL;
-
-  // alloc temp image to blur
-  img_dest = dt_alloc_align(64, roi_mask_scaled->width * roi_mask_scaled->height * ch * sizeof(float));
-  if(img_dest == NULL)
+  // temp image to blur
+  if(!rt_scratch_reserve(scratch, (size_t)roi_mask_scaled->width * roi_mask_scaled->height * ch))
   {
     fprintf(stderr, "retouch_blur: error allocating memory for blurring\n");
-    goto cleanup;
+    return;
   }
+  float *const img_dest = scratch->buf[0];
 
   // copy source image so we blur just the mask area (at least the smallest rect that covers it)
   rt_copy_in_to_out(in, roi_in, img_dest, roi_mask_scaled, ch, 0, 0);
@@ -4138,26 +4162,20 @@ static void retouch_blur(dt_iop_module_t *self, float *const in, dt_iop_roi_t *c
 
   // copy blurred (temp) image to destination image
   rt_copy_image_masked(img_dest, in, roi_in, ch, mask_scaled, roi_mask_scaled, opacity, use_sse);
-
-cleanup:
-  if(img_dest) dt_free_align(img_dest);
 }
 
 static void retouch_heal(float *const in, dt_iop_roi_t *const roi_in, const int ch, float *const mask_scaled,
                          dt_iop_roi_t *const roi_mask_scaled, const int dx, const int dy, const float opacity,
-                         int use_sse)
+                         rt_scratch_t *const scratch, int use_sse)
 {
-  float *img_src = NULL;
-  float *img_dest = NULL;
-
-  // alloc temp images for source and destination
-  img_src = dt_alloc_align(64, roi_mask_scaled->width * roi_mask_scaled->height * ch * sizeof(float));
-  img_dest = dt_alloc_align(64, roi_mask_scaled->width * roi_mask_scaled->height * ch * sizeof(float));
-  if((img_src == NULL) || (img_dest == NULL))
+  // temp images for source and destination
+  if(!rt_scratch_reserve(scratch, (size_t)roi_mask_scaled->width * roi_mask_scaled->height * ch))
   {
     fprintf(stderr, "retouch_heal: error allocating memory for healing\n");
-    goto cleanup;
+    return;
   }
+  float *const img_src = scratch->buf[0];
+  float *const img_dest = scratch->buf[1];
 
   // copy source and destination to temp images
   rt_copy_in_to_out(in, roi_in, img_src, roi_mask_scaled, ch, dx, dy);
@@ -4168,10 +4186,136 @@ static void retouch_heal(float *const in, dt_iop_roi_t *const roi_in, const int
 
   // copy healed (temp) image to destination image
   rt_copy_image_masked(img_dest, in, roi_in, ch, mask_scaled, roi_mask_scaled, opacity, use_sse);
+}
 
-cleanup:
-  if(img_src) dt_free_align(img_src);
-  if(img_dest) dt_free_align(img_dest);
+// a form of the current scale, with everything needed to apply it
+typedef struct rt_form_job_t
+{
+  int index; // into p->rt_forms
+  float opacity;
+  dt_masks_form_t *form;
+  dt_iop_retouch_algo_type_t algo;
+  int dx, dy;
+  float *mask_scaled; // NULL if there is nothing to do
+  dt_iop_roi_t roi_mask_scaled;
+  int wave;
+} rt_form_job_t;
+
+static inline gboolean rt_boxes_overlap(const dt_iop_roi_t *const a, const int adx, const int ady,
+                                        const dt_iop_roi_t *const b, const int bdx, const int bdy)
+{
+  return a->x - adx < b->x - bdx + b->width && b->x - bdx < a->x - adx + a->width
+         && a->y - ady < b->y - bdy + b->height && b->y - bdy < a->y - ady + a->height;
+}
+
+// a form writes the box of its scaled mask and reads it, clone and heal also read
+// the same box moved by -dx, -dy. a later form has to wait for an earlier one if
+// one of them writes where the other reads or writes.
+static gboolean rt_forms_depend(const rt_form_job_t *const earlier, const rt_form_job_t *const later)
+{
+  const gboolean earlier_src = earlier->algo == DT_IOP_RETOUCH_CLONE || earlier->algo == DT_IOP_RETOUCH_HEAL;
+  const gboolean later_src = later->algo == DT_IOP_RETOUCH_CLONE || later->algo == DT_IOP_RETOUCH_HEAL;
+  const dt_iop_roi_t *const e = &earlier->roi_mask_scaled;
+  const dt_iop_roi_t *const l = &later->roi_mask_scaled;
+
+  return rt_boxes_overlap(e, 0, 0, l, 0, 0)
+         || (later_src && rt_boxes_overlap(e, 0, 0, l, later->dx, later->dy))
+         || (earlier_src && rt_boxes_overlap(e, earlier->dx, earlier->dy, l, 0, 0));
+}
+
+// gets the mask of a form, scaled to the layer, and its distance to the source
+static void rt_prepare_form(rt_form_job_t *const job, dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                            dt_iop_retouch_params_t *p, dt_iop_roi_t *roi_layer)
+{
+  // if the form is outside the roi, we just skip it
+  if(!rt_masks_form_is_in_roi(self, piece, job->form, roi_layer, roi_layer)) return;
+
+  // get the mask
+  float *mask = NULL;
+  dt_iop_roi_t roi_mask = { 0 };
+
+  dt_masks_get_mask(self, piece, job->form, &mask, &roi_mask.width, &roi_mask.height, &roi_mask.x, &roi_mask.y);
+  if(mask == NULL)
+  {
+    fprintf(stderr, "rt_process_forms: error retrieving mask\n");
+    return;
+  }
+
+  // search the delta with the source
+  job->algo = p->rt_forms[job->index].algorithm;
+
+  if(job->algo != DT_IOP_RETOUCH_BLUR && job->algo != DT_IOP_RETOUCH_FILL)
+  {
+    if(!rt_masks_get_delta_to_destination(self, piece, roi_layer, job->form, &job->dx, &job->dy))
+    {
+      dt_free_align(mask);
+      return;
+    }
+  }
+
+  // scale the mask
+  rt_build_scaled_mask(mask, &roi_mask, &job->mask_scaled, &job->roi_mask_scaled, roi_layer, job->dx, job->dy,
+                       job->algo);
+
+  // we don't need the original mask anymore
+  dt_free_align(mask);
+
+  if(job->mask_scaled
+     && !((job->dx != 0 || job->dy != 0 || job->algo == DT_IOP_RETOUCH_BLUR || job->algo == DT_IOP_RETOUCH_FILL)
+          && ((job->roi_mask_scaled.width > 2) && (job->roi_mask_scaled.height > 2))))
+  {
+    dt_free_align(job->mask_scaled);
+    job->mask_scaled = NULL;
+  }
+}
+
+static void rt_apply_form(const rt_form_job_t *const job, float *layer, dwt_params_t *const wt_p,
+                          dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, dt_iop_retouch_params_t *p,
+                          dt_iop_roi_t *roi_layer, const int mask_display, rt_scratch_t *const scratch)
+{
+  const int index = job->index;
+  float *const mask_scaled = job->mask_scaled;
+  dt_iop_roi_t roi_mask_scaled = job->roi_mask_scaled;
+
+  if(job->algo == DT_IOP_RETOUCH_CLONE)
+  {
+    retouch_clone(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, job->dx, job->dy, job->opacity,
+                  scratch, wt_p->use_sse);
+  }
+  else if(job->algo == DT_IOP_RETOUCH_HEAL)
+  {
+    retouch_heal(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, job->dx, job->dy, job->opacity,
+                 scratch, wt_p->use_sse);
+  }
+  else if(job->algo == DT_IOP_RETOUCH_BLUR)
+  {
+    retouch_blur(self, layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, job->opacity,
+                 p->rt_forms[index].blur_type, p->rt_forms[index].blur_radius, piece, scratch, wt_p->use_sse);
+  }
+  else if(job->algo == DT_IOP_RETOUCH_FILL)
+  {
+    // add a brightness to the color so it can be fine-adjusted by the user
+    float fill_color[3];
+
+    if(p->rt_forms[index].fill_mode == DT_IOP_RETOUCH_FILL_ERASE)
+    {
+      fill_color[0] = fill_color[1] = fill_color[2] = p->rt_forms[index].fill_brightness;
+    }
+    else
+    {
+      fill_color[0] = p->rt_forms[index].fill_color[0] + p->rt_forms[index].fill_brightness;
+      fill_color[1] = p->rt_forms[index].fill_color[1] + p->rt_forms[index].fill_brightness;
+      fill_color[2] = p->rt_forms[index].fill_color[2] + p->rt_forms[index].fill_brightness;
+    }
+
+    retouch_fill(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, job->opacity, fill_color,
+                 wt_p->use_sse);
+  }
+  else
+    fprintf(stderr, "rt_process_forms: unknown algorithm %i\n", job->algo);
+
+  if(mask_display)
+    rt_copy_mask_to_alpha(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, job->opacity);
 }
 
 static void rt_process_forms(float *layer, dwt_params_t *const wt_p, const int scale1)
@@ -4200,158 +4344,104 @@ static void rt_process_forms(float *layer, dwt_params_t *const wt_p, const int s
     scale = p->num_scales + 1;
   }
 
-  // iterate through all forms
-  if(!usr_d->suppress_mask)
-  {
-    const dt_masks_form_t *grp = dt_masks_get_from_id_ext(piece->pipe->forms, bp->mask_id);
-    if(grp && (grp->type & DT_MASKS_GROUP))
-    {
-      GList *forms = g_list_first(grp->points);
-      while(forms)
-      {
-        const dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)forms->data;
-        if(grpt == NULL)
-        {
-          fprintf(stderr, "rt_process_forms: invalid form\n");
-          forms = g_list_next(forms);
-          continue;
-        }
-        const int formid = grpt->formid;
-        const float form_opacity = grpt->opacity;
-        if(formid == 0)
-        {
-          fprintf(stderr, "rt_process_forms: form is null\n");
-          forms = g_list_next(forms);
-          continue;
-        }
-        const int index = rt_get_index_from_formid(p, formid);
-        if(index == -1)
-        {
-          // FIXME: we get this error when user go back in history, so forms are the same but the array has changed
-          fprintf(stderr, "rt_process_forms: missing form=%i from array\n", formid);
-          forms = g_list_next(forms);
-          continue;
-        }
+  if(usr_d->suppress_mask) return;
 
-        // only process current scale
-        if(p->rt_forms[index].scale != scale)
-        {
-          forms = g_list_next(forms);
-          continue;
-        }
-
-        // get the spot
-        dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, formid);
-        if(form == NULL)
-        {
-          fprintf(stderr, "rt_process_forms: missing form=%i from masks\n", formid);
-          forms = g_list_next(forms);
-          continue;
-        }
-
-        // if the form is outside the roi, we just skip it
-        if(!rt_masks_form_is_in_roi(self, piece, form, roi_layer, roi_layer))
-        {
-          forms = g_list_next(forms);
-          continue;
-        }
-
-        // get the mask
-        float *mask = NULL;
-        dt_iop_roi_t roi_mask = { 0 };
-
-        dt_masks_get_mask(self, piece, form, &mask, &roi_mask.width, &roi_mask.height, &roi_mask.x, &roi_mask.y);
-        if(mask == NULL)
-        {
-          fprintf(stderr, "rt_process_forms: error retrieving mask\n");
-          forms = g_list_next(forms);
-          continue;
-        }
-
-        // search the delta with the source
-        const dt_iop_retouch_algo_type_t algo = p->rt_forms[index].algorithm;
-        int dx = 0, dy = 0;
+  const dt_masks_form_t *grp = dt_masks_get_from_id_ext(piece->pipe->forms, bp->mask_id);
+  if(!grp || !(grp->type & DT_MASKS_GROUP)) return;
 
-        if(algo != DT_IOP_RETOUCH_BLUR && algo != DT_IOP_RETOUCH_FILL)
-        {
-          if(!rt_masks_get_delta_to_destination(self, piece, roi_layer, form, &dx, &dy))
-          {
-            forms = g_list_next(forms);
-            if(mask) dt_free_align(mask);
-            continue;
-          }
-        }
+  // collect the forms of the current scale, in the order they are applied
+  rt_form_job_t *jobs = calloc(g_list_length(grp->points), sizeof(rt_form_job_t));
+  if(jobs == NULL) return;
+  int nb_jobs = 0;
 
-        // scale the mask
-        float *mask_scaled = NULL;
-        dt_iop_roi_t roi_mask_scaled = { 0 };
+  for(GList *forms = g_list_first(grp->points); forms; forms = g_list_next(forms))
+  {
+    const dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)forms->data;
+    if(grpt == NULL)
+    {
+      fprintf(stderr, "rt_process_forms: invalid form\n");
+      continue;
+    }
+    const int formid = grpt->formid;
+    if(formid == 0)
+    {
+      fprintf(stderr, "rt_process_forms: form is null\n");
+      continue;
+    }
+    const int index = rt_get_index_from_formid(p, formid);
+    if(index == -1)
+    {
+      // FIXME: we get this error when user go back in history, so forms are the same but the array has changed
+      fprintf(stderr, "rt_process_forms: missing form=%i from array\n", formid);
+      continue;
+    }
 
-        rt_build_scaled_mask(mask, &roi_mask, &mask_scaled, &roi_mask_scaled, roi_layer, dx, dy, algo);
+    // only process current scale
+    if(p->rt_forms[index].scale != scale) continue;
 
-        // we don't need the original mask anymore
-        if(mask)
-        {
-          dt_free_align(mask);
-          mask = NULL;
-        }
-
-        if(mask_scaled == NULL)
-        {
-          forms = g_list_next(forms);
-          continue;
-        }
+    // get the spot
+    dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, formid);
+    if(form == NULL)
+    {
+      fprintf(stderr, "rt_process_forms: missing form=%i from masks\n", formid);
+      continue;
+    }
 
-        if((dx != 0 || dy != 0 || algo == DT_IOP_RETOUCH_BLUR || algo == DT_IOP_RETOUCH_FILL)
-           && ((roi_mask_scaled.width > 2) && (roi_mask_scaled.height > 2)))
-        {
-          if(algo == DT_IOP_RETOUCH_CLONE)
-          {
-            retouch_clone(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, dx, dy, form_opacity,
-                          wt_p->use_sse);
-          }
-          else if(algo == DT_IOP_RETOUCH_HEAL)
-          {
-            retouch_heal(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, dx, dy, form_opacity,
-                         wt_p->use_sse);
-          }
-          else if(algo == DT_IOP_RETOUCH_BLUR)
-          {
-            retouch_blur(self, layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, form_opacity,
-                         p->rt_forms[index].blur_type, p->rt_forms[index].blur_radius, piece, wt_p->use_sse);
-          }
-          else if(algo == DT_IOP_RETOUCH_FILL)
-          {
-            // add a brightness to the color so it can be fine-adjusted by the user
-            float fill_color[3];
+    jobs[nb_jobs].index = index;
+    jobs[nb_jobs].opacity = grpt->opacity;
+    jobs[nb_jobs].form = form;
+    nb_jobs++;
+  }
 
-            if(p->rt_forms[index].fill_mode == DT_IOP_RETOUCH_FILL_ERASE)
-            {
-              fill_color[0] = fill_color[1] = fill_color[2] = p->rt_forms[index].fill_brightness;
-            }
-            else
-            {
-              fill_color[0] = p->rt_forms[index].fill_color[0] + p->rt_forms[index].fill_brightness;
-              fill_color[1] = p->rt_forms[index].fill_color[1] + p->rt_forms[index].fill_brightness;
-              fill_color[2] = p->rt_forms[index].fill_color[2] + p->rt_forms[index].fill_brightness;
-            }
+  // masks of different forms don't depend on each other
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(jobs, nb_jobs, p, piece, roi_layer, self) \
+  schedule(dynamic)
+#endif
+  for(int k = 0; k < nb_jobs; k++) rt_prepare_form(&jobs[k], self, piece, p, roi_layer);
 
-            retouch_fill(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, form_opacity, fill_color,
-                         wt_p->use_sse);
-          }
-          else
-            fprintf(stderr, "rt_process_forms: unknown algorithm %i\n", algo);
+  // a form goes in the first wave after all earlier forms it depends on,
+  // the forms of a wave are independent of each other
+  int nb_waves = 0;
+  for(int k = 0; k < nb_jobs; k++)
+  {
+    if(jobs[k].mask_scaled == NULL) continue;
+    for(int i = 0; i < k; i++)
+      if(jobs[i].mask_scaled && jobs[i].wave >= jobs[k].wave && rt_forms_depend(&jobs[i], &jobs[k]))
+        jobs[k].wave = jobs[i].wave + 1;
+    nb_waves = MAX(nb_waves, jobs[k].wave + 1);
+  }
 
-          if(mask_display)
-            rt_copy_mask_to_alpha(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, form_opacity);
-        }
+  const int nthreads = dt_get_num_threads();
+  rt_scratch_t *scratch = calloc(nthreads, sizeof(rt_scratch_t));
+  int *wave_jobs = malloc(sizeof(int) * MAX(nb_jobs, 1));
 
-        if(mask) dt_free_align(mask);
-        if(mask_scaled) dt_free_align(mask_scaled);
+  for(int wave = 0; wave < nb_waves && scratch && wave_jobs; wave++)
+  {
+    int nb_wave_jobs = 0;
+    for(int k = 0; k < nb_jobs; k++)
+      if(jobs[k].mask_scaled && jobs[k].wave == wave) wave_jobs[nb_wave_jobs++] = k;
 
-        forms = g_list_next(forms);
-      }
-    }
-  }
+    // a single form keeps the parallel loops inside the algorithms
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(jobs, layer, mask_display, nb_wave_jobs, p, piece, roi_layer, scratch, self, wave_jobs, \
+                        wt_p) \
+    schedule(dynamic) if(nb_wave_jobs > 1)
+#endif
+    for(int k = 0; k < nb_wave_jobs; k++)
+      rt_apply_form(&jobs[wave_jobs[k]], layer, wt_p, self, piece, p, roi_layer, mask_display,
+                    &scratch[dt_get_thread_num()]);
+  }
+
+  if(scratch)
+    for(int k = 0; k < nthreads; k++) rt_scratch_free(&scratch[k]);
+  free(scratch);
+  free(wave_jobs);
+  for(int k = 0; k < nb_jobs; k++)
+    if(jobs[k].mask_scaled) dt_free_align(jobs[k].mask_scaled);
+  free(jobs);
 }
 
 static void process_internal(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
@@ -367,12 +367,13 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     const float sigma_s = sigma;
     const float detail = -1.0f; // we want the bilateral base layer
 
-    dt_bilateral_t *b = dt_bilateral_init(width, height, sigma_s, sigma_r);
+    // the grid only depends on our input and the radius, so it is reused while
+    // the shadows and highlights sliders are dragged. tiles keep a private grid.
+    const uint64_t hash = piece->pipe->tiling ? 0 : dt_dev_pixelpipe_cache_hash_input(piece, roi_in);
+    dt_bilateral_t *b = dt_bilateral_acquire(piece->pipe, hash, in, width, height, sigma_s, sigma_r);
     if(!b) return;
-    dt_bilateral_splat(b, in);
-    dt_bilateral_blur(b);
     dt_bilateral_slice(b, in, out, detail);
-    dt_bilateral_free(b);
+    dt_bilateral_release(b);
   }
 
 // invert and desaturate
@@ -447,6 +447,38 @@ static void dt_wb_preset_interpolate(const wb_data *const p1, // the smaller tun
   }
 }
 
+int fuse_raw_frontend(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, dt_iop_raw_frontend_t *fe,
+                      dt_iop_buffer_dsc_t *dsc, const dt_iop_roi_t *const roi_in,
+                      const dt_iop_roi_t *const roi_out)
+{
+  const uint32_t filters = dsc->filters;
+  const uint8_t(*const xtrans)[6] = (const uint8_t(*const)[6])dsc->xtrans;
+  const dt_iop_temperature_data_t *const d = (dt_iop_temperature_data_t *)piece->data;
+
+  if(!filters) return 1;
+  // the front-end tables repeat every 6 rows, so the bayer pattern has to repeat every other row
+  if(filters != 9u && (filters & 0xff) * 0x01010101u != filters) return 1;
+
+  for(int j = 0; j < 6; j++)
+  {
+    for(int i = 0; i < 6; i++)
+    {
+      const int c = (filters == 9u) ? FCxtrans(j, i, roi_out, xtrans)
+                                    : FC(j + roi_out->y, i + roi_out->x, filters);
+      fe->mul[j][i] *= d->coeffs[c];
+    }
+  }
+
+  dsc->temperature.enabled = 1;
+  for(int k = 0; k < 4; k++)
+  {
+    dsc->temperature.coeffs[k] = d->coeffs[k];
+    dsc->processed_maximum[k] = d->coeffs[k] * dsc->processed_maximum[k];
+  }
+
+  return 0;
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -184,8 +184,10 @@ static gboolean _lib_histogram_draw_callback(GtkWidget *widget, cairo_t *crf, gp
   gtk_widget_get_allocation(widget, &allocation);
   const int width = allocation.width, height = allocation.height;
 
-  dt_pthread_mutex_lock(&dev->preview_pipe_mutex);
+  // the histogram job publishes under this lock, not under the preview pipe's
+  dt_pthread_mutex_lock(&dev->histogram_async.lock);
 
+  const uint32_t histogram_max = dev->histogram_max;
   const int waveform_width = dev->histogram_waveform_width;
   const int waveform_height = dev->histogram_waveform_height;
   const gint waveform_stride = dev->histogram_waveform_stride;
@@ -202,7 +204,7 @@ static gboolean _lib_histogram_draw_callback(GtkWidget *widget, cairo_t *crf, gp
       memcpy(buf, dev->histogram, histsize);
   }
 
-  dt_pthread_mutex_unlock(&dev->preview_pipe_mutex);
+  dt_pthread_mutex_unlock(&dev->histogram_async.lock);
   if(buf == NULL) return FALSE;
 
   cairo_surface_t *cst = dt_cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
@@ -274,11 +276,11 @@ static gboolean _lib_histogram_draw_callback(GtkWidget *widget, cairo_t *crf, gp
       cairo_paint(cr);
       cairo_surface_destroy(source);
     }
-    else if(dev->histogram_max)
+    else if(histogram_max)
     {
       uint32_t *hist = buf;
-      const float hist_max = dev->histogram_type == DT_DEV_HISTOGRAM_LINEAR ? dev->histogram_max
-                                                                            : logf(1.0 + dev->histogram_max);
+      const float hist_max = dev->histogram_type == DT_DEV_HISTOGRAM_LINEAR ? histogram_max
+                                                                            : logf(1.0 + histogram_max);
       cairo_translate(cr, 0, height);
       cairo_scale(cr, width / 255.0, -(height - 10) / hist_max);
       cairo_set_operator(cr, CAIRO_OPERATOR_ADD);
@@ -598,6 +600,9 @@ void gui_init(dt_lib_module_t *self)
   /* connect to preview pipe finished  signal */
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_DEVELOP_PREVIEW_PIPE_FINISHED,
                             G_CALLBACK(_lib_histogram_change_callback), self);
+  /* the histogram itself is computed in the background and may arrive later */
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_DEVELOP_HISTOGRAM_READY,
+                            G_CALLBACK(_lib_histogram_change_callback), self);
 }
 
 void gui_cleanup(dt_lib_module_t *self)
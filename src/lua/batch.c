@@ -0,0 +1,474 @@
+/*
+   This file is part of darktable,
+   copyright (c) 2020 darktable developers.
+
+   darktable is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   darktable is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lua/batch.h"
+#include "common/darktable.h"
+#include "common/imageio.h"
+#include "control/conf.h"
+#include "control/control.h"
+#include "control/jobs.h"
+#include "control/progress.h"
+#include "lua/call.h"
+#include "lua/image.h"
+#include "lua/types.h"
+#include <glib.h>
+
+/*
+   a batch is shared between the lua state and the control jobs exporting its images.
+
+   the jobs never take the lua lock: they pick the next image under the batch mutex,
+   export it with their own copy of the format parameters and hand the result over
+   to the lua thread through alien calls.
+
+   while jobs are running the lua object is anchored in the registry, so it can't be
+   collected under their feet. the last job to finish posts the call that removes the
+   anchor, the memory is released by the __gc of the lua object.
+   */
+
+typedef enum dt_lua_batch_state_t
+{
+  DT_LUA_BATCH_PENDING = 0,
+  DT_LUA_BATCH_DONE,
+  DT_LUA_BATCH_FAILED
+} dt_lua_batch_state_t;
+
+typedef struct dt_lua_batch_data_t
+{
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *fdata; // template, copied by every job
+  gboolean high_quality;
+  gboolean upscale;
+  dt_colorspaces_color_profile_type_t icc_type;
+  gchar *icc_filename;
+
+  int total;
+  int32_t *imgids;
+  gchar **filenames;
+  dt_lua_batch_state_t *states;
+  dt_progress_t *progress;
+
+  // everything below is protected by the mutex
+  GMutex mutex;
+  GCond cond;
+  int next;
+  int completed;
+  int running;
+  gboolean cancelled;
+} dt_lua_batch_data_t;
+
+typedef dt_lua_batch_data_t *dt_lua_batch_t;
+
+#define RUNNING_BATCHES "dt_lua_batch_running"
+
+static void batch_free(dt_lua_batch_t batch)
+{
+  batch->format->free_params(batch->format, batch->fdata);
+  g_free(batch->icc_filename);
+  for(int i = 0; i < batch->total; i++) g_free(batch->filenames[i]);
+  g_free(batch->filenames);
+  g_free(batch->imgids);
+  g_free(batch->states);
+  g_mutex_clear(&batch->mutex);
+  g_cond_clear(&batch->cond);
+  g_free(batch);
+}
+
+static void push_results(lua_State *L, dt_lua_batch_t batch)
+{
+  lua_newtable(L);
+  g_mutex_lock(&batch->mutex);
+  for(int i = 0; i < batch->total; i++)
+  {
+    // images that have been skipped after a cancel stay nil
+    if(batch->states[i] == DT_LUA_BATCH_PENDING) continue;
+    lua_pushboolean(L, batch->states[i] == DT_LUA_BATCH_DONE);
+    lua_rawseti(L, -2, i + 1);
+  }
+  g_mutex_unlock(&batch->mutex);
+}
+
+/***********************************************************************
+  calls posted by the jobs, run in the lua thread
+ **********************************************************************/
+
+static int image_done(lua_State *L)
+{
+  dt_lua_batch_t batch;
+  luaA_to(L, dt_lua_batch_t, &batch, 1);
+  const int index = lua_tointeger(L, 2);
+  const int completed = lua_tointeger(L, 3);
+
+  lua_getuservalue(L, 1);
+  lua_getfield(L, -1, "progress");
+  if(lua_isfunction(L, -1))
+  {
+    g_mutex_lock(&batch->mutex);
+    const gboolean ok = batch->states[index] == DT_LUA_BATCH_DONE;
+    g_mutex_unlock(&batch->mutex);
+
+    lua_pushvalue(L, 1);
+    luaA_push(L, dt_lua_image_t, &batch->imgids[index]);
+    lua_pushboolean(L, ok);
+    lua_pushinteger(L, completed);
+    lua_pushinteger(L, batch->total);
+    lua_call(L, 5, 0);
+  }
+  lua_pop(L, 2);
+  return 0;
+}
+
+static int batch_finished(lua_State *L)
+{
+  dt_lua_batch_t batch;
+  luaA_to(L, dt_lua_batch_t, &batch, 1);
+
+  // no job references the batch anymore, let the gc have it once scripts are done with it
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, RUNNING_BATCHES);
+  lua_pushlightuserdata(L, batch);
+  lua_pushnil(L);
+  lua_settable(L, -3);
+  lua_pop(L, 1);
+
+  lua_getuservalue(L, 1);
+  lua_getfield(L, -1, "done");
+  if(lua_isfunction(L, -1))
+  {
+    lua_pushvalue(L, 1);
+    push_results(L, batch);
+    lua_call(L, 2, 0);
+  }
+  lua_pop(L, 2);
+  return 0;
+}
+
+/***********************************************************************
+  the control jobs
+ **********************************************************************/
+
+static int32_t batch_job_run(dt_job_t *job)
+{
+  dt_lua_batch_t batch = dt_control_job_get_params(job);
+  dt_imageio_module_format_t *format = batch->format;
+  const size_t params_size = format->params_size(format);
+
+  // one fdata struct per job, export may change it
+  dt_imageio_module_data_t *fdata = format->get_params(format);
+
+  while(TRUE)
+  {
+    g_mutex_lock(&batch->mutex);
+    const int index = batch->cancelled ? batch->total : batch->next;
+    if(index < batch->total) batch->next++;
+    g_mutex_unlock(&batch->mutex);
+    if(index >= batch->total) break;
+
+    memcpy(fdata, batch->fdata, params_size);
+    const int failed = dt_imageio_export(batch->imgids[index], batch->filenames[index], format, fdata,
+                                         batch->high_quality, batch->upscale, FALSE, batch->icc_type,
+                                         batch->icc_filename, DT_INTENT_LAST, NULL, NULL, index + 1,
+                                         batch->total, NULL);
+
+    g_mutex_lock(&batch->mutex);
+    batch->states[index] = failed ? DT_LUA_BATCH_FAILED : DT_LUA_BATCH_DONE;
+    const int completed = ++batch->completed;
+    g_mutex_unlock(&batch->mutex);
+
+    dt_control_progress_set_progress(darktable.control, batch->progress, (double)completed / batch->total);
+    dt_lua_async_call_alien(image_done,
+        0, NULL, NULL,
+        LUA_ASYNC_TYPENAME, "dt_lua_batch_t", batch,
+        LUA_ASYNC_TYPENAME, "int", GINT_TO_POINTER(index),
+        LUA_ASYNC_TYPENAME, "int", GINT_TO_POINTER(completed),
+        LUA_ASYNC_DONE);
+  }
+
+  format->free_params(format, fdata);
+
+  g_mutex_lock(&batch->mutex);
+  const gboolean last = --batch->running == 0;
+  g_cond_broadcast(&batch->cond);
+  g_mutex_unlock(&batch->mutex);
+
+  if(last)
+  {
+    // not under the batch mutex, the progress system calls batch_cancelled with its own lock held
+    dt_control_progress_destroy(darktable.control, batch->progress);
+    batch->progress = NULL;
+    dt_lua_async_call_alien(batch_finished,
+        0, NULL, NULL,
+        LUA_ASYNC_TYPENAME, "dt_lua_batch_t", batch,
+        LUA_ASYNC_DONE);
+  }
+  return 0;
+}
+
+static void batch_cancelled(dt_progress_t *progress, gpointer user_data)
+{
+  dt_lua_batch_t batch = user_data;
+  g_mutex_lock(&batch->mutex);
+  batch->cancelled = TRUE;
+  g_mutex_unlock(&batch->mutex);
+}
+
+/***********************************************************************
+  the lua side
+ **********************************************************************/
+
+static int batch_export(lua_State *L)
+{
+  /* check that param 1 is a module_format_t */
+  luaL_argcheck(L, dt_lua_isa(L, 1, dt_imageio_module_format_t), 1, "dt_imageio_module_format_t expected");
+  luaL_checktype(L, 2, LUA_TTABLE);
+  if(!lua_isnoneornil(L, 3)) luaL_checktype(L, 3, LUA_TTABLE);
+
+  /* check the list of { image = ..., filename = ... } before allocating anything */
+  const int total = luaL_len(L, 2);
+  for(int i = 1; i <= total; i++)
+  {
+    lua_geti(L, 2, i);
+    luaL_argcheck(L, lua_istable(L, -1), 2, "list of { image, filename } expected");
+    lua_getfield(L, -1, "image");
+    luaL_argcheck(L, dt_lua_isa(L, -1, dt_lua_image_t), 2, "image expected");
+    lua_getfield(L, -2, "filename");
+    luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, 2, "filename expected");
+    lua_pop(L, 3);
+  }
+
+  int concurrency = 2;
+  gboolean high_quality = dt_conf_get_bool("plugins/lighttable/export/high_quality_processing");
+  gboolean upscale = FALSE;
+  if(lua_istable(L, 3))
+  {
+    lua_getfield(L, 3, "concurrency");
+    if(!lua_isnil(L, -1)) concurrency = luaL_checkinteger(L, -1);
+    lua_getfield(L, 3, "high_quality");
+    if(!lua_isnil(L, -1)) high_quality = lua_toboolean(L, -1);
+    lua_getfield(L, 3, "upscale");
+    upscale = lua_toboolean(L, -1);
+    lua_getfield(L, 3, "progress");
+    if(!lua_isnil(L, -1)) luaL_checktype(L, -1, LUA_TFUNCTION);
+    lua_getfield(L, 3, "done");
+    if(!lua_isnil(L, -1)) luaL_checktype(L, -1, LUA_TFUNCTION);
+    lua_pop(L, 5);
+  }
+  // leave a worker to the thumbnails and other background jobs
+  concurrency = CLAMP(concurrency, 1, MAX(1, darktable.control->num_threads - 1));
+
+  lua_getmetatable(L, 1);
+  lua_getfield(L, -1, "__luaA_Type");
+  luaA_Type format_type = luaL_checkinteger(L, -1);
+  lua_pop(L, 1);
+  lua_getfield(L, -1, "__associated_object");
+  dt_imageio_module_format_t *format = lua_touserdata(L, -1);
+  lua_pop(L, 2);
+
+  dt_lua_batch_t batch = g_malloc0(sizeof(dt_lua_batch_data_t));
+  batch->format = format;
+  batch->fdata = format->get_params(format);
+  luaA_to_type(L, format_type, batch->fdata, 1);
+  batch->high_quality = high_quality;
+  batch->upscale = upscale;
+  // TODO: expose icc overwrites to the user!
+  batch->icc_type = dt_conf_get_int("plugins/lighttable/export/icctype");
+  batch->icc_filename = dt_conf_get_string("plugins/lighttable/export/iccprofile");
+  batch->total = total;
+  batch->imgids = g_malloc0_n(MAX(total, 1), sizeof(int32_t));
+  batch->filenames = g_malloc0_n(MAX(total, 1), sizeof(gchar *));
+  batch->states = g_malloc0_n(MAX(total, 1), sizeof(dt_lua_batch_state_t));
+  for(int i = 0; i < total; i++)
+  {
+    lua_geti(L, 2, i + 1);
+    lua_getfield(L, -1, "image");
+    luaA_to(L, dt_lua_image_t, &batch->imgids[i], -1);
+    lua_getfield(L, -2, "filename");
+    batch->filenames[i] = g_strdup(lua_tostring(L, -1));
+    lua_pop(L, 3);
+  }
+  g_mutex_init(&batch->mutex);
+  g_cond_init(&batch->cond);
+
+  luaA_push(L, dt_lua_batch_t, &batch);
+  if(lua_istable(L, 3))
+  {
+    lua_getuservalue(L, -1);
+    lua_getfield(L, 3, "progress");
+    lua_setfield(L, -2, "progress");
+    lua_getfield(L, 3, "done");
+    lua_setfield(L, -2, "done");
+    lua_pop(L, 1);
+  }
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, RUNNING_BATCHES);
+  lua_pushlightuserdata(L, batch);
+  lua_pushvalue(L, -3);
+  lua_settable(L, -3);
+  lua_pop(L, 1);
+
+  batch->progress = dt_control_progress_create(darktable.control, TRUE, _("lua batch export"));
+  dt_control_progress_make_cancellable(darktable.control, batch->progress, batch_cancelled, batch);
+
+  // all jobs must be counted before the first one can finish
+  batch->running = concurrency;
+  for(int k = 0; k < concurrency; k++)
+  {
+    dt_job_t *job = dt_control_job_create(&batch_job_run, "lua batch export");
+    if(job) dt_control_job_set_params(job, batch, NULL);
+    if(!job || dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, job))
+    {
+      // the job will never run, account for it as if it had found nothing to do
+      g_mutex_lock(&batch->mutex);
+      const gboolean last = --batch->running == 0;
+      g_mutex_unlock(&batch->mutex);
+      if(last)
+      {
+        dt_control_progress_destroy(darktable.control, batch->progress);
+        batch->progress = NULL;
+        dt_lua_async_call_alien(batch_finished,
+            0, NULL, NULL,
+            LUA_ASYNC_TYPENAME, "dt_lua_batch_t", batch,
+            LUA_ASYNC_DONE);
+      }
+    }
+  }
+  return 1;
+}
+
+static int batch_wait(lua_State *L)
+{
+  dt_lua_batch_t batch;
+  luaA_to(L, dt_lua_batch_t, &batch, 1);
+  lua_pushvalue(L, 1); // keep the batch alive while the lock is released
+
+  dt_lua_unlock();
+  g_mutex_lock(&batch->mutex);
+  while(batch->running > 0) g_cond_wait(&batch->cond, &batch->mutex);
+  g_mutex_unlock(&batch->mutex);
+  dt_lua_lock();
+
+  push_results(L, batch);
+  return 1;
+}
+
+static int batch_cancel(lua_State *L)
+{
+  dt_lua_batch_t batch;
+  luaA_to(L, dt_lua_batch_t, &batch, 1);
+  g_mutex_lock(&batch->mutex);
+  batch->cancelled = TRUE;
+  g_mutex_unlock(&batch->mutex);
+  return 0;
+}
+
+static int total_member(lua_State *L)
+{
+  dt_lua_batch_t batch;
+  luaA_to(L, dt_lua_batch_t, &batch, 1);
+  lua_pushinteger(L, batch->total);
+  return 1;
+}
+
+static int completed_member(lua_State *L)
+{
+  dt_lua_batch_t batch;
+  luaA_to(L, dt_lua_batch_t, &batch, 1);
+  g_mutex_lock(&batch->mutex);
+  const int completed = batch->completed;
+  g_mutex_unlock(&batch->mutex);
+  lua_pushinteger(L, completed);
+  return 1;
+}
+
+static int finished_member(lua_State *L)
+{
+  dt_lua_batch_t batch;
+  luaA_to(L, dt_lua_batch_t, &batch, 1);
+  g_mutex_lock(&batch->mutex);
+  const gboolean finished = batch->running == 0;
+  g_mutex_unlock(&batch->mutex);
+  lua_pushboolean(L, finished);
+  return 1;
+}
+
+static int cancelled_member(lua_State *L)
+{
+  dt_lua_batch_t batch;
+  luaA_to(L, dt_lua_batch_t, &batch, 1);
+  g_mutex_lock(&batch->mutex);
+  const gboolean cancelled = batch->cancelled;
+  g_mutex_unlock(&batch->mutex);
+  lua_pushboolean(L, cancelled);
+  return 1;
+}
+
+static int results_member(lua_State *L)
+{
+  dt_lua_batch_t batch;
+  luaA_to(L, dt_lua_batch_t, &batch, 1);
+  push_results(L, batch);
+  return 1;
+}
+
+static int batch_gc(lua_State *L)
+{
+  // the registry holds running batches, so the jobs are all gone by now,
+  // unless the whole lua state is being closed: leak rather than pull the rug
+  dt_lua_batch_t batch = *(dt_lua_batch_t *)lua_touserdata(L, 1);
+  if(!batch) return 0;
+  g_mutex_lock(&batch->mutex);
+  const gboolean running = batch->running > 0;
+  g_mutex_unlock(&batch->mutex);
+  if(!running) batch_free(batch);
+  return 0;
+}
+
+int dt_lua_init_batch(lua_State *L)
+{
+  int type_id = dt_lua_init_gpointer_type(L, dt_lua_batch_t);
+  lua_pushcfunction(L, total_member);
+  dt_lua_type_register_const_type(L, type_id, "total");
+  lua_pushcfunction(L, completed_member);
+  dt_lua_type_register_const_type(L, type_id, "completed");
+  lua_pushcfunction(L, finished_member);
+  dt_lua_type_register_const_type(L, type_id, "finished");
+  lua_pushcfunction(L, cancelled_member);
+  dt_lua_type_register_const_type(L, type_id, "cancelled");
+  lua_pushcfunction(L, results_member);
+  dt_lua_type_register_const_type(L, type_id, "results");
+  lua_pushcfunction(L, batch_wait);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, type_id, "wait");
+  lua_pushcfunction(L, batch_cancel);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, type_id, "cancel");
+  lua_pushcfunction(L, batch_gc);
+  dt_lua_type_setmetafield_type(L, type_id, "__gc");
+
+  dt_lua_push_darktable_lib(L);
+  luaA_Type batch_lib = dt_lua_init_singleton(L, "batch_lib", NULL);
+  lua_setfield(L, -2, "batch");
+  lua_pop(L, 1);
+
+  lua_pushcfunction(L, batch_export);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, batch_lib, "export");
+  return 0;
+}
+
+#undef RUNNING_BATCHES
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
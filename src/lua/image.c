@@ -17,6 +17,7 @@
  */
 
 #include "lua/image.h"
+#include "common/collection.h"
 #include "common/colorlabels.h"
 #include "common/debug.h"
 #include "common/grouping.h"
@@ -209,6 +210,7 @@ static int rating_member(lua_State *L)
     my_image->flags &= ~0x7;
     my_image->flags |= my_score;
     releasewriteimage(L, my_image);
+    dt_collection_images_changed();
     return 0;
   }
 }
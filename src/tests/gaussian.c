@@ -0,0 +1,282 @@
+/*
+    This file is part of darktable,
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// micro-benchmark of the recursive gaussian: megapixels per second of dt_gaussian_blur() and
+// dt_gaussian_blur_4c() against the column by column code they replaced, and how far apart
+// the results are.
+//
+//   darktable-bench-gaussian [width height [sigma]]
+
+#include "common/darktable.h"
+#include "common/gaussian.h"
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CLAMPF(a, mn, mx) ((a) < (mn) ? (mn) : ((a) > (mx) ? (mx) : (a)))
+#define RUNS 5
+
+// same as in src/common/gaussian.c, only zero order is benchmarked
+static void compute_gauss_params(const float sigma, dt_gaussian_order_t order, float *a0, float *a1,
+                                 float *a2, float *a3, float *b1, float *b2, float *coefp, float *coefn)
+{
+  const float alpha = 1.695f / sigma;
+  const float ema = exp(-alpha);
+  const float ema2 = exp(-2.0f * alpha);
+  *b1 = -2.0f * ema;
+  *b2 = ema2;
+  const float k = (1.0f - ema) * (1.0f - ema) / (1.0f + (2.0f * alpha * ema) - ema2);
+  *a0 = k;
+  *a1 = k * (alpha - 1.0f) * ema;
+  *a2 = k * (alpha + 1.0f) * ema;
+  *a3 = -k * ema2;
+  *coefp = (*a0 + *a1) / (1.0f + *b1 + *b2);
+  *coefn = (*a2 + *a3) / (1.0f + *b1 + *b2);
+}
+
+// the column by column implementation dt_gaussian_blur() had before the blocked vertical pass
+static void reference_blur(dt_gaussian_t *g, const float *const in, float *const out)
+{
+  const int width = g->width;
+  const int height = g->height;
+  const int ch = MIN(4, g->channels); // just to appease zealous compiler warnings about stack usage
+
+  float a0, a1, a2, a3, b1, b2, coefp, coefn;
+
+  compute_gauss_params(g->sigma, g->order, &a0, &a1, &a2, &a3, &b1, &b2, &coefp, &coefn);
+
+  float *temp = g->buf;
+
+  float *Labmax = g->max;
+  float *Labmin = g->min;
+
+// vertical blur column by column
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, width, height, ch) \
+  shared(temp, Labmin, Labmax, a0, a1, a2, a3, b1, b2, coefp, coefn) \
+  schedule(static)
+#endif
+  for(int i = 0; i < width; i++)
+  {
+    float xp[4] = {0.0f};
+    float yb[4] = {0.0f};
+    float yp[4] = {0.0f};
+    float xc[4] = {0.0f};
+    float yc[4] = {0.0f};
+    float xn[4] = {0.0f};
+    float xa[4] = {0.0f};
+    float yn[4] = {0.0f};
+    float ya[4] = {0.0f};
+
+    // forward filter
+    for(int k = 0; k < ch; k++)
+    {
+      xp[k] = CLAMPF(in[(size_t)i * ch + k], Labmin[k], Labmax[k]);
+      yb[k] = xp[k] * coefp;
+      yp[k] = yb[k];
+      xc[k] = yc[k] = xn[k] = xa[k] = yn[k] = ya[k] = 0.0f;
+    }
+
+    for(int j = 0; j < height; j++)
+    {
+      size_t offset = ((size_t)j * width + i) * ch;
+
+      for(int k = 0; k < ch; k++)
+      {
+        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
+        yc[k] = (a0 * xc[k]) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
+
+        temp[offset + k] = yc[k];
+
+        xp[k] = xc[k];
+        yb[k] = yp[k];
+        yp[k] = yc[k];
+      }
+    }
+
+    // backward filter
+    for(int k = 0; k < ch; k++)
+    {
+      xn[k] = CLAMPF(in[((size_t)(height - 1) * width + i) * ch + k], Labmin[k], Labmax[k]);
+      xa[k] = xn[k];
+      yn[k] = xn[k] * coefn;
+      ya[k] = yn[k];
+    }
+
+    for(int j = height - 1; j > -1; j--)
+    {
+      size_t offset = ((size_t)j * width + i) * ch;
+
+      for(int k = 0; k < ch; k++)
+      {
+        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
+
+        yc[k] = (a2 * xn[k]) + (a3 * xa[k]) - (b1 * yn[k]) - (b2 * ya[k]);
+
+        xa[k] = xn[k];
+        xn[k] = xc[k];
+        ya[k] = yn[k];
+        yn[k] = yc[k];
+
+        temp[offset + k] += yc[k];
+      }
+    }
+  }
+
+// horizontal blur line by line
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(out, ch, width, height) \
+  shared(temp, Labmin, Labmax, a0, a1, a2, a3, b1, b2, coefp, coefn) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    float xp[4] = {0.0f};
+    float yb[4] = {0.0f};
+    float yp[4] = {0.0f};
+    float xc[4] = {0.0f};
+    float yc[4] = {0.0f};
+    float xn[4] = {0.0f};
+    float xa[4] = {0.0f};
+    float yn[4] = {0.0f};
+    float ya[4] = {0.0f};
+
+    // forward filter
+    for(int k = 0; k < ch; k++)
+    {
+      xp[k] = CLAMPF(temp[(size_t)j * width * ch + k], Labmin[k], Labmax[k]);
+      yb[k] = xp[k] * coefp;
+      yp[k] = yb[k];
+      xc[k] = yc[k] = xn[k] = xa[k] = yn[k] = ya[k] = 0.0f;
+    }
+
+    for(int i = 0; i < width; i++)
+    {
+      size_t offset = ((size_t)j * width + i) * ch;
+
+      for(int k = 0; k < ch; k++)
+      {
+        xc[k] = CLAMPF(temp[offset + k], Labmin[k], Labmax[k]);
+        yc[k] = (a0 * xc[k]) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
+
+        out[offset + k] = yc[k];
+
+        xp[k] = xc[k];
+        yb[k] = yp[k];
+        yp[k] = yc[k];
+      }
+    }
+
+    // backward filter
+    for(int k = 0; k < ch; k++)
+    {
+      xn[k] = CLAMPF(temp[((size_t)(j + 1) * width - 1) * ch + k], Labmin[k], Labmax[k]);
+      xa[k] = xn[k];
+      yn[k] = xn[k] * coefn;
+      ya[k] = yn[k];
+    }
+
+    for(int i = width - 1; i > -1; i--)
+    {
+      size_t offset = ((size_t)j * width + i) * ch;
+
+      for(int k = 0; k < ch; k++)
+      {
+        xc[k] = CLAMPF(temp[offset + k], Labmin[k], Labmax[k]);
+
+        yc[k] = (a2 * xn[k]) + (a3 * xa[k]) - (b1 * yn[k]) - (b2 * ya[k]);
+
+        xa[k] = xn[k];
+        xn[k] = xc[k];
+        ya[k] = yn[k];
+        yn[k] = yc[k];
+
+        out[offset + k] += yc[k];
+      }
+    }
+  }
+}
+
+typedef void(blur_t)(dt_gaussian_t *g, const float *const in, float *const out);
+
+// best of a few runs, including the setup the modules pay for on every call
+static double bench(blur_t *blur, const int width, const int height, const int ch, const float sigma,
+                    const float *const in, float *const out)
+{
+  const float max[4] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+  const float min[4] = { -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+  double best = DBL_MAX;
+  for(int r = 0; r < RUNS; r++)
+  {
+    const double start = dt_get_wtime();
+    dt_gaussian_t *g = dt_gaussian_init(width, height, ch, max, min, sigma, DT_IOP_GAUSSIAN_ZERO);
+    if(!g) return 0.0;
+    blur(g, in, out);
+    dt_gaussian_free(g);
+    best = MIN(best, dt_get_wtime() - start);
+  }
+  return (double)width * height / best * 1e-6;
+}
+
+static float max_difference(const float *const a, const float *const b, const size_t n)
+{
+  float diff = 0.0f;
+  for(size_t k = 0; k < n; k++) diff = fmaxf(diff, fabsf(a[k] - b[k]));
+  return diff;
+}
+
+int main(int argc, char *arg[])
+{
+  char *argv[] = { "darktable-bench-gaussian", "--library", ":memory:", "--conf", "write_sidecar_files=FALSE", NULL };
+  if(dt_init(sizeof(argv) / sizeof(*argv) - 1, argv, FALSE, FALSE, NULL)) exit(1);
+
+  const int width = argc > 2 ? atoi(arg[1]) : 6000;
+  const int height = argc > 2 ? atoi(arg[2]) : 4000;
+  const float sigma = argc > 3 ? atof(arg[3]) : 50.0f;
+  const size_t n = (size_t)width * height * 4;
+
+  float *in = dt_alloc_align(64, n * sizeof(float));
+  float *out = dt_alloc_align(64, n * sizeof(float));
+  float *ref = dt_alloc_align(64, n * sizeof(float));
+  if(!in || !out || !ref) exit(1);
+  for(size_t k = 0; k < n; k++) in[k] = (float)((k * 2654435761u) % 1000) * 0.1f;
+
+  printf("%dx%d, sigma %g, %d threads\n", width, height, sigma, dt_get_num_threads());
+  for(int ch = 1; ch <= 4; ch += 3)
+  {
+    const double mref = bench(reference_blur, width, height, ch, sigma, in, ref);
+    const double mnew = bench(dt_gaussian_blur, width, height, ch, sigma, in, out);
+    printf("  %dc column by column %8.1f MP/s\n", ch, mref);
+    printf("  %dc dt_gaussian_blur %8.1f MP/s, max difference %g\n", ch, mnew,
+           max_difference(ref, out, (size_t)width * height * ch));
+  }
+  const double m4c = bench(dt_gaussian_blur_4c, width, height, 4, sigma, in, out);
+  printf("  4c dt_gaussian_blur_4c %6.1f MP/s, max difference %g\n", m4c, max_difference(ref, out, n));
+
+  dt_free_align(in);
+  dt_free_align(out);
+  dt_free_align(ref);
+  dt_cleanup();
+  return 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -27,6 +27,7 @@
 #include "common/image_cache.h"
 #include "common/imageio.h"
 #include "common/imageio_module.h"
+#include "common/mipmap_cache.h"
 #include "common/styles.h"
 #include "common/tags.h"
 #include "common/undo.h"
@@ -291,10 +292,14 @@ void expose(
     dt_pthread_mutex_lock(mutex);
     float wd = dev->pipe->output_backbuf_width;
     float ht = dev->pipe->output_backbuf_height;
+    // a coarse pass of progressive rendering, shown upscaled until the full one arrives
+    const int coarse = dev->pipe->output_backbuf_coarse;
     stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, wd);
     surface = dt_cairo_image_surface_create_for_data(dev->pipe->output_backbuf, CAIRO_FORMAT_RGB24, wd, ht, stride);
     wd /= darktable.gui->ppd;
     ht /= darktable.gui->ppd;
+    wd *= coarse;
+    ht *= coarse;
 
     if(dev->iso_12646.enabled)
     {
@@ -327,6 +332,11 @@ void expose(
     }
 
     cairo_rectangle(cr, 0, 0, wd, ht);
+    if(coarse > 1)
+    {
+      cairo_save(cr);
+      cairo_scale(cr, coarse, coarse);
+    }
     cairo_set_source_surface(cr, surface, 0, 0);
     if(closeup)
       cairo_pattern_set_filter(cairo_get_source(cr), darktable.gui->filter_image);
@@ -334,8 +344,9 @@ void expose(
       cairo_pattern_set_filter(cairo_get_source(cr), darktable.gui->filter_image);
 
     cairo_fill(cr);
+    if(coarse > 1) cairo_restore(cr);
 
-    if(darktable.gui->show_focus_peaking)
+    if(darktable.gui->show_focus_peaking && coarse == 1)
     {
       cairo_save(cr);
       cairo_scale(cr, 1./ darktable.gui->ppd, 1. / darktable.gui->ppd);
@@ -681,6 +692,114 @@ static void dt_dev_cleanup_module_accels(dt_iop_module_t *module)
   dt_accel_cleanup_locals_iop(module);
 }
 
+typedef struct _dev_prefetch_t
+{
+  dt_develop_t *dev;
+  int32_t imgid;
+  dt_mipmap_size_t mip;
+  gint generation;
+} _dev_prefetch_t;
+
+// would loading one more buffer push the image being edited out of the cache? the mip_f and full caches
+// count entries and not bytes (see dt_mipmap_cache_allocate_dynamic()), and dt_cache_get() collects the
+// least recently used ones down to 80% of the quota before allocating once it is above that.
+static gboolean _dev_prefetch_fits(const dt_develop_t *dev, const dt_mipmap_size_t mip)
+{
+  const dt_cache_t *cache = mip == DT_MIPMAP_FULL ? &darktable.mipmap_cache->mip_full.cache
+                                                  : &darktable.mipmap_cache->mip_f.cache;
+  // no collection at all
+  if(cache->cost + 1 <= 0.8f * cache->cost_quota) return TRUE;
+
+  // otherwise move the edited image to the recent end, so that only older images get dropped. it is
+  // safe as long as it and both neighbours are left after the collection.
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, dev->image_storage.id, mip, DT_MIPMAP_TESTLOCK, 'r');
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  return 0.8f * cache->cost_quota > 2;
+}
+
+static int32_t _dev_prefetch_job_run(dt_job_t *job)
+{
+  const _dev_prefetch_t *params = dt_control_job_get_params(job);
+  // navigation turned around since this was queued
+  if(params->generation != g_atomic_int_get(&params->dev->prefetch_generation)) return 0;
+  if(!_dev_prefetch_fits(params->dev, params->mip))
+  {
+    dt_print(DT_DEBUG_DEV, "[darkroom] no room to prefetch image %d mip %d\n", params->imgid, params->mip);
+    return 0;
+  }
+
+  dt_print(DT_DEBUG_DEV, "[darkroom] prefetching image %d mip %d\n", params->imgid, params->mip);
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgid, params->mip, DT_MIPMAP_BLOCKING, 'r');
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  return 0;
+}
+
+static void _dev_prefetch(dt_develop_t *dev, const int32_t imgid, const dt_mipmap_size_t mip)
+{
+  dt_job_t *job = dt_control_job_create(&_dev_prefetch_job_run, "prefetch image %d mip %d", imgid, mip);
+  if(!job) return;
+  _dev_prefetch_t *params = (_dev_prefetch_t *)calloc(1, sizeof(_dev_prefetch_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return;
+  }
+  params->dev = dev;
+  params->imgid = imgid;
+  params->mip = mip;
+  params->generation = g_atomic_int_get(&dev->prefetch_generation);
+  dt_control_job_set_params_with_size(job, params, sizeof(_dev_prefetch_t), free);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+}
+
+static int32_t _dev_collection_neighbour(const int offset, const int diff)
+{
+  const gchar *qin = dt_collection_get_query(darktable.collection);
+  if(!qin || offset + diff < 0) return -1;
+
+  int32_t imgid = -1;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, offset + diff);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, 1);
+  if(sqlite3_step(stmt) == SQLITE_ROW) imgid = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+  return imgid;
+}
+
+// remember which way the user is moving through the filmstrip. turning around drops the prefetches
+// still queued for the old direction.
+static void _dev_prefetch_set_direction(dt_develop_t *dev, const int direction)
+{
+  if(direction != 0 && dev->prefetch_direction != 0 && direction != dev->prefetch_direction)
+    g_atomic_int_inc(&dev->prefetch_generation);
+  dev->prefetch_direction = direction;
+}
+
+// speculatively load the raw (and the mip f the preview pipe starts from) of the images next to the
+// current one, the one in the direction of travel last so it ends up on top of the job stack.
+static void _dev_prefetch_neighbours(dt_develop_t *dev)
+{
+  const int offset = dt_collection_image_offset(dev->image_storage.id);
+  const int ahead = dev->prefetch_direction < 0 ? -1 : 1;
+
+  const int32_t behind_id = _dev_collection_neighbour(offset, -ahead);
+  const int32_t ahead_id = _dev_collection_neighbour(offset, ahead);
+
+  if(behind_id > 0 && behind_id != dev->image_storage.id)
+  {
+    _dev_prefetch(dev, behind_id, DT_MIPMAP_F);
+    _dev_prefetch(dev, behind_id, DT_MIPMAP_FULL);
+  }
+  if(ahead_id > 0 && ahead_id != dev->image_storage.id)
+  {
+    _dev_prefetch(dev, ahead_id, DT_MIPMAP_F);
+    _dev_prefetch(dev, ahead_id, DT_MIPMAP_FULL);
+  }
+}
+
 static void dt_dev_change_image(dt_develop_t *dev, const uint32_t imgid)
 {
   // stop crazy users from sleeping on key-repeat spacebar:
@@ -914,8 +1033,8 @@ static void dt_dev_change_image(dt_develop_t *dev, const uint32_t imgid)
   // Signal develop initialize
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_IMAGE_CHANGED);
 
-  // prefetch next few from first selected image on.
-  dt_view_filmstrip_prefetch();
+  // prefetch the neighbours of the new image.
+  _dev_prefetch_neighbours(dev);
 
   // release pixel pipe mutices
   dt_pthread_mutex_BAD_unlock(&dev->preview2_pipe_mutex);
@@ -941,6 +1060,10 @@ static void film_strip_activated(const int imgid, void *data)
   const dt_view_t *self = (dt_view_t *)data;
   dt_develop_t *dev = (dt_develop_t *)self->data;
 
+  const int from = dt_collection_image_offset(dev->image_storage.id);
+  const int to = dt_collection_image_offset(imgid);
+  _dev_prefetch_set_direction(dev, to > from ? 1 : (to < from ? -1 : 0));
+
   dt_dev_change_image(dev, imgid);
   dt_view_filmstrip_scroll_to_image(darktable.view_manager, imgid, FALSE);
   // record the imgid to display when going back to lighttable
@@ -988,6 +1111,7 @@ static void dt_dev_jump_image(dt_develop_t *dev, int diff)
 
       if(!dev->image_loading)
       {
+        _dev_prefetch_set_direction(dev, diff > 0 ? 1 : -1);
         dt_dev_change_image(dev, imgid);
         dt_view_filmstrip_scroll_to_image(darktable.view_manager, imgid, FALSE);
         // record the imgid to display when going back to lighttable
@@ -2617,8 +2741,9 @@ void enter(dt_view_t *self)
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_VIEWMANAGER_FILMSTRIP_ACTIVATE,
                             G_CALLBACK(_view_darkroom_filmstrip_activate_callback), self);
 
-  // prefetch next few from first selected image on.
-  dt_view_filmstrip_prefetch();
+  // prefetch the neighbours of the image we start with.
+  dev->prefetch_direction = 0;
+  _dev_prefetch_neighbours(dev);
 
   dt_collection_hint_message(darktable.collection);
 
@@ -1046,6 +1046,75 @@ void cleanup(dt_view_t *self)
   free(self->data);
 }
 
+typedef struct _viewport_cell_t
+{
+  int32_t imgid;
+  int index;
+  float distance;
+} _viewport_cell_t;
+
+static int _viewport_cell_cmp(const void *a, const void *b)
+{
+  const _viewport_cell_t *ca = (const _viewport_cell_t *)a;
+  const _viewport_cell_t *cb = (const _viewport_cell_t *)b;
+  if(ca->distance != cb->distance) return ca->distance < cb->distance ? -1 : 1;
+  return ca->index - cb->index;
+}
+
+// hand the thumbnails of the file manager over to the mipmap cache: the visible cells from the
+// centre outwards, then the rows below the view, which are the most likely to be scrolled to.
+// query_ids holds the ids from offset on, the first skipped cells of the grid are left empty.
+static void _prefetch_viewport(dt_library_t *lib, const int *query_ids, const int max_rows, const int iir,
+                               const int32_t offset, const int skipped, const float thumb_wd,
+                               const float thumb_ht)
+{
+  const int prefetchrows = .5 * max_rows + 1;
+  const int nb_cells = max_rows * iir;
+  _viewport_cell_t *cells = malloc(sizeof(_viewport_cell_t) * (nb_cells + prefetchrows * iir));
+  if(!cells) return;
+
+  const float center_row = (MIN(lib->visible_rows, max_rows) - 1) * 0.5f;
+  const float center_col = (iir - 1) * 0.5f;
+  int count = 0;
+  for(int k = 0; k + skipped < nb_cells; k++)
+  {
+    if(query_ids[k] <= 0) break;
+    const int row = (k + skipped) / iir;
+    const int col = (k + skipped) % iir;
+    cells[count].imgid = query_ids[k];
+    cells[count].index = count;
+    cells[count].distance = (row - center_row) * (row - center_row) + (col - center_col) * (col - center_col);
+    count++;
+    if(iir == 1) break;
+  }
+  qsort(cells, count, sizeof(_viewport_cell_t), _viewport_cell_cmp);
+
+  /* clear and reset main query */
+  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
+  DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
+
+  /* setup offset and row for prefetch, only one image is shown at a time in full preview */
+  DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, offset + (iir == 1 ? 1 : nb_cells - skipped));
+  DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, prefetchrows * iir);
+
+  while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW && count < nb_cells + prefetchrows * iir)
+    cells[count++].imgid = sqlite3_column_int(lib->statements.main_query, 0);
+
+  int32_t *imgids = malloc(sizeof(int32_t) * MAX(count, 1));
+  if(imgids)
+  {
+    for(int k = 0; k < count; k++) imgids[k] = cells[k].imgid;
+
+    // same size as requested by dt_view_image_expose()
+    const float imgwd = iir == 1 ? .97f : .91f;
+    const dt_mipmap_size_t mip
+        = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, imgwd * thumb_wd, imgwd * thumb_ht);
+    dt_mipmap_cache_prefetch_viewport(darktable.mipmap_cache, imgids, count, mip);
+    free(imgids);
+  }
+  free(cells);
+}
+
 /**
  * \brief A helper function to convert grid coordinates to an absolute index
  *
@@ -1212,6 +1281,11 @@ static int expose_filemanager(dt_view_t *self, cairo_t *cr, int32_t width, int32
   }
 
 end_query_cache:
+  // thumbnails are generated from the centre of the view outwards, before the cells ask for them
+  if(offset_changed)
+    _prefetch_viewport(lib, query_ids, max_rows, iir, offset, -drawing_offset, wd - line_width,
+                       iir == 1 ? height : ht - line_width);
+
   mouse_over_id = -1;
   cairo_save(cr);
   int current_image = 0;
@@ -1585,37 +1659,6 @@ escape_image_loop:
 escape_border_loop:
   cairo_restore(cr);
 after_drawing:
-  /* check if offset was changed and we need to prefetch thumbs */
-  if(offset_changed)
-  {
-    int32_t imgids_num = 0;
-    const int prefetchrows = .5 * max_rows + 1;
-    int32_t *imgids = malloc(prefetchrows * iir * sizeof(int32_t));
-
-    /* clear and reset main query */
-    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
-    DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
-
-    /* setup offset and row for prefetch */
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, offset + max_rows * iir);
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, prefetchrows * iir);
-
-    // prefetch jobs in inverse order: supersede previous jobs: most important last
-    while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW && imgids_num < prefetchrows * iir)
-      imgids[imgids_num++] = sqlite3_column_int(lib->statements.main_query, 0);
-
-    float imgwd = iir == 1 ? 0.97 : 0.8;
-    dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, imgwd * wd,
-                                                             imgwd * (iir == 1 ? height : ht));
-    while(imgids_num > 0)
-    {
-      imgids_num--;
-      dt_mipmap_cache_get(darktable.mipmap_cache, NULL, imgids[imgids_num], mip, DT_MIPMAP_PREFETCH, 'r');
-    }
-
-    free(imgids);
-  }
-
   free(query_ids);
   // oldpan = pan;
   if(darktable.unmuted & DT_DEBUG_CACHE) dt_mipmap_cache_print(darktable.mipmap_cache);
@@ -2380,6 +2423,10 @@ static void _culling_prefetch(dt_view_t *self)
   const float imgwd = 0.97;
   const float fz = (lib->full_zoom > 1.0f) ? lib->full_zoom : 1.0f;
 
+  // the previous & next images to prefetch and their sizes
+  int32_t found[2] = { -1, -1 };
+  dt_mipmap_size_t found_mip[2] = { DT_MIPMAP_NONE, DT_MIPMAP_NONE };
+
   // we get the previous & next images infos
   for(int i = 0; i < 2; i++)
   {
@@ -2438,12 +2485,29 @@ static void _culling_prefetch(dt_view_t *self)
                                                                  imgwd * sl.height * fz);
 
         if(mip < DT_MIPMAP_8)
-          dt_mipmap_cache_get(darktable.mipmap_cache, NULL, img->imgid, mip, DT_MIPMAP_PREFETCH, 'r');
+        {
+          found[i] = img->imgid;
+          found_mip[i] = mip;
+        }
       }
       else
         img->imgid = -2; // no image available
     }
   }
+
+  // like the file manager, hand them over to the mipmap cache as one list instead of a job each, the
+  // next image first as moving forward is the most likely. the list is for one size, should the two
+  // slots need different ones only the next image gets it.
+  int32_t imgids[2];
+  dt_mipmap_size_t mip = DT_MIPMAP_NONE;
+  int count = 0;
+  for(int i = 1; i >= 0; i--)
+  {
+    if(found[i] < 0 || (count && found_mip[i] != mip)) continue;
+    mip = found_mip[i];
+    imgids[count++] = found[i];
+  }
+  if(count) dt_mipmap_cache_prefetch_viewport(darktable.mipmap_cache, imgids, count, mip);
 }
 
 static int expose_culling(dt_view_t *self, cairo_t *cr, int32_t width, int32_t height, int32_t pointerx,
@@ -2609,7 +2673,7 @@ static int expose_full_preview(dt_view_t *self, cairo_t *cr, int32_t width, int3
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), stmt_string, -1, &stmt, NULL);
 
     /* Walk through the "next" images, activate preload and find out where to go if moving */
-    int *preload_stack = malloc(preload_num * sizeof(int));
+    int32_t *preload_stack = malloc(preload_num * sizeof(int32_t));
     for(int i = 0; i < preload_num; ++i)
     {
       preload_stack[i] = -1;
@@ -2636,15 +2700,10 @@ static int expose_full_preview(dt_view_t *self, cairo_t *cr, int32_t width, int3
     if(preload)
     {
       dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, n_width, n_height);
-      /* Preload these images.
-      * The job queue is not a queue, but a stack, so we have to do it backwards.
-      * Simply swapping DESC and ASC in the SQL won't help because we rely on the LIMIT clause, and
-      * that LIMIT has to work with the "correct" sort order. One could use a subquery, but I don't
-      * think that would be terribly elegant, either. */
-      while(--count >= 0 && preload_stack[count] != -1 && mip != DT_MIPMAP_8)
-      {
-        dt_mipmap_cache_get(darktable.mipmap_cache, NULL, preload_stack[count], mip, DT_MIPMAP_PREFETCH, 'r');
-      }
+      /* Preload these images. The mipmap cache works through the list in order, so the next image
+       * is ready first, and a later move replaces what is still waiting with the new neighbours. */
+      if(mip != DT_MIPMAP_8 && count > 0)
+        dt_mipmap_cache_prefetch_viewport(darktable.mipmap_cache, preload_stack, count, mip);
     }
 
     free(preload_stack);
@@ -2665,7 +2724,7 @@ static int expose_full_preview(dt_view_t *self, cairo_t *cr, int32_t width, int3
       dt_free_align(lib->full_res_thumb);
       lib->full_res_thumb = NULL;
       dt_colorspaces_color_profile_type_t color_space;
-      if(!dt_imageio_large_thumbnail(filename, &lib->full_res_thumb,
+      if(!dt_imageio_large_thumbnail(lib->full_preview_id, filename, 0, 0, &lib->full_res_thumb,
                                                &lib->full_res_thumb_wd,
                                                &lib->full_res_thumb_ht,
                                                &color_space))
@@ -531,6 +531,20 @@ darktable.control.execute:add_return("int","The result of the system call")
 darktable.control.read:set_text("Block until a file is readable while not blocking darktable"..para()..emphasis("This function is not available on Windows builds"))
 darktable.control.read:add_parameter("file","file","The file object to wait for")
 
+darktable.batch:set_text([[This table contains functions to export many images in the background.]]..para()..
+[[The images are exported by darktable's worker threads, several at a time, without holding the lua lock. The callbacks are run from lua once the images are done.]])
+darktable.batch.export:set_text([[Start exporting a list of images and return immediately.]])
+darktable.batch.export:add_parameter("format",types.dt_imageio_module_format_t,[[The format to export to, its fields are used as the export parameters.]])
+darktable.batch.export:add_parameter("jobs","table",[[A list of tables with an ]]..code("image")..[[ field (]]..my_tostring(types.dt_lua_image_t)..[[) and a ]]..code("filename")..[[ field (string).]])
+tmp = darktable.batch.export:add_parameter("options","table",[[Optional fields:]]..para()..
+code("concurrency")..[[ : how many images to export at the same time, 2 by default. It is capped to leave one worker thread free.]]..para()..
+code("high_quality")..[[ : use high quality processing, the export module preference by default.]]..para()..
+code("upscale")..[[ : allow upscaling, false by default.]]..para()..
+code("progress")..[[ : a function called with the batch, the image, a boolean telling if it was exported, the number of images done and the total.]]..para()..
+code("done")..[[ : a function called with the batch and its results once all images are done.]])
+tmp:set_attribute("optional",true)
+darktable.batch.export:add_return(types.dt_lua_batch_t,[[The batch object, to follow or wait for the exports.]])
+
 
 darktable.gettext:set_text([[This table contains functions related to translating lua scripts]])
 darktable.gettext.gettext:set_text([[Translate a string using the darktable textdomain]])
@@ -783,6 +797,18 @@ darktable.debug.type:set_text([[Similar to the system function type() but it wil
 	types.dt_lua_backgroundjob_t.percent:set_text([[The value of the progress bar, between 0 and 1. will return nil if there is no progress bar, will raise an error if read or written on an invalid job]])
 	types.dt_lua_backgroundjob_t.valid:set_text([[True if the job is displayed, set it to false to destroy the entry]]..para().."An invalid job cannot be made valid again")
 
+	types.dt_lua_batch_t:set_text([[A set of exports running in the background, see ]]..my_tostring(darktable.batch.export))
+	types.dt_lua_batch_t.total:set_text([[The number of images in the batch]])
+	types.dt_lua_batch_t.completed:set_text([[The number of images processed so far]])
+	types.dt_lua_batch_t.finished:set_text([[True once no image of the batch is being processed anymore]])
+	types.dt_lua_batch_t.cancelled:set_text([[True if the batch has been cancelled]])
+	types.dt_lua_batch_t.results:set_text([[A table with, for each image index, true if it was exported, false if the export failed and nil if it was not processed (yet)]])
+	types.dt_lua_batch_t.wait:set_text([[Wait until the batch is finished without blocking darktable and return its results]])
+	types.dt_lua_batch_t.wait:add_parameter("self",types.dt_lua_batch_t,[[The batch to wait for]]):set_attribute("is_self",true)
+	types.dt_lua_batch_t.wait:add_return("table",[[The results, as in ]]..my_tostring(types.dt_lua_batch_t.results))
+	types.dt_lua_batch_t.cancel:set_text([[Skip the images not started yet, the ones being exported are finished]])
+	types.dt_lua_batch_t.cancel:add_parameter("self",types.dt_lua_batch_t,[[The batch to cancel]]):set_attribute("is_self",true)
+
 
 	types.dt_lua_snapshot_t:set_text([[The description of a snapshot in the snapshot lib]])
 	types.dt_lua_snapshot_t.filename:set_text([[The filename of an image containing the snapshot]])